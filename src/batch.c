@@ -0,0 +1,359 @@
+/*
+  liblightify -- library to control OSRAM's LIGHTIFY
+
+Copyright (c) 2015, Tobias Frost <tobi@coldtobi.de>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/** \file batch.c
+ *
+ * Pipelined batches of set commands.
+ *
+ * Sending one telegram and waiting for its answer costs a full round trip
+ * to the gateway per command. A batch collects many telegrams and keeps up
+ * to "window" of them in flight; the answers are matched by their token.
+ */
+
+#include "liblightify-private.h"
+#include "context.h"
+#include "frame.h"
+#include "groups.h"
+#include "log.h"
+#include "node.h"
+#include "protocol.h"
+#include "socket.h"
+#include "telegram.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BATCH_DEFAULT_WINDOW (8)
+
+enum batch_entry_state {
+	BATCH_QUEUED,
+	BATCH_IN_FLIGHT,
+	BATCH_DONE,
+};
+
+struct batch_entry {
+	unsigned char msg[TELEGRAM_MAX_SIZE];
+	unsigned char size;
+	enum batch_entry_state state;
+	int result;
+	uint32_t token;
+	struct timespec sent;
+	long latency; /**< microseconds from sending to the answer */
+};
+
+struct lightify_batch {
+	struct lightify_ctx *ctx;
+	unsigned int window;
+
+	struct batch_entry *entries;
+	unsigned int count;
+	unsigned int alloc;
+};
+
+LIGHTIFY_EXPORT int lightify_batch_new(struct lightify_ctx *ctx, struct lightify_batch **batch) {
+	struct lightify_batch *b;
+
+	if (!ctx || !batch) return -EINVAL;
+
+	b = calloc(1, sizeof(struct lightify_batch));
+	if (!b) return -ENOMEM;
+
+	b->ctx = ctx;
+	b->window = BATCH_DEFAULT_WINDOW;
+	*batch = b;
+	return 0;
+}
+
+LIGHTIFY_EXPORT int lightify_batch_free(struct lightify_batch *batch) {
+	if (!batch) return -EINVAL;
+	free(batch->entries);
+	free(batch);
+	return 0;
+}
+
+LIGHTIFY_EXPORT int lightify_batch_set_window(struct lightify_batch *batch, unsigned int window) {
+	if (!batch || !window) return -EINVAL;
+	batch->window = window;
+	return 0;
+}
+
+LIGHTIFY_EXPORT int lightify_batch_clear(struct lightify_batch *batch) {
+	if (!batch) return -EINVAL;
+	batch->count = 0;
+	return 0;
+}
+
+LIGHTIFY_EXPORT int lightify_batch_get_count(struct lightify_batch *batch) {
+	if (!batch) return -EINVAL;
+	return batch->count;
+}
+
+static struct batch_entry *batch_append(struct lightify_batch *batch) {
+	struct batch_entry *e;
+
+	if (batch->count == batch->alloc) {
+		unsigned int alloc = batch->alloc ? batch->alloc * 2 : 16;
+		e = realloc(batch->entries, alloc * sizeof(struct batch_entry));
+		if (!e) return NULL;
+		batch->entries = e;
+		batch->alloc = alloc;
+	}
+
+	e = &batch->entries[batch->count];
+	memset(e, 0, sizeof(*e));
+	e->state = BATCH_QUEUED;
+	return e;
+}
+
+/* Resolve the address: node, group or -- if both are NULL -- broadcast. */
+static int batch_address(struct lightify_node *node, struct lightify_group *group,
+		uint64_t *adr, int *isgroup) {
+	if (node && group) return -EINVAL;
+	*isgroup = 0;
+	if (node) {
+		*adr = lightify_node_get_nodeadr(node);
+	} else if (group) {
+		*adr = lightify_group_get_id(group);
+		*isgroup = 1;
+	} else {
+		*adr = UINT64_MAX;
+	}
+	return 0;
+}
+
+LIGHTIFY_EXPORT int lightify_batch_add_telegram(struct lightify_batch *batch,
+		const unsigned char *msg, size_t size) {
+	struct batch_entry *e;
+	int n;
+
+	if (!batch) return -EINVAL;
+	n = telegram_check(msg, size);
+	if (n < 0) return n;
+
+	e = batch_append(batch);
+	if (!e) return -ENOMEM;
+	memcpy(e->msg, msg, size);
+	e->size = size;
+	return batch->count++;
+}
+
+LIGHTIFY_EXPORT int lightify_batch_add_onoff(struct lightify_batch *batch,
+		struct lightify_node *node, struct lightify_group *group, int onoff) {
+	unsigned char msg[TELEGRAM_MAX_SIZE];
+	uint64_t adr;
+	int isgroup;
+
+	if (!batch || batch_address(node, group, &adr, &isgroup) < 0) return -EINVAL;
+	return lightify_batch_add_telegram(batch, msg, telegram_onoff(msg, adr, isgroup, onoff));
+}
+
+LIGHTIFY_EXPORT int lightify_batch_add_brightness(struct lightify_batch *batch,
+		struct lightify_node *node, struct lightify_group *group,
+		unsigned int level, unsigned int fadetime) {
+	unsigned char msg[TELEGRAM_MAX_SIZE];
+	uint64_t adr;
+	int isgroup;
+
+	if (!batch || batch_address(node, group, &adr, &isgroup) < 0) return -EINVAL;
+	return lightify_batch_add_telegram(batch, msg,
+			telegram_brightness(msg, adr, isgroup, level, fadetime));
+}
+
+LIGHTIFY_EXPORT int lightify_batch_add_cct(struct lightify_batch *batch,
+		struct lightify_node *node, struct lightify_group *group,
+		unsigned int cct, unsigned int fadetime) {
+	unsigned char msg[TELEGRAM_MAX_SIZE];
+	uint64_t adr;
+	int isgroup;
+
+	if (!batch || batch_address(node, group, &adr, &isgroup) < 0) return -EINVAL;
+	return lightify_batch_add_telegram(batch, msg,
+			telegram_cct(msg, adr, isgroup, cct, fadetime));
+}
+
+LIGHTIFY_EXPORT int lightify_batch_add_rgbw(struct lightify_batch *batch,
+		struct lightify_node *node, struct lightify_group *group,
+		unsigned int r, unsigned int g, unsigned int b, unsigned int w,
+		unsigned int fadetime) {
+	unsigned char msg[TELEGRAM_MAX_SIZE];
+	uint64_t adr;
+	int isgroup;
+
+	if (!batch || batch_address(node, group, &adr, &isgroup) < 0) return -EINVAL;
+	return lightify_batch_add_telegram(batch, msg,
+			telegram_rgbw(msg, adr, isgroup, r, g, b, w, fadetime));
+}
+
+LIGHTIFY_EXPORT int lightify_batch_add_color_loop(struct lightify_batch *batch,
+		struct lightify_node *node, struct lightify_group *group,
+		const struct lightify_color_loop_spec *colorspec,
+		unsigned int number_of_specs, const uint8_t static_bytes[8]) {
+	unsigned char msg[TELEGRAM_MAX_SIZE];
+	uint64_t adr;
+	int isgroup;
+	size_t size;
+
+	if (!batch || batch_address(node, group, &adr, &isgroup) < 0) return -EINVAL;
+	size = telegram_color_loop(msg, adr, isgroup, colorspec, number_of_specs, static_bytes);
+	if (!size) return -EINVAL;
+	return lightify_batch_add_telegram(batch, msg, size);
+}
+
+LIGHTIFY_EXPORT int lightify_batch_add_cct_loop(struct lightify_batch *batch,
+		struct lightify_node *node, struct lightify_group *group,
+		const struct lightify_cct_loop_spec *cctspec,
+		unsigned int number_of_specs, const uint8_t static_bytes[8]) {
+	unsigned char msg[TELEGRAM_MAX_SIZE];
+	uint64_t adr;
+	int isgroup;
+	size_t size;
+
+	if (!batch || batch_address(node, group, &adr, &isgroup) < 0) return -EINVAL;
+	size = telegram_cct_loop(msg, adr, isgroup, cctspec, number_of_specs, static_bytes);
+	if (!size) return -EINVAL;
+	return lightify_batch_add_telegram(batch, msg, size);
+}
+
+static long batch_elapsed_us(const struct timespec *since) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - since->tv_sec) * 1000000L + (now.tv_nsec - since->tv_nsec) / 1000;
+}
+
+static void batch_finish(struct lightify_batch *batch, struct batch_entry *e, int result) {
+	e->state = BATCH_DONE;
+	e->result = result;
+	if (result < 0) {
+		dbg(batch->ctx, "batch: telegram 0x%02x failed: %d\n", e->msg[HEADER_CMD], result);
+	}
+}
+
+/* The stream is unusable: everything not yet answered fails */
+static void batch_abort(struct lightify_batch *batch, int err) {
+	unsigned int i;
+	for (i = 0; i < batch->count; i++) {
+		struct batch_entry *e = &batch->entries[i];
+		if (e->state == BATCH_DONE) continue;
+		if (e->state == BATCH_IN_FLIGHT) e->latency = batch_elapsed_us(&e->sent);
+		telegram_update_nodes(batch->ctx, e->msg, err);
+		batch_finish(batch, e, err);
+	}
+}
+
+static struct batch_entry *batch_lookup(struct lightify_batch *batch, unsigned int from,
+		unsigned int to, uint32_t token) {
+	for (; from < to; from++) {
+		struct batch_entry *e = &batch->entries[from];
+		if (e->state == BATCH_IN_FLIGHT && e->token == token) return e;
+	}
+	return NULL;
+}
+
+LIGHTIFY_EXPORT int lightify_batch_run(struct lightify_batch *batch) {
+	struct lightify_ctx *ctx;
+	unsigned char answer[TELEGRAM_ANSWER_SIZE];
+	unsigned int next = 0, oldest = 0, inflight = 0, failed = 0, i;
+	struct batch_entry *e;
+	uint32_t token;
+	int n;
+
+	if (!batch) return -EINVAL;
+	ctx = batch->ctx;
+
+	for (i = 0; i < batch->count; i++) {
+		batch->entries[i].state = BATCH_QUEUED;
+		batch->entries[i].result = 0;
+		batch->entries[i].latency = 0;
+	}
+
+	while (oldest < batch->count) {
+		/* fill the window */
+		while (inflight < batch->window && next < batch->count) {
+			e = &batch->entries[next];
+			e->token = ++ctx->cnt;
+			telegram_set_token(e->msg, e->token);
+			clock_gettime(CLOCK_MONOTONIC, &e->sent);
+
+			n = lightify_io_write(ctx, e->msg, e->size);
+			if (n != e->size) {
+				batch_abort(batch, n < 0 ? n : -EIO);
+				goto out;
+			}
+			e->state = BATCH_IN_FLIGHT;
+			inflight++;
+			next++;
+		}
+
+		n = frame_read_any(ctx, answer, sizeof(answer));
+		if (n < 0) {
+			batch_abort(batch, n);
+			goto out;
+		}
+
+		token = answer[HEADER_REQ_ID_B0] | (answer[HEADER_REQ_ID_B1] << 8U) |
+				(answer[HEADER_REQ_ID_B2] << 16U) | ((uint32_t)answer[HEADER_REQ_ID_B3] << 24U);
+		e = batch_lookup(batch, oldest, next, token);
+		if (!e) {
+			dbg(ctx, "batch: dropping answer with token %u\n", token);
+			continue;
+		}
+
+		e->latency = batch_elapsed_us(&e->sent);
+		if (n != TELEGRAM_ANSWER_SIZE) {
+			telegram_update_nodes(ctx, e->msg, -EPROTO);
+			batch_finish(batch, e, -EPROTO);
+		} else {
+			batch_finish(batch, e, telegram_complete(ctx, e->msg, answer));
+		}
+		inflight--;
+
+		while (oldest < batch->count && batch->entries[oldest].state == BATCH_DONE) oldest++;
+	}
+
+out:
+	for (i = 0; i < batch->count; i++) {
+		if (batch->entries[i].result < 0) failed++;
+	}
+	return failed;
+}
+
+LIGHTIFY_EXPORT int lightify_batch_get_result(struct lightify_batch *batch, unsigned int index) {
+	if (!batch || index >= batch->count) return -EINVAL;
+	if (batch->entries[index].state != BATCH_DONE) return -EAGAIN;
+	return batch->entries[index].result;
+}
+
+LIGHTIFY_EXPORT long lightify_batch_get_latency(struct lightify_batch *batch, unsigned int index) {
+	if (!batch || index >= batch->count) return -EINVAL;
+	if (batch->entries[index].state != BATCH_DONE) return -EAGAIN;
+	return batch->entries[index].latency;
+}
@@ -0,0 +1,343 @@
+/*
+  liblightify -- library to control OSRAM's LIGHTIFY
+
+Copyright (c) 2015, Tobias Frost <tobi@coldtobi.de>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/** \file capture.c
+ *
+ * Recording of gateway sessions into a capture file and replaying them
+ * later as a transport via lightify_set_socket_fn().
+ */
+
+#include "liblightify-private.h"
+#include "context.h"
+#include "log.h"
+#include "capture.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+struct lightify_capture {
+	/** file we're recording into, NULL if not recording */
+	FILE *rec;
+	/** time the recording has been started */
+	struct timespec rec_start;
+
+	/** complete capture file to be replayed, NULL if not replaying */
+	unsigned char *play;
+	/** size of the replay buffer */
+	size_t play_size;
+	/** offset of the next record to be replayed */
+	size_t play_pos;
+	/** bytes of the current RX record already handed out */
+	size_t play_rdoff;
+	/** pace the replay to the recorded timing? */
+	int play_realtime;
+	/** time the replay has been started */
+	struct timespec play_start;
+	/** timestamp of the first record, replay time is relative to it */
+	struct timespec play_first;
+};
+
+/** A record, as parsed from the replay buffer */
+struct capture_rec {
+	struct timespec ts;
+	enum capture_direction dir;
+	const unsigned char *data;
+	size_t len;
+};
+
+static void ts_sub(struct timespec *res, const struct timespec *a, const struct timespec *b) {
+	res->tv_sec = a->tv_sec - b->tv_sec;
+	res->tv_nsec = a->tv_nsec - b->tv_nsec;
+	if (res->tv_nsec < 0) {
+		res->tv_sec--;
+		res->tv_nsec += 1000000000L;
+	}
+}
+
+static void put_le(unsigned char *p, uint32_t val, int bytes) {
+	while (bytes--) {
+		*p++ = val & 0xff;
+		val >>= 8;
+	}
+}
+
+static uint32_t get_le(const unsigned char *p, int bytes) {
+	uint32_t val = 0;
+	while (bytes--) {
+		val = val << 8 | p[bytes];
+	}
+	return val;
+}
+
+static struct lightify_capture *capture_get(struct lightify_ctx *ctx) {
+	if (!ctx->capture) ctx->capture = calloc(1, sizeof(struct lightify_capture));
+	return ctx->capture;
+}
+
+void capture_record(struct lightify_ctx *ctx, enum capture_direction dir,
+		const unsigned char *msg, size_t size) {
+
+	struct lightify_capture *c = ctx->capture;
+	unsigned char hdr[CAPTURE_REC_SIZE];
+	struct timespec now, rel;
+
+	if (!c || !c->rec) return;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ts_sub(&rel, &now, &c->rec_start);
+
+	/* oversized chunks are split, the length field is only 16 bits. */
+	do {
+		size_t len = size > 0xffff ? 0xffff : size;
+		put_le(&hdr[CAPTURE_REC_SEC_B0], rel.tv_sec, 4);
+		put_le(&hdr[CAPTURE_REC_USEC_B0], rel.tv_nsec / 1000, 4);
+		hdr[CAPTURE_REC_DIRECTION] = dir;
+		hdr[CAPTURE_REC_RESERVED] = 0;
+		put_le(&hdr[CAPTURE_REC_LEN_LSB], len, 2);
+
+		if (1 != fwrite(hdr, sizeof(hdr), 1, c->rec) ||
+				(len && 1 != fwrite(msg, len, 1, c->rec))) {
+			err(ctx, "capture write error, stopping capture\n");
+			fclose(c->rec);
+			c->rec = NULL;
+			return;
+		}
+		msg += len;
+		size -= len;
+	} while (size);
+}
+
+LIGHTIFY_EXPORT int lightify_capture_start(struct lightify_ctx *ctx, const char *filename) {
+	unsigned char hdr[CAPTURE_HDR_SIZE];
+	struct lightify_capture *c;
+
+	if (!ctx || !filename) return -EINVAL;
+	c = capture_get(ctx);
+	if (!c) return -ENOMEM;
+	if (c->rec) return -EBUSY;
+
+	c->rec = fopen(filename, "wb");
+	if (!c->rec) return -errno;
+
+	memcpy(&hdr[CAPTURE_HDR_MAGIC], CAPTURE_MAGIC, 4);
+	put_le(&hdr[CAPTURE_HDR_VERSION_LSB], CAPTURE_VERSION, 2);
+	put_le(&hdr[CAPTURE_HDR_RESERVED_LSB], 0, 2);
+	if (1 != fwrite(hdr, sizeof(hdr), 1, c->rec)) {
+		int ret = -errno;
+		fclose(c->rec);
+		c->rec = NULL;
+		return ret ? ret : -EIO;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &c->rec_start);
+	info(ctx, "capture to %s started\n", filename);
+	return 0;
+}
+
+LIGHTIFY_EXPORT int lightify_capture_stop(struct lightify_ctx *ctx) {
+	int ret;
+	if (!ctx) return -EINVAL;
+	if (!ctx->capture || !ctx->capture->rec) return -EBADF;
+
+	ret = fclose(ctx->capture->rec) ? -errno : 0;
+	ctx->capture->rec = NULL;
+	return ret;
+}
+
+/** Parse the record at offset pos.
+ *
+ * @return offset of the next record, 0 if there is no (valid) record at pos.
+ */
+static size_t replay_parse(struct lightify_capture *c, size_t pos, struct capture_rec *r) {
+	if (pos + CAPTURE_REC_SIZE > c->play_size) return 0;
+
+	const unsigned char *p = &c->play[pos];
+	r->ts.tv_sec = get_le(&p[CAPTURE_REC_SEC_B0], 4);
+	r->ts.tv_nsec = get_le(&p[CAPTURE_REC_USEC_B0], 4) * 1000L;
+	r->dir = p[CAPTURE_REC_DIRECTION];
+	r->len = get_le(&p[CAPTURE_REC_LEN_LSB], 2);
+	r->data = p + CAPTURE_REC_SIZE;
+
+	pos += CAPTURE_REC_SIZE + r->len;
+	if (pos > c->play_size) return 0;
+	return pos;
+}
+
+/** In realtime mode, sleep until the record is due. */
+static void replay_pace(struct lightify_capture *c, const struct capture_rec *r) {
+	struct timespec now, elapsed, due, wait;
+
+	if (!c->play_realtime) return;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ts_sub(&elapsed, &now, &c->play_start);
+	ts_sub(&due, &r->ts, &c->play_first);
+	ts_sub(&wait, &due, &elapsed);
+	if (wait.tv_sec < 0) return;
+
+	while (nanosleep(&wait, &wait) && errno == EINTR);
+}
+
+static int replay_write(struct lightify_ctx *ctx, unsigned char *msg, size_t size) {
+	struct lightify_capture *c = ctx->capture;
+	struct capture_rec r;
+	size_t next;
+
+	if (!c || !c->play) return -EBADF;
+
+	/* answers not consumed by the library are skipped: the library
+	 * moved on to the next request. */
+	while ((next = replay_parse(c, c->play_pos, &r)) && r.dir == CAPTURE_DIR_RX) {
+		dbg(ctx, "replay: skipping %d unread bytes\n", (int)(r.len - c->play_rdoff));
+		c->play_pos = next;
+		c->play_rdoff = 0;
+	}
+
+	if (!next) {
+		info(ctx, "replay: end of capture reached\n");
+		return -EIO;
+	}
+
+	replay_pace(c, &r);
+	c->play_pos = next;
+
+	if (r.len != size || memcmp(r.data, msg, size)) {
+		/* e.g tokens differ if the session was not replayed from a fresh context */
+		info(ctx, "replay: telegram differs from recorded one\n");
+	}
+	return size;
+}
+
+static int replay_read(struct lightify_ctx *ctx, unsigned char *msg, size_t size) {
+	struct lightify_capture *c = ctx->capture;
+	struct capture_rec r;
+	size_t next, copied = 0;
+
+	if (!c || !c->play) return -EBADF;
+
+	/* serve from consecutive RX records, as the read sizes of the recording
+	 * and the replay need not to match. */
+	while (copied < size && (next = replay_parse(c, c->play_pos, &r))
+			&& r.dir == CAPTURE_DIR_RX) {
+		size_t take = r.len - c->play_rdoff;
+		if (!c->play_rdoff) replay_pace(c, &r);
+		if (take > size - copied) take = size - copied;
+
+		memcpy(msg + copied, r.data + c->play_rdoff, take);
+		copied += take;
+		c->play_rdoff += take;
+		if (c->play_rdoff == r.len) {
+			c->play_pos = next;
+			c->play_rdoff = 0;
+		}
+	}
+	return copied;
+}
+
+LIGHTIFY_EXPORT int lightify_replay_start(struct lightify_ctx *ctx, const char *filename,
+		int realtime) {
+	struct lightify_capture *c;
+	struct capture_rec r;
+	FILE *f;
+	long size;
+	int ret = 0;
+
+	if (!ctx || !filename) return -EINVAL;
+	c = capture_get(ctx);
+	if (!c) return -ENOMEM;
+	if (c->play) return -EBUSY;
+
+	f = fopen(filename, "rb");
+	if (!f) return -errno;
+
+	if (fseek(f, 0, SEEK_END) || (size = ftell(f)) < 0 || fseek(f, 0, SEEK_SET)) {
+		ret = -errno;
+		goto out;
+	}
+	if (size < CAPTURE_HDR_SIZE) {
+		ret = -EPROTO;
+		goto out;
+	}
+
+	c->play = malloc(size);
+	if (!c->play) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	if (1 != fread(c->play, size, 1, f)) {
+		ret = -EIO;
+		goto out;
+	}
+
+	if (memcmp(&c->play[CAPTURE_HDR_MAGIC], CAPTURE_MAGIC, 4) ||
+			get_le(&c->play[CAPTURE_HDR_VERSION_LSB], 2) != CAPTURE_VERSION) {
+		info(ctx, "%s: not a capture file or unsupported version\n", filename);
+		ret = -EPROTO;
+		goto out;
+	}
+
+	c->play_size = size;
+	c->play_pos = CAPTURE_HDR_SIZE;
+	c->play_rdoff = 0;
+	c->play_realtime = realtime;
+	memset(&c->play_first, 0, sizeof(c->play_first));
+	if (replay_parse(c, c->play_pos, &r)) c->play_first = r.ts;
+	clock_gettime(CLOCK_MONOTONIC, &c->play_start);
+
+	ret = lightify_set_socket_fn(ctx, replay_write, replay_read);
+	info(ctx, "replay of %s started\n", filename);
+
+out:
+	if (ret < 0) {
+		free(c->play);
+		c->play = NULL;
+	}
+	fclose(f);
+	return ret;
+}
+
+LIGHTIFY_EXPORT int lightify_replay_stop(struct lightify_ctx *ctx) {
+	if (!ctx) return -EINVAL;
+	if (!ctx->capture || !ctx->capture->play) return -EBADF;
+
+	free(ctx->capture->play);
+	ctx->capture->play = NULL;
+	return lightify_set_socket_fn(ctx, NULL, NULL);
+}
+
+void capture_free(struct lightify_ctx *ctx) {
+	if (!ctx->capture) return;
+	if (ctx->capture->rec) fclose(ctx->capture->rec);
+	free(ctx->capture->play);
+	free(ctx->capture);
+	ctx->capture = NULL;
+}
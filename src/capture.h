@@ -0,0 +1,113 @@
+/*
+  liblightify -- library to control OSRAM's LIGHTIFY
+
+Copyright (c) 2015, Tobias Frost <tobi@coldtobi.de>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * \file capture.h
+ *
+ * Recording of gateway sessions and replay of those recordings.
+ */
+
+#ifndef SRC_CAPTURE_H_
+#define SRC_CAPTURE_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+
+/* Capture file format (all numbers little endian):
+ *
+ * File header:
+ *   4 bytes magic "LFYC"
+ *   2 bytes format version (CAPTURE_VERSION)
+ *   2 bytes reserved (0)
+ *
+ * Followed by one record per I/O chunk:
+ *   4 bytes seconds since start of capture
+ *   4 bytes microseconds
+ *   1 byte  direction (CAPTURE_DIR_TX or CAPTURE_DIR_RX)
+ *   1 byte  reserved (0)
+ *   2 bytes payload length
+ *   payload
+ */
+#define CAPTURE_MAGIC "LFYC"
+#define CAPTURE_VERSION (1)
+
+enum capture_file_header {
+	CAPTURE_HDR_MAGIC,
+	CAPTURE_HDR_VERSION_LSB = 4,
+	CAPTURE_HDR_VERSION_MSB,
+	CAPTURE_HDR_RESERVED_LSB,
+	CAPTURE_HDR_RESERVED_MSB,
+	CAPTURE_HDR_SIZE
+};
+
+enum capture_record_header {
+	CAPTURE_REC_SEC_B0,
+	CAPTURE_REC_SEC_B1,
+	CAPTURE_REC_SEC_B2,
+	CAPTURE_REC_SEC_B3,
+	CAPTURE_REC_USEC_B0,
+	CAPTURE_REC_USEC_B1,
+	CAPTURE_REC_USEC_B2,
+	CAPTURE_REC_USEC_B3,
+	CAPTURE_REC_DIRECTION,
+	CAPTURE_REC_RESERVED,
+	CAPTURE_REC_LEN_LSB,
+	CAPTURE_REC_LEN_MSB,
+	CAPTURE_REC_SIZE
+};
+
+/** Direction of a recorded chunk, as seen from the library */
+enum capture_direction {
+	CAPTURE_DIR_TX = 0, /**< library to gateway */
+	CAPTURE_DIR_RX = 1  /**< gateway to library */
+};
+
+/** Append a chunk to the capture file, if a capture is running.
+ *
+ * @param ctx library context
+ * @param dir direction of the data
+ * @param msg the data
+ * @param size number of bytes in msg
+ *
+ * \note I/O errors on the capture file are logged and will stop the
+ * capture, but will not be propagated to the request.
+ */
+void capture_record(struct lightify_ctx *ctx, enum capture_direction dir,
+		const unsigned char *msg, size_t size);
+
+/** Free all capture and replay resources of the context
+ *
+ * @param ctx library context
+ */
+void capture_free(struct lightify_ctx *ctx);
+
+#endif /* SRC_CAPTURE_H_ */
@@ -0,0 +1,232 @@
+/*
+  liblightify -- library to control OSRAM's LIGHTIFY
+
+Copyright (c) 2015, Tobias Frost <tobi@coldtobi.de>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/** \file color.c
+ *
+ * Colour math: CCT to RGB, HSV to RGBW, gamma and the CCT encoding of the
+ * loop programs.
+ *
+ * All conversions are table driven and integer only, so that converting a
+ * whole animation frame stays cheap. The _n variants convert arrays; their
+ * loops have no branches depending on the data besides the table lookups and
+ * can be vectorized by the compiler.
+ */
+
+#include "liblightify-private.h"
+#include "color.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* CCT encoding of the 0xD9 loop program. The lamp expects a piecewise linear
+ * function of the colour temperature, one segment per row:
+ * value = (base - slope * cct) / COLOR_LOOP_SCALE, rounded
+ *
+ * (Determined by experiments, it seems that there are 3 sections)
+ *
+ * Data from the experiments:
+ *
+ * | CCT   | value |
+ * |-------|-------|
+ * | 6500  | 150   |
+ * | 6000  | 163   |
+ * | 5000  | 200   |
+ * | 4500  | 220   |
+ * | 3400  | 290   |
+ * | 3000  | 325   |
+ * | 2500  | 390   |
+ */
+#define COLOR_LOOP_SCALE (10000000LL)
+
+static const struct {
+	unsigned int max_cct;
+	int64_t base;
+	int64_t slope;
+} cct_loop_segments[] = {
+	{ 3000, 7433000000LL, 1400000LL },
+	{ 4500, 5277000000LL,  686464LL },
+	{ UINT16_MAX, 3779500000LL, 354000LL },
+};
+
+uint16_t color_cct_to_loop(uint16_t cct) {
+	unsigned int i = 0;
+	int64_t tmp;
+
+	while (cct > cct_loop_segments[i].max_cct) i++;
+
+	tmp = cct_loop_segments[i].base - cct_loop_segments[i].slope * cct;
+	if (tmp <= 0) return 0;
+	return (tmp + COLOR_LOOP_SCALE / 2) / COLOR_LOOP_SCALE;
+}
+
+/* Colour of a black body, from 1000K to 12000K in 100K steps. Generated from
+ * Tanner Helland's approximation of the CIE 1964 10 degree colour matching
+ * functions. */
+#define CCT_TABLE_MIN (1000)
+#define CCT_TABLE_MAX (12000)
+#define CCT_TABLE_STEP (100)
+
+static const uint8_t cct_rgb_table[][3] = {
+	{ 255,  68,   0 }, { 255,  77,   0 }, { 255,  86,   0 }, { 255,  94,   0 },
+	{ 255, 101,   0 }, { 255, 108,   0 }, { 255, 115,   0 }, { 255, 121,   0 },
+	{ 255, 126,   0 }, { 255, 132,   0 }, { 255, 137,  14 }, { 255, 142,  27 },
+	{ 255, 146,  39 }, { 255, 151,  50 }, { 255, 155,  61 }, { 255, 159,  70 },
+	{ 255, 163,  79 }, { 255, 167,  87 }, { 255, 170,  95 }, { 255, 174, 103 },
+	{ 255, 177, 110 }, { 255, 180, 117 }, { 255, 184, 123 }, { 255, 187, 129 },
+	{ 255, 190, 135 }, { 255, 193, 141 }, { 255, 195, 146 }, { 255, 198, 151 },
+	{ 255, 201, 157 }, { 255, 203, 161 }, { 255, 206, 166 }, { 255, 208, 171 },
+	{ 255, 211, 175 }, { 255, 213, 179 }, { 255, 215, 183 }, { 255, 218, 187 },
+	{ 255, 220, 191 }, { 255, 222, 195 }, { 255, 224, 199 }, { 255, 226, 202 },
+	{ 255, 228, 206 }, { 255, 230, 209 }, { 255, 232, 213 }, { 255, 234, 216 },
+	{ 255, 236, 219 }, { 255, 237, 222 }, { 255, 239, 225 }, { 255, 241, 228 },
+	{ 255, 243, 231 }, { 255, 244, 234 }, { 255, 246, 237 }, { 255, 248, 240 },
+	{ 255, 249, 242 }, { 255, 251, 245 }, { 255, 253, 248 }, { 255, 254, 250 },
+	{ 255, 255, 255 }, { 254, 249, 255 }, { 250, 246, 255 }, { 246, 244, 255 },
+	{ 243, 242, 255 }, { 240, 240, 255 }, { 237, 239, 255 }, { 234, 237, 255 },
+	{ 232, 236, 255 }, { 230, 235, 255 }, { 228, 234, 255 }, { 226, 233, 255 },
+	{ 224, 232, 255 }, { 223, 231, 255 }, { 221, 230, 255 }, { 220, 229, 255 },
+	{ 218, 228, 255 }, { 217, 227, 255 }, { 216, 227, 255 }, { 215, 226, 255 },
+	{ 214, 225, 255 }, { 213, 225, 255 }, { 212, 224, 255 }, { 211, 223, 255 },
+	{ 210, 223, 255 }, { 209, 222, 255 }, { 208, 222, 255 }, { 207, 221, 255 },
+	{ 206, 221, 255 }, { 205, 220, 255 }, { 205, 220, 255 }, { 204, 219, 255 },
+	{ 203, 219, 255 }, { 202, 218, 255 }, { 202, 218, 255 }, { 201, 218, 255 },
+	{ 200, 217, 255 }, { 200, 217, 255 }, { 199, 217, 255 }, { 199, 216, 255 },
+	{ 198, 216, 255 }, { 197, 215, 255 }, { 197, 215, 255 }, { 196, 215, 255 },
+	{ 196, 214, 255 }, { 195, 214, 255 }, { 195, 214, 255 }, { 194, 213, 255 },
+	{ 194, 213, 255 }, { 193, 213, 255 }, { 193, 213, 255 }, { 192, 212, 255 },
+	{ 192, 212, 255 }, { 192, 212, 255 }, { 191, 211, 255 },
+};
+
+/* gamma 2.2: perceived level to linear output level */
+static const uint8_t gamma_table[256] = {
+	  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,
+	  1,   1,   1,   1,   1,   1,   1,   1,   1,   2,   2,   2,   2,   2,   2,   2,
+	  3,   3,   3,   3,   3,   4,   4,   4,   4,   5,   5,   5,   5,   6,   6,   6,
+	  6,   7,   7,   7,   8,   8,   8,   9,   9,   9,  10,  10,  11,  11,  11,  12,
+	 12,  13,  13,  13,  14,  14,  15,  15,  16,  16,  17,  17,  18,  18,  19,  19,
+	 20,  20,  21,  22,  22,  23,  23,  24,  25,  25,  26,  26,  27,  28,  28,  29,
+	 30,  30,  31,  32,  33,  33,  34,  35,  35,  36,  37,  38,  39,  39,  40,  41,
+	 42,  43,  43,  44,  45,  46,  47,  48,  49,  49,  50,  51,  52,  53,  54,  55,
+	 56,  57,  58,  59,  60,  61,  62,  63,  64,  65,  66,  67,  68,  69,  70,  71,
+	 73,  74,  75,  76,  77,  78,  79,  81,  82,  83,  84,  85,  87,  88,  89,  90,
+	 91,  93,  94,  95,  97,  98,  99, 100, 102, 103, 105, 106, 107, 109, 110, 111,
+	113, 114, 116, 117, 119, 120, 121, 123, 124, 126, 127, 129, 130, 132, 133, 135,
+	137, 138, 140, 141, 143, 145, 146, 148, 149, 151, 153, 154, 156, 158, 159, 161,
+	163, 165, 166, 168, 170, 172, 173, 175, 177, 179, 181, 182, 184, 186, 188, 190,
+	192, 194, 196, 197, 199, 201, 203, 205, 207, 209, 211, 213, 215, 217, 219, 221,
+	223, 225, 227, 229, 231, 234, 236, 238, 240, 242, 244, 246, 248, 251, 253, 255,
+};
+
+static inline void cct_to_rgbw(unsigned int cct, struct lightify_rgbw *out) {
+	unsigned int idx, frac;
+	const uint8_t *lo, *hi;
+
+	if (cct < CCT_TABLE_MIN) cct = CCT_TABLE_MIN;
+	if (cct > CCT_TABLE_MAX) cct = CCT_TABLE_MAX;
+
+	/* interpolate linearly between two table entries */
+	idx = (cct - CCT_TABLE_MIN) / CCT_TABLE_STEP;
+	frac = (cct - CCT_TABLE_MIN) % CCT_TABLE_STEP;
+	lo = cct_rgb_table[idx];
+	hi = frac ? cct_rgb_table[idx + 1] : lo;
+
+	out->red = (lo[0] * (CCT_TABLE_STEP - frac) + hi[0] * frac) / CCT_TABLE_STEP;
+	out->green = (lo[1] * (CCT_TABLE_STEP - frac) + hi[1] * frac) / CCT_TABLE_STEP;
+	out->blue = (lo[2] * (CCT_TABLE_STEP - frac) + hi[2] * frac) / CCT_TABLE_STEP;
+	out->white = 0;
+}
+
+static inline void hsv_to_rgbw(const struct lightify_hsv *in, struct lightify_rgbw *out) {
+	/* hue 0..255 is the full circle: six sectors of 256 steps each */
+	unsigned int h = in->hue * 6U;
+	unsigned int frac = h & 0xff;
+	unsigned int v = in->value, s = in->saturation;
+
+	/* the achromatic part goes to the white channel */
+	unsigned int w = v * (255 - s) / 255;
+	unsigned int c = v - w;
+	unsigned int rise = c * frac / 255;
+	unsigned int fall = c - rise;
+	unsigned int r, g, b;
+
+	switch (h >> 8) {
+	case 0: r = c; g = rise; b = 0; break;
+	case 1: r = fall; g = c; b = 0; break;
+	case 2: r = 0; g = c; b = rise; break;
+	case 3: r = 0; g = fall; b = c; break;
+	case 4: r = rise; g = 0; b = c; break;
+	default: r = c; g = 0; b = fall; break;
+	}
+
+	out->red = r;
+	out->green = g;
+	out->blue = b;
+	out->white = w;
+}
+
+LIGHTIFY_EXPORT int lightify_color_cct_to_rgbw(unsigned int cct, struct lightify_rgbw *out) {
+	if (!out) return -EINVAL;
+	cct_to_rgbw(cct, out);
+	return 0;
+}
+
+LIGHTIFY_EXPORT int lightify_color_hsv_to_rgbw(const struct lightify_hsv *in,
+		struct lightify_rgbw *out) {
+	if (!in || !out) return -EINVAL;
+	hsv_to_rgbw(in, out);
+	return 0;
+}
+
+LIGHTIFY_EXPORT uint8_t lightify_color_gamma(uint8_t level) {
+	return gamma_table[level];
+}
+
+LIGHTIFY_EXPORT int lightify_color_cct_to_rgbw_n(const uint16_t *cct,
+		struct lightify_rgbw *out, size_t n) {
+	size_t i;
+	if (n && (!cct || !out)) return -EINVAL;
+	for (i = 0; i < n; i++) cct_to_rgbw(cct[i], &out[i]);
+	return 0;
+}
+
+LIGHTIFY_EXPORT int lightify_color_hsv_to_rgbw_n(const struct lightify_hsv *in,
+		struct lightify_rgbw *out, size_t n) {
+	size_t i;
+	if (n && (!in || !out)) return -EINVAL;
+	for (i = 0; i < n; i++) hsv_to_rgbw(&in[i], &out[i]);
+	return 0;
+}
+
+LIGHTIFY_EXPORT int lightify_color_gamma_n(const uint8_t *in, uint8_t *out, size_t n) {
+	size_t i;
+	if (n && (!in || !out)) return -EINVAL;
+	for (i = 0; i < n; i++) out[i] = gamma_table[in[i]];
+	return 0;
+}
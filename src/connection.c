@@ -0,0 +1,445 @@
+/*
+  liblightify -- library to control OSRAM's LIGHTIFY
+
+Copyright (c) 2015, Tobias Frost <tobi@coldtobi.de>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/** \file connection.c
+ *
+ * Library managed connection to the gateway.
+ *
+ * Instead of setting up the socket itself and passing it via
+ * lightify_skt_setfd(), the application can tell the library where the
+ * gateway is. The library will then (re-)connect on its own: If the
+ * connection breaks during a request, it reconnects with exponential
+ * backoff and -- for idempotent telegrams -- sends the interrupted
+ * telegram again, so the request completes transparently.
+ */
+
+#include "liblightify-private.h"
+#include "context.h"
+#include "log.h"
+#include "connection.h"
+#include "protocol.h"
+#include "socket.h"
+#include "wait.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+struct lightify_conn {
+	/** gateway host and port */
+	char *host;
+	unsigned int port;
+
+	/** address of the gateway, as resolved on the last successful connect */
+	struct sockaddr_storage addr;
+	socklen_t addrlen;
+
+	/** timeout for a single connection attempt */
+	struct timeval connect_timeout;
+	/** delay before the second connection attempt, doubled on every retry */
+	struct timeval backoff_initial;
+	/** upper limit for the delay */
+	struct timeval backoff_max;
+	/** how many connection attempts for one reconnect */
+	int attempts;
+
+	/** replay idempotent telegrams after reconnect? */
+	int replay;
+
+	/** set while lightify_conn_open() is in effect */
+	int managed;
+
+	/** copy of the last telegram sent */
+	unsigned char *req;
+	size_t req_size;
+	size_t req_alloc;
+
+	/** first bytes of the current answer, to verify the replayed answer */
+	unsigned char ans_hdr[HEADER_PAYLOAD_START];
+	/** bytes of the current answer handed to the library so far */
+	size_t ans_count;
+};
+
+static struct lightify_conn *conn_get(struct lightify_ctx *ctx) {
+	struct lightify_conn *c = ctx->conn;
+	if (c) return c;
+
+	c = calloc(1, sizeof(struct lightify_conn));
+	if (!c) return NULL;
+
+	c->connect_timeout.tv_sec = 2;
+	c->backoff_initial.tv_usec = 50000;
+	c->backoff_max.tv_sec = 2;
+	c->attempts = 5;
+	c->replay = 1;
+	ctx->conn = c;
+	return c;
+}
+
+/** Is it safe to send this command twice? */
+static int is_idempotent(unsigned char cmd) {
+	switch (cmd) {
+		/* queries */
+		case 0x13: case 0x1e: case 0x68:
+		/* setting absolute values */
+		case 0x31: case 0x32: case 0x33: case 0x36:
+		/* (re)starting a loop */
+		case 0xd8: case 0xd9:
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+/** Connect to addr, non-blocking with timeout.
+ *
+ * The timeout is clamped to the deadline of the request in flight.
+ *
+ * @return fd on success, negative on error
+ */
+static int connect_addr(struct lightify_ctx *ctx, struct lightify_conn *c,
+		const struct sockaddr *addr, socklen_t len) {
+	int fd, n;
+	int one = 1;
+	socklen_t sl = sizeof(n);
+	struct pollfd pfd;
+	struct timespec dl;
+
+	fd = socket(addr->sa_family, SOCK_STREAM, 0);
+	if (fd < 0) return -errno;
+
+	n = fcntl(fd, F_GETFL, 0);
+	if (n < 0 || fcntl(fd, F_SETFL, n | O_NONBLOCK) < 0) goto err_out;
+
+	/* telegrams are small and latency matters */
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	if (0 == connect(fd, addr, len)) return fd;
+	if (errno != EINPROGRESS) goto err_out;
+
+	wait_deadline_set(&dl, c->connect_timeout);
+	wait_deadline_clamp(ctx, &dl);
+
+	pfd.fd = fd;
+	pfd.events = POLLOUT;
+	do {
+		n = poll(&pfd, 1, wait_remaining_ms(&dl));
+	} while (n < 0 && errno == EINTR);
+	if (n < 0) goto err_out;
+	if (n == 0) {
+		close(fd);
+		return -ETIMEDOUT;
+	}
+
+	if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &n, &sl) < 0) goto err_out;
+	if (n) {
+		close(fd);
+		return -n;
+	}
+	return fd;
+
+err_out:
+	n = -errno;
+	close(fd);
+	return n;
+}
+
+/** Has the request in flight run out of time? */
+static int conn_expired(struct lightify_ctx *ctx) {
+	return ctx->has_req_deadline && wait_deadline_expired(&ctx->req_deadline);
+}
+
+/** One connection attempt: Try the last known good address, then resolve.
+ *
+ * @return fd on success, negative on error
+ */
+static int connect_once(struct lightify_ctx *ctx, struct lightify_conn *c) {
+	struct addrinfo hints, *res, *ai;
+	char port[8];
+	int fd = -EHOSTUNREACH;
+	int n;
+
+	if (c->addrlen) {
+		fd = connect_addr(ctx, c, (struct sockaddr*) &c->addr, c->addrlen);
+		if (fd >= 0) return fd;
+		/* maybe the gateway got a new address. */
+		c->addrlen = 0;
+	}
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	snprintf(port, sizeof(port), "%u", c->port);
+
+	n = getaddrinfo(c->host, port, &hints, &res);
+	if (n) {
+		info(ctx, "cannot resolve %s: %s\n", c->host, gai_strerror(n));
+		return -EHOSTUNREACH;
+	}
+
+	for (ai = res; ai; ai = ai->ai_next) {
+		if (conn_expired(ctx)) {
+			fd = -ETIMEDOUT;
+			break;
+		}
+		fd = connect_addr(ctx, c, ai->ai_addr, ai->ai_addrlen);
+		if (fd >= 0) {
+			memcpy(&c->addr, ai->ai_addr, ai->ai_addrlen);
+			c->addrlen = ai->ai_addrlen;
+			break;
+		}
+	}
+	freeaddrinfo(res);
+	return fd;
+}
+
+static void conn_close_fd(struct lightify_ctx *ctx) {
+	int fd = lightify_skt_getfd(ctx);
+	if (fd < 0) return;
+	lightify_skt_setfd(ctx, -1);
+	close(fd);
+}
+
+int conn_reconnect(struct lightify_ctx *ctx) {
+	struct lightify_conn *c = ctx->conn;
+	struct timespec delay;
+	int i, fd = -EINVAL;
+
+	if (!c || !c->host) return -EINVAL;
+
+	/* only close fds we own */
+	if (c->managed) conn_close_fd(ctx);
+
+	delay.tv_sec = c->backoff_initial.tv_sec;
+	delay.tv_nsec = c->backoff_initial.tv_usec * 1000L;
+
+	for (i = 0; i < c->attempts; i++) {
+		if (conn_expired(ctx)) {
+			info(ctx, "request deadline exceeded while connecting\n");
+			return -ETIMEDOUT;
+		}
+		if (i) {
+			struct timespec wake;
+			struct timeval tv;
+
+			/* sleep until the backoff passed, but not beyond the deadline */
+			tv.tv_sec = delay.tv_sec;
+			tv.tv_usec = delay.tv_nsec / 1000;
+			wait_deadline_set(&wake, tv);
+			wait_deadline_clamp(ctx, &wake);
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL) == EINTR);
+			if (conn_expired(ctx)) {
+				info(ctx, "request deadline exceeded while connecting\n");
+				return -ETIMEDOUT;
+			}
+
+			/* exponential backoff, capped */
+			delay.tv_sec *= 2;
+			delay.tv_nsec *= 2;
+			if (delay.tv_nsec >= 1000000000L) {
+				delay.tv_sec++;
+				delay.tv_nsec -= 1000000000L;
+			}
+			if (delay.tv_sec > c->backoff_max.tv_sec ||
+					(delay.tv_sec == c->backoff_max.tv_sec &&
+					delay.tv_nsec > c->backoff_max.tv_usec * 1000L)) {
+				delay.tv_sec = c->backoff_max.tv_sec;
+				delay.tv_nsec = c->backoff_max.tv_usec * 1000L;
+			}
+		}
+
+		fd = connect_once(ctx, c);
+		if (fd >= 0) {
+			info(ctx, "connected to %s:%u (attempt %d)\n", c->host, c->port, i + 1);
+			return lightify_skt_setfd(ctx, fd);
+		}
+		dbg(ctx, "connect to %s:%u failed: %d\n", c->host, c->port, fd);
+	}
+
+	err(ctx, "giving up connecting to %s:%u after %d attempts\n", c->host, c->port, i);
+	return fd;
+}
+
+int conn_is_managed(struct lightify_ctx *ctx) {
+	return ctx->conn && ctx->conn->managed &&
+			ctx->socket_read_fn == read_from_socket &&
+			ctx->socket_write_fn == write_to_socket;
+}
+
+void conn_track_request(struct lightify_ctx *ctx, const unsigned char *msg, size_t size) {
+	struct lightify_conn *c = ctx->conn;
+
+	c->ans_count = 0;
+	c->req_size = 0;
+	if (size > c->req_alloc) {
+		unsigned char *tmp = realloc(c->req, size);
+		/* without a copy, we just cannot replay. */
+		if (!tmp) return;
+		c->req = tmp;
+		c->req_alloc = size;
+	}
+	memcpy(c->req, msg, size);
+	c->req_size = size;
+}
+
+void conn_track_answer(struct lightify_ctx *ctx, const unsigned char *msg, size_t size) {
+	struct lightify_conn *c = ctx->conn;
+	size_t i;
+
+	for (i = 0; i < size && c->ans_count + i < sizeof(c->ans_hdr); i++) {
+		c->ans_hdr[c->ans_count + i] = msg[i];
+	}
+	c->ans_count += size;
+}
+
+int conn_replay_request(struct lightify_ctx *ctx, const unsigned char *msg, size_t got) {
+	struct lightify_conn *c = ctx->conn;
+	unsigned char hdr[HEADER_PAYLOAD_START];
+	unsigned char buf[64];
+	size_t skip, pos, i;
+	int n;
+
+	if (!c->replay || !c->req_size || !is_idempotent(c->req[HEADER_CMD])) return -EIO;
+
+	/* the part of the answer we've already got, incl. the partial read */
+	memcpy(hdr, c->ans_hdr, sizeof(hdr));
+	for (i = 0; i < got && c->ans_count + i < sizeof(hdr); i++) {
+		hdr[c->ans_count + i] = msg[i];
+	}
+	skip = c->ans_count + got;
+
+	n = conn_reconnect(ctx);
+	if (n < 0) return n;
+
+	info(ctx, "replaying telegram 0x%02x after reconnect\n", c->req[HEADER_CMD]);
+	n = ctx->socket_write_fn(ctx, c->req, c->req_size);
+	if (n != (int) c->req_size) return n < 0 ? n : -EIO;
+
+	/* drop what the library already consumed, but verify that
+	 * the answer is the same as far as we've seen the header. */
+	for (pos = 0; pos < skip; pos += n) {
+		size_t chunk = skip - pos;
+		if (chunk > sizeof(buf)) chunk = sizeof(buf);
+		n = ctx->socket_read_fn(ctx, buf, chunk);
+		if (n <= 0) return n < 0 ? n : -EIO;
+		for (i = 0; i < (size_t) n && pos + i < sizeof(hdr); i++) {
+			if (buf[i] != hdr[pos + i]) {
+				info(ctx, "replayed answer differs, giving up\n");
+				return -EPROTO;
+			}
+		}
+	}
+	return 0;
+}
+
+void conn_free(struct lightify_ctx *ctx) {
+	struct lightify_conn *c = ctx->conn;
+	if (!c) return;
+	if (c->managed) conn_close_fd(ctx);
+	free(c->host);
+	free(c->req);
+	free(c);
+	ctx->conn = NULL;
+}
+
+LIGHTIFY_EXPORT int lightify_conn_set_host(struct lightify_ctx *ctx, const char *host,
+		unsigned int port) {
+	struct lightify_conn *c;
+	char *tmp;
+
+	if (!ctx || !host || port > 0xffff) return -EINVAL;
+	c = conn_get(ctx);
+	if (!c) return -ENOMEM;
+
+	tmp = strdup(host);
+	if (!tmp) return -ENOMEM;
+	free(c->host);
+	c->host = tmp;
+	c->port = port;
+	c->addrlen = 0;
+	return 0;
+}
+
+LIGHTIFY_EXPORT int lightify_conn_set_timeout(struct lightify_ctx *ctx, struct timeval tv) {
+	struct lightify_conn *c;
+	if (!ctx) return -EINVAL;
+	c = conn_get(ctx);
+	if (!c) return -ENOMEM;
+	c->connect_timeout = tv;
+	return 0;
+}
+
+LIGHTIFY_EXPORT int lightify_conn_set_backoff(struct lightify_ctx *ctx,
+		struct timeval initial, struct timeval max, int attempts) {
+	struct lightify_conn *c;
+	if (!ctx || attempts < 1) return -EINVAL;
+	c = conn_get(ctx);
+	if (!c) return -ENOMEM;
+	c->backoff_initial = initial;
+	c->backoff_max = max;
+	c->attempts = attempts;
+	return 0;
+}
+
+LIGHTIFY_EXPORT int lightify_conn_set_replay(struct lightify_ctx *ctx, int enable) {
+	struct lightify_conn *c;
+	if (!ctx) return -EINVAL;
+	c = conn_get(ctx);
+	if (!c) return -ENOMEM;
+	c->replay = (enable != 0);
+	return 0;
+}
+
+LIGHTIFY_EXPORT int lightify_conn_open(struct lightify_ctx *ctx) {
+	int ret;
+	if (!ctx || !ctx->conn || !ctx->conn->host) return -EINVAL;
+
+	/* not part of a request: no request deadline applies */
+	ctx->has_req_deadline = 0;
+	ret = conn_reconnect(ctx);
+	if (ret < 0) return ret;
+	ctx->conn->managed = 1;
+	return 0;
+}
+
+LIGHTIFY_EXPORT int lightify_conn_close(struct lightify_ctx *ctx) {
+	if (!ctx) return -EINVAL;
+	if (!ctx->conn || !ctx->conn->managed) return -EBADF;
+	ctx->conn->managed = 0;
+	conn_close_fd(ctx);
+	return 0;
+}
@@ -0,0 +1,98 @@
+/*
+  liblightify -- library to control OSRAM's LIGHTIFY
+
+Copyright (c) 2015, Tobias Frost <tobi@coldtobi.de>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * \file connection.h
+ *
+ * Library managed connection to the gateway: connect, reconnect with
+ * backoff and replay of the interrupted request.
+ */
+
+#ifndef SRC_CONNECTION_H_
+#define SRC_CONNECTION_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+
+/** Check if the connection is managed by the library
+ *
+ * That is, lightify_conn_open() has been called and the default I/O
+ * functions are in use.
+ *
+ * @param ctx library context
+ * @return non-zero if managed
+ */
+int conn_is_managed(struct lightify_ctx *ctx);
+
+/** Remember the telegram just sent, so that it can be replayed
+ * after a reconnect.
+ *
+ * @param ctx library context
+ * @param msg telegram
+ * @param size telegram size
+ */
+void conn_track_request(struct lightify_ctx *ctx, const unsigned char *msg, size_t size);
+
+/** Account answer bytes handed to the library
+ *
+ * @param ctx library context
+ * @param msg data read
+ * @param size number of bytes read
+ */
+void conn_track_answer(struct lightify_ctx *ctx, const unsigned char *msg, size_t size);
+
+/** Re-establish the connection (with backoff)
+ *
+ * @param ctx library context
+ * @return 0 on success, negative on error
+ */
+int conn_reconnect(struct lightify_ctx *ctx);
+
+/** Recover from an interrupted answer: Reconnect, send the last telegram
+ * again and skip the part of the answer the library already consumed.
+ *
+ * Only done if replay is enabled and the last telegram is idempotent.
+ *
+ * @param ctx library context
+ * @param msg partial data of the failed read
+ * @param got number of bytes in msg
+ * @return 0 if the answer can be read again, negative on error.
+ */
+int conn_replay_request(struct lightify_ctx *ctx, const unsigned char *msg, size_t got);
+
+/** Close the connection and free all associated resources
+ *
+ * @param ctx library context
+ */
+void conn_free(struct lightify_ctx *ctx);
+
+#endif /* SRC_CONNECTION_H_ */
@@ -32,12 +32,19 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "log.h"
 #include "node.h"
 #include "groups.h"
+#include "capture.h"
+#include "color.h"
+#include "connection.h"
+#include "protocol.h"
+#include "shm.h"
+#include "snapshot.h"
+#include "telegram.h"
+#include "wait.h"
 
 #include "socket.h"
 
 #include <errno.h>
 #include <fcntl.h>
-#include <math.h>
 #include <string.h>
 #include <unistd.h>
 
@@ -47,18 +54,6 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #endif
 
 
-enum msg_header {
-	HEADER_LEN_LSB,
-	HEADER_LEN_MSB,
-	HEADER_FLAGS,
-	HEADER_CMD,
-	HEADER_REQ_ID_B0,
-	HEADER_REQ_ID_B1,
-	HEADER_REQ_ID_B2,
-	HEADER_REQ_ID_B3,
-	HEADER_PAYLOAD_START
-};
-
 enum msg_0x13_query {
 	QUERY_0x13_REQTYPE = HEADER_PAYLOAD_START,
 	QUERY_0x13_SIZE
@@ -406,10 +401,9 @@ static int decode_status(unsigned char code) {
 LIGHTIFY_EXPORT struct lightify_node *lightify_node_get_from_mac(struct lightify_ctx *ctx, uint64_t mac) {
 	if (!ctx) return NULL;
 
-	struct lightify_node *ret = ctx->nodes;
-	while(ret) {
-		if (lightify_node_get_nodeadr(ret) == mac) return ret;
-		ret = lightify_node_get_nextnode(ret);
+	size_t i;
+	for (i = 0; i < ctx->nodes_count; i++) {
+		if (lightify_node_get_nodeadr(ctx->nodes[i]) == mac) return ctx->nodes[i];
 	}
 	return NULL;
 }
@@ -496,7 +490,7 @@ LIGHTIFY_EXPORT struct lightify_node* lightify_node_get_next(struct lightify_ctx
 
 	if(!ctx) return NULL;
 	if(node) return lightify_node_get_nextnode(node);
-	return ctx->nodes;
+	return ctx->nodes_count ? ctx->nodes[0] : NULL;
 }
 
 LIGHTIFY_EXPORT struct lightify_node* lightify_node_get_previous(struct lightify_ctx *ctx,
@@ -567,19 +561,22 @@ LIGHTIFY_EXPORT int lightify_new(struct lightify_ctx **ctx, void *reserved)
         return 0;
 }
 
+/* remove from the end, so that no entries need to be moved */
 static void free_all_nodes(struct lightify_ctx *ctx) {
 	if (!ctx) return;
-        while(ctx->nodes) {
-		dbg(ctx, "freeing node %p.\n", ctx->nodes);
-		lightify_node_remove(ctx->nodes);
+        while(ctx->nodes_count) {
+		struct lightify_node *node = ctx->nodes[ctx->nodes_count - 1];
+		dbg(ctx, "freeing node %p.\n", node);
+		lightify_node_remove(node);
         }
 }
 
 static void free_all_groups(struct lightify_ctx *ctx) {
 	if (!ctx) return;
-        while(ctx->groups) {
-		dbg(ctx, "freeing group %p.\n", ctx->groups);
-		lightify_group_remove(ctx->groups);
+        while(ctx->groups_count) {
+		struct lightify_group *grp = ctx->groups[ctx->groups_count - 1];
+		dbg(ctx, "freeing group %p.\n", grp);
+		lightify_group_remove(grp);
         }
 }
 
@@ -588,12 +585,42 @@ LIGHTIFY_EXPORT int lightify_free(struct lightify_ctx *ctx) {
 
 	free_all_nodes(ctx);
 	free_all_groups(ctx);
+	snapshot_free(ctx);
+	shm_free(ctx);
+	lightify_nodes_release(ctx);
+	free(ctx->groups);
+	capture_free(ctx);
+	conn_free(ctx);
+	wait_free(ctx);
 
 	dbg(ctx, "context %p freed.\n", ctx);
 	free(ctx);
 	return 0;
 }
 
+LIGHTIFY_EXPORT int lightify_set_cache_ttl(struct lightify_ctx *ctx, struct timeval ttl) {
+	if (!ctx || ttl.tv_sec < 0 || ttl.tv_usec < 0) return -EINVAL;
+	ctx->cache_ttl = ttl;
+	/* freshness was computed with the old ttl */
+	ctx->nodes_fresh = 0;
+	ctx->groups_fresh = 0;
+	return 0;
+}
+
+LIGHTIFY_EXPORT int lightify_cache_invalidate(struct lightify_ctx *ctx) {
+	if (!ctx) return -EINVAL;
+	ctx->nodes_fresh = 0;
+	ctx->groups_fresh = 0;
+	return 0;
+}
+
+/* check if a scan result can be reused instead of asking the gateway */
+static int cache_is_fresh(struct lightify_ctx *ctx, int fresh, const struct timespec *until) {
+	if (!fresh) return 0;
+	if (!ctx->cache_ttl.tv_sec && !ctx->cache_ttl.tv_usec) return 0;
+	return !wait_deadline_expired(until);
+}
+
 LIGHTIFY_EXPORT int lightify_node_request_scan(struct lightify_ctx *ctx) {
 	int ret;
 	int n,m;
@@ -603,6 +630,11 @@ LIGHTIFY_EXPORT int lightify_node_request_scan(struct lightify_ctx *ctx) {
 
 	if (!ctx) return -EINVAL;
 
+	if (cache_is_fresh(ctx, ctx->nodes_fresh, &ctx->nodes_fresh_until)) {
+		dbg(ctx, "0x13: using cached scan\n");
+		return ctx->nodes_count;
+	}
+
 	/* if using standard I/O functions, fd must be valid. If the user overrode those function,
 	 we won't care */
 	if (ctx->socket_read_fn == read_from_socket
@@ -612,6 +644,7 @@ LIGHTIFY_EXPORT int lightify_node_request_scan(struct lightify_ctx *ctx) {
 
 	/* remove old node information */
 	free_all_nodes(ctx);
+	ctx->nodes_fresh = 0;
 
 	token = ++ctx->cnt;
 
@@ -623,7 +656,7 @@ LIGHTIFY_EXPORT int lightify_node_request_scan(struct lightify_ctx *ctx) {
 	fill_telegram_header(msg, QUERY_0x13_SIZE, token, 0x00, 0x13);
 	msg[QUERY_0x13_REQTYPE] = 0x01;
 
-	n = ctx->socket_write_fn(ctx, msg, QUERY_0x13_SIZE);
+	n = lightify_io_write(ctx, msg, QUERY_0x13_SIZE);
 	if ( n < 0 ) {
 		info(ctx,"socket_write_fn error %d\n", n);
 		return n;
@@ -634,7 +667,7 @@ LIGHTIFY_EXPORT int lightify_node_request_scan(struct lightify_ctx *ctx) {
 	}
 
 	/* read the header */
-	n = ctx->socket_read_fn(ctx, msg, ANSWER_0x13_SIZE);
+	n = lightify_io_read(ctx, msg, ANSWER_0x13_SIZE);
 	if (n < 0) {
 		info(ctx,"socket_read_fn error %d\n", n);
 		return n;
@@ -679,12 +712,15 @@ LIGHTIFY_EXPORT int lightify_node_request_scan(struct lightify_ctx *ctx) {
 		info(ctx, "strange byte at PAYLOAD_START: %d\n", msg[HEADER_PAYLOAD_START]);
 	}
 
+	n = lightify_nodes_reserve(ctx, no_of_nodes);
+	if (n < 0) return n;
+
 	ret = 0;
 	/* read each node..*/
 	while(no_of_nodes--) {
 		uint64_t tmp64;
 		struct lightify_node *node = NULL;
-		n = ctx->socket_read_fn(ctx, msg, read_size);
+		n = lightify_io_read(ctx, msg, read_size);
 		if (n< 0) return n;
 		if (read_size != n ) {
 			info(ctx,"read node info: short read %d!=%d\n", read_size, n);
@@ -785,6 +821,8 @@ LIGHTIFY_EXPORT int lightify_node_request_scan(struct lightify_ctx *ctx) {
 		lightify_node_set_stale(node, 0);
 		ret++;
 	}
+	wait_deadline_set(&ctx->nodes_fresh_until, ctx->cache_ttl);
+	ctx->nodes_fresh = 1;
 	return ret;
 }
 
@@ -803,7 +841,7 @@ static int lightify_request_set_onoff(struct lightify_ctx *ctx, uint64_t adr, in
 	msg_from_uint64(&msg[QUERY_0x32_NODEADR64_B0], adr);
 	msg[QUERY_0x32_ONOFF] = onoff;
 
-	n = ctx->socket_write_fn(ctx,msg, QUERY_0x32_SIZE);
+	n = lightify_io_write(ctx, msg, QUERY_0x32_SIZE);
 	if ( n < 0 ) {
 		info(ctx,"socket_write_fn error %d\n", n);
 		return n;
@@ -814,7 +852,7 @@ static int lightify_request_set_onoff(struct lightify_ctx *ctx, uint64_t adr, in
 	}
 
 	/* read the header */
-	n = ctx->socket_read_fn(ctx, msg, ANSWER_0x32_SIZE);
+	n = lightify_io_read(ctx, msg, ANSWER_0x32_SIZE);
 	if (n < 0) {
 		info(ctx,"socket_read_fn error %d\n", n);
 		return n;
@@ -865,7 +903,7 @@ static int lightify_request_set_cct(struct lightify_ctx *ctx, uint64_t adr, int
 	msg[QUERY_0x33_FADETIME_LSB] = fadetime & 0xff;
 	msg[QUERY_0x33_FADETIME_MSB] = (fadetime >> 8 ) & 0xff;
 
-	n = ctx->socket_write_fn(ctx,msg, QUERY_0x33_SIZE);
+	n = lightify_io_write(ctx, msg, QUERY_0x33_SIZE);
 	if ( n < 0 ) {
 		info(ctx,"socket_write_fn error %d\n", n);
 		return n;
@@ -876,7 +914,7 @@ static int lightify_request_set_cct(struct lightify_ctx *ctx, uint64_t adr, int
 	}
 
 	/* read the header */
-	n = ctx->socket_read_fn(ctx, msg, ANSWER_0x33_SIZE);
+	n = lightify_io_read(ctx, msg, ANSWER_0x33_SIZE);
 	if (n < 0) {
 		info(ctx,"socket_read_fn error %d\n", n);
 		return n;
@@ -923,7 +961,7 @@ static int lightify_request_set_rgbw(struct lightify_ctx *ctx, uint64_t adr,
 	msg[QUERY_0x36_FADETIME_LSB] = fadetime & 0xff;
 	msg[QUERY_0x36_FADETIME_MSB] = (fadetime >> 8 ) & 0xff;
 
-	n = ctx->socket_write_fn(ctx,msg, QUERY_0x36_SIZE);
+	n = lightify_io_write(ctx, msg, QUERY_0x36_SIZE);
 	if ( n < 0 ) {
 		info(ctx,"socket_write_fn error %d\n", n);
 		return n;
@@ -934,7 +972,7 @@ static int lightify_request_set_rgbw(struct lightify_ctx *ctx, uint64_t adr,
 	}
 
 	/* read the header */
-	n = ctx->socket_read_fn(ctx, msg, ANSWER_0x36_SIZE);
+	n = lightify_io_read(ctx, msg, ANSWER_0x36_SIZE);
 	if (n != ANSWER_0x36_SIZE) {
 		info(ctx,"short read %d!=%d\n", ANSWER_0x36_SIZE, n);
 		return -EIO;
@@ -974,7 +1012,7 @@ static int lightify_request_set_brightness(struct lightify_ctx *ctx, uint64_t ad
 	msg[QUERY_0x31_FADETIME_LSB] = fadetime & 0xff;
 	msg[QUERY_0x31_FADETIME_MSB] = (fadetime >> 8 ) & 0xff;
 
-	n = ctx->socket_write_fn(ctx,msg, QUERY_0x31_SIZE);
+	n = lightify_io_write(ctx, msg, QUERY_0x31_SIZE);
 	if ( n < 0 ) {
 		info(ctx,"socket_write_fn error %d\n", n);
 		return n;
@@ -985,7 +1023,7 @@ static int lightify_request_set_brightness(struct lightify_ctx *ctx, uint64_t ad
 	}
 
 	/* read the header */
-	n = ctx->socket_read_fn(ctx,msg,ANSWER_0x31_SIZE);
+	n = lightify_io_read(ctx, msg,ANSWER_0x31_SIZE);
 	if (n < 0) {
 		info(ctx,"socket_read_fn error %d\n", n);
 		return n;
@@ -1013,6 +1051,179 @@ static int lightify_request_set_brightness(struct lightify_ctx *ctx, uint64_t ad
 	return n;
 }
 
+/* Telegrams of the set commands, for lightify_request_telegram() and the
+ * batch API. The token is left at zero, see telegram_set_token(). */
+
+size_t telegram_onoff(unsigned char *msg, uint64_t adr, int isgroup, int onoff) {
+	fill_telegram_header(msg, QUERY_0x32_SIZE, 0, isgroup ? 2 : 0, 0x32);
+	msg_from_uint64(&msg[QUERY_0x32_NODEADR64_B0], adr);
+	msg[QUERY_0x32_ONOFF] = (onoff != 0);
+	return QUERY_0x32_SIZE;
+}
+
+size_t telegram_brightness(unsigned char *msg, uint64_t adr, int isgroup,
+		unsigned int level, unsigned int fadetime) {
+	fill_telegram_header(msg, QUERY_0x31_SIZE, 0, isgroup ? 2 : 0, 0x31);
+	msg_from_uint64(&msg[QUERY_0x31_NODEADR64_B0], adr);
+	msg[QUERY_0x31_LEVEL] = level & 0xff;
+	msg[QUERY_0x31_FADETIME_LSB] = fadetime & 0xff;
+	msg[QUERY_0x31_FADETIME_MSB] = (fadetime >> 8) & 0xff;
+	return QUERY_0x31_SIZE;
+}
+
+size_t telegram_cct(unsigned char *msg, uint64_t adr, int isgroup,
+		unsigned int cct, unsigned int fadetime) {
+	fill_telegram_header(msg, QUERY_0x33_SIZE, 0, isgroup ? 2 : 0, 0x33);
+	msg_from_uint64(&msg[QUERY_0x33_NODEADR64_B0], adr);
+	msg[QUERY_0x33_CCT_LSB] = cct & 0xff;
+	msg[QUERY_0x33_CCT_MSB] = (cct >> 8) & 0xff;
+	msg[QUERY_0x33_FADETIME_LSB] = fadetime & 0xff;
+	msg[QUERY_0x33_FADETIME_MSB] = (fadetime >> 8) & 0xff;
+	return QUERY_0x33_SIZE;
+}
+
+size_t telegram_rgbw(unsigned char *msg, uint64_t adr, int isgroup,
+		unsigned int r, unsigned int g, unsigned int b, unsigned int w,
+		unsigned int fadetime) {
+	fill_telegram_header(msg, QUERY_0x36_SIZE, 0, isgroup ? 2 : 0, 0x36);
+	msg_from_uint64(&msg[QUERY_0x36_NODEADR64_B0], adr);
+	msg[QUERY_0x36_R] = r & 0xff;
+	msg[QUERY_0x36_G] = g & 0xff;
+	msg[QUERY_0x36_B] = b & 0xff;
+	msg[QUERY_0x36_W] = w & 0xff;
+	msg[QUERY_0x36_FADETIME_LSB] = fadetime & 0xff;
+	msg[QUERY_0x36_FADETIME_MSB] = (fadetime >> 8) & 0xff;
+	return QUERY_0x36_SIZE;
+}
+
+int telegram_check(const unsigned char *msg, size_t size) {
+	size_t expected;
+
+	if (!msg || size < HEADER_PAYLOAD_START) return -EINVAL;
+
+	switch (msg[HEADER_CMD]) {
+	case 0x31: expected = QUERY_0x31_SIZE; break;
+	case 0x32: expected = QUERY_0x32_SIZE; break;
+	case 0x33: expected = QUERY_0x33_SIZE; break;
+	case 0x36: expected = QUERY_0x36_SIZE; break;
+	case 0xd8: expected = QUERY_0xD8_START_OF_PROGRAMM + 1 + LOOP_STEPS * STEP_0xD8_SIZE; break;
+	case 0xd9: expected = QUERY_0xD9_START_OF_PROGRAMM + 1 + LOOP_STEPS * STEP_0xD9_SIZE; break;
+	default: return -EINVAL;
+	}
+	if (size != expected) return -EINVAL;
+	if ((size_t)(msg[HEADER_LEN_LSB] | msg[HEADER_LEN_MSB] << 8) != size - 2) return -EINVAL;
+	return 0;
+}
+
+void telegram_set_token(unsigned char *msg, uint32_t token) {
+	msg[HEADER_REQ_ID_B0] = token & 0xff;
+	msg[HEADER_REQ_ID_B1] = token >> 8 & 0xff;
+	msg[HEADER_REQ_ID_B2] = token >> 16 & 0xff;
+	msg[HEADER_REQ_ID_B3] = token >> 24 & 0xff;
+}
+
+static void telegram_update_node(struct lightify_node *node,
+		const unsigned char *msg, int status) {
+	switch (msg[HEADER_CMD]) {
+	case 0x31:
+		lightify_node_set_brightness(node, msg[QUERY_0x31_LEVEL]);
+		lightify_node_set_onoff(node, msg[QUERY_0x31_LEVEL] != 0);
+		break;
+	case 0x32:
+		lightify_node_set_onoff(node, msg[QUERY_0x32_ONOFF] != 0);
+		break;
+	case 0x33:
+		lightify_node_set_cct(node, msg[QUERY_0x33_CCT_LSB] | msg[QUERY_0x33_CCT_MSB] << 8);
+		break;
+	case 0x36:
+		lightify_node_set_red(node, msg[QUERY_0x36_R]);
+		lightify_node_set_green(node, msg[QUERY_0x36_G]);
+		lightify_node_set_blue(node, msg[QUERY_0x36_B]);
+		lightify_node_set_white(node, msg[QUERY_0x36_W]);
+		break;
+	}
+	if (status < 0) lightify_node_set_stale(node, 1);
+}
+
+void telegram_update_nodes(struct lightify_ctx *ctx, const unsigned char *msg, int status) {
+	struct lightify_node *node = NULL;
+	uint64_t adr = uint64_from_msg((uint8_t *) &msg[QUERY_0x32_NODEADR64_B0]);
+	uint16_t grpmask;
+
+	if (msg[HEADER_FLAGS] == 2) {
+		grpmask = (adr >= 1 && adr <= 16) ? 1U << (adr - 1) : 0;
+		while ((node = lightify_node_get_next(ctx, node))) {
+			if (grpmask & lightify_node_get_grpadr(node)) telegram_update_node(node, msg, status);
+		}
+	} else if (adr == UINT64_MAX) {
+		while ((node = lightify_node_get_next(ctx, node))) {
+			telegram_update_node(node, msg, status);
+		}
+	} else {
+		node = lightify_node_get_from_mac(ctx, adr);
+		if (node) telegram_update_node(node, msg, status);
+	}
+}
+
+int telegram_complete(struct lightify_ctx *ctx, const unsigned char *msg,
+		unsigned char *answer) {
+	uint32_t token;
+	uint64_t adr;
+	int n;
+
+	token = msg[HEADER_REQ_ID_B0] | (msg[HEADER_REQ_ID_B1] << 8U) |
+			(msg[HEADER_REQ_ID_B2] << 16U) | ((uint32_t)msg[HEADER_REQ_ID_B3] << 24U);
+	n = check_header_response(answer, token, msg[HEADER_CMD]);
+	if (n < 0) return n;
+
+	/* all four commands have the same answer layout */
+	adr = uint64_from_msg((uint8_t *) &msg[QUERY_0x32_NODEADR64_B0]);
+	if (adr != uint64_from_msg(&answer[ANSWER_0x32_NODEADR64_B0])) return -EPROTO;
+
+	n = -decode_status(answer[ANSWER_0x32_STATE]);
+
+	/* keep the cache of the addressed nodes up to date */
+	telegram_update_nodes(ctx, msg, n);
+	return n;
+}
+
+/* Send a telegram with the common 20 bytes answer and evaluate the latter */
+static int request_telegram(struct lightify_ctx *ctx, unsigned char *msg, size_t size) {
+	unsigned char answer[TELEGRAM_ANSWER_SIZE];
+	int n;
+
+	telegram_set_token(msg, ++ctx->cnt);
+
+	n = lightify_io_write(ctx, msg, size);
+	if (n >= 0 && n != (int) size) n = -EIO;
+
+	if (n >= 0) {
+		n = lightify_io_read(ctx, answer, TELEGRAM_ANSWER_SIZE);
+		if (n >= 0 && n != TELEGRAM_ANSWER_SIZE) n = -EIO;
+	}
+
+	if (n < 0) {
+		telegram_update_nodes(ctx, msg, n);
+		return n;
+	}
+	return telegram_complete(ctx, msg, answer);
+}
+
+LIGHTIFY_EXPORT int lightify_request_telegram(struct lightify_ctx *ctx,
+		unsigned char *msg, size_t size) {
+	int n;
+
+	if (!ctx) return -EINVAL;
+	n = telegram_check(msg, size);
+	if (n < 0) return n;
+
+	/* we cannot tell what the telegram changes on the gateway */
+	ctx->nodes_fresh = 0;
+	ctx->groups_fresh = 0;
+
+	return request_telegram(ctx, msg, size);
+}
+
 /* Node control */
 LIGHTIFY_EXPORT int lightify_node_request_onoff(struct lightify_ctx *ctx, struct lightify_node *node, int onoff) {
 	if (!ctx) return -EINVAL;
@@ -1094,7 +1305,7 @@ LIGHTIFY_EXPORT int lightify_node_request_update(struct lightify_ctx *ctx,
 	fill_telegram_header(msg, QUERY_0x68_SIZE, token, 0x00, 0x68);
 	msg_from_uint64(&msg[QUERY_0x68_NODEADR64_B0], node_adr);
 
-	n = ctx->socket_write_fn(ctx,msg, QUERY_0x68_SIZE);
+	n = lightify_io_write(ctx, msg, QUERY_0x68_SIZE);
 	if ( n < 0 ) {
 		info(ctx,"socket_write_fn error %d\n", n);
 		return n;
@@ -1105,7 +1316,7 @@ LIGHTIFY_EXPORT int lightify_node_request_update(struct lightify_ctx *ctx,
 	}
 
 	/* read the header incl. no of nodes and the byte that seems to be the status */
-	n = ctx->socket_read_fn(ctx,msg, ANSWER_0x68_ONLINESTATE);
+	n = lightify_io_read(ctx, msg, ANSWER_0x68_ONLINESTATE);
 	if (n < 0) {
 		info(ctx,"socket_read_fn error %d\n", n);
 		return n;
@@ -1148,7 +1359,7 @@ LIGHTIFY_EXPORT int lightify_node_request_update(struct lightify_ctx *ctx,
 		read_size = ANSWER_0x68_SIZE-ANSWER_0x68_ONLINESTATE;
 	}
 
-	n = ctx->socket_read_fn(ctx,&msg[ANSWER_0x68_ONLINESTATE],read_size);
+	n = lightify_io_read(ctx, &msg[ANSWER_0x68_ONLINESTATE],read_size);
 	if (n < 0) {
 		info(ctx,"socket_read_fn error %d\n", n);
 		return n;
@@ -1182,6 +1393,11 @@ LIGHTIFY_EXPORT int lightify_group_request_scan(struct lightify_ctx *ctx) {
 
 	if (!ctx) return -EINVAL;
 
+	if (cache_is_fresh(ctx, ctx->groups_fresh, &ctx->groups_fresh_until)) {
+		dbg(ctx, "0x1e: using cached scan\n");
+		return ctx->groups_count;
+	}
+
 	/* if using standard I/O functions, fd must be valid. If the user overrode those function,
 	 we won't care */
 	if (ctx->socket_read_fn == read_from_socket &&
@@ -1191,6 +1407,7 @@ LIGHTIFY_EXPORT int lightify_group_request_scan(struct lightify_ctx *ctx) {
 
 	/* remove old group information */
 	free_all_groups(ctx);
+	ctx->groups_fresh = 0;
 
 	token = ++ctx->cnt;
 
@@ -1201,7 +1418,7 @@ LIGHTIFY_EXPORT int lightify_group_request_scan(struct lightify_ctx *ctx) {
 	/* 0x1e command to get all groups. */
 	fill_telegram_header(msg, QUERY_0x1e_SIZE, token, 0x00, 0x1e);
 
-	n = ctx->socket_write_fn(ctx, msg, QUERY_0x1e_SIZE);
+	n = lightify_io_write(ctx, msg, QUERY_0x1e_SIZE);
 	if ( n < 0 ) {
 		info(ctx,"socket_write_fn error %d\n", n);
 		return n;
@@ -1212,7 +1429,7 @@ LIGHTIFY_EXPORT int lightify_group_request_scan(struct lightify_ctx *ctx) {
 	}
 
 	/* read the header */
-	n = ctx->socket_read_fn(ctx, msg, ANSWER_0x1e_SIZE);
+	n = lightify_io_read(ctx, msg, ANSWER_0x1e_SIZE);
 	if (n < 0) {
 		info(ctx,"socket_read_fn error %d\n", n);
 		return n;
@@ -1244,11 +1461,14 @@ LIGHTIFY_EXPORT int lightify_group_request_scan(struct lightify_ctx *ctx) {
 		info(ctx, "strange byte at PAYLOAD_START: %d\n", msg[HEADER_PAYLOAD_START]);
 	}
 
+	n = lightify_groups_reserve(ctx, no_of_grps);
+	if (n < 0) return n;
+
 	ret = 0;
 	/* read each node..*/
 	while(no_of_grps--) {
 		struct lightify_group *group = NULL;
-		n = ctx->socket_read_fn(ctx, msg, ANSWER_0x1e_GRP_LENGHT);
+		n = lightify_io_read(ctx, msg, ANSWER_0x1e_GRP_LENGHT);
 		if (n< 0) return n;
 		if (ANSWER_0x1e_GRP_LENGHT != n ) {
 			info(ctx,"read group info: short read %d!=%d\n", ANSWER_0x1e_GRP_LENGHT, n);
@@ -1265,6 +1485,8 @@ LIGHTIFY_EXPORT int lightify_group_request_scan(struct lightify_ctx *ctx) {
 		lightify_group_set_name(group, &msg[ANSWER_0x1e_GRP_NAME]);
 		ret++;
 	}
+	wait_deadline_set(&ctx->groups_fresh_until, ctx->cache_ttl);
+	ctx->groups_fresh = 1;
 	return ret;
 }
 
@@ -1330,35 +1552,25 @@ LIGHTIFY_EXPORT int lightify_group_request_brightness(struct lightify_ctx *ctx,
 	return ret;
 }
 
-// note: experimental API -- do not use yet.
-// WARNING: INSTABLE API.
-LIGHTIFY_EXPORT int lightify_node_request_color_loop(struct lightify_ctx *ctx,
-		struct lightify_node *node, const struct lightify_color_loop_spec* colorspec,
-		unsigned int number_of_specs, const uint8_t static_bytes[8])
-{
-	if (!ctx || !node || !colorspec || 15 != number_of_specs) return -EINVAL;
+/* static 8 bytes: 01 ff 00 ff 00 3c 00 00
+ * unclear meaning -- some bytes seems to change behaviour,
+ * need to fiddle with it -- this is why this api is not stable yet.*/
+static const unsigned char loop_statics[8] = {0x01, 0xff, 0x00, 0xff, 0x00, 0x3c, 0x00, 0x00};
+
+size_t telegram_color_loop(unsigned char *msg, uint64_t adr, int isgroup,
+		const struct lightify_color_loop_spec *colorspec,
+		unsigned int number_of_specs, const uint8_t static_bytes[8]) {
+
+	if (!colorspec || LOOP_STEPS != number_of_specs) return 0;
 
 	/* colorspec[0].delay must be 0x3C */
-	if (colorspec[0].delay != 0x3C) return -EINVAL;
+	if (colorspec[0].delay != 0x3C) return 0;
 
 	unsigned int telegram_size = QUERY_0xD8_START_OF_PROGRAMM + 1 + number_of_specs*STEP_0xD8_SIZE;
-	unsigned char msg[telegram_size +1];
-
-	uint32_t token = ++ctx->cnt;
-	fill_telegram_header(msg, telegram_size, token, 0, 0xd8);
 
-	uint64_t adr = lightify_node_get_nodeadr(node);
+	fill_telegram_header(msg, telegram_size, 0, isgroup ? 2 : 0, 0xd8);
 	msg_from_uint64(&msg[QUERY_0xD8_NODEADR64_B0], adr);
-
-	/* static 8 bytes: 01 ff 00 ff 00 3c 00 00
-	 * unclear meaning -- some bytes seems to change behaviour,
-	 * need to fiddle with it -- this is why this api is not stable yet.*/
-	if (!static_bytes) {
-		const unsigned char statics[8] = {0x01, 0xff, 0x00, 0xff, 0x00, 0x3c, 0x00, 0x00};
-		memcpy(&msg[QUERY_0xD8_UNKNOWN_1],statics,sizeof(statics));
-	} else {
-		memcpy(&msg[QUERY_0xD8_UNKNOWN_1],static_bytes,8);
-	}
+	memcpy(&msg[QUERY_0xD8_UNKNOWN_1], static_bytes ? static_bytes : loop_statics, 8);
 
 	// Fill colorspecs
 	uint8_t *ptr = &msg[QUERY_0xD8_START_OF_PROGRAMM];
@@ -1375,117 +1587,30 @@ LIGHTIFY_EXPORT int lightify_node_request_color_loop(struct lightify_ctx *ctx,
 	 * Checksum is: start with 0xff and substract every byte over all color-specs,
 	 * except the first byte (which is static 0x3c) */
 	unsigned int checksum = 0xff;
-	uint8_t *ptr2 = (uint8_t*) colorspec + 1 ;
+	uint8_t *ptr2 = &msg[QUERY_0xD8_START_OF_PROGRAMM + 1];
 	size_t size = number_of_specs * STEP_0xD8_SIZE;
 	for (i=1; i < size; i++) {
 		checksum -= *ptr2++;
 	}
 	*ptr++ = checksum & 0xff;
 
-	int n = ctx->socket_write_fn(ctx,msg, telegram_size);
-	if ( n < 0 ) {
-		info(ctx,"socket_write_fn error %d\n", n);
-		return n;
-	}
-	if ( n != (int) telegram_size) {
-		info(ctx,"short write %d!=%d\n", telegram_size, n);
-		return -EIO;
-	}
-
-	/* read the header */
-	n = ctx->socket_read_fn(ctx, msg, ANSWER_0xD8_SIZE);
-	if (n < 0) {
-		info(ctx,"socket_read_fn error %d\n", n);
-		return n;
-	}
-	if (n != ANSWER_0xD8_SIZE) {
-		info(ctx,"short read %d!=%d\n", ANSWER_0xD8_SIZE, n);
-		return -EIO;
-	}
-
-	n = check_header_response(msg, token, 0xD8);
-	if ( n < 0 ) {
-		info(ctx,"Invalid response (header)\n");
-		return n;
-	}
-
-	/* check if the node address was echoed properly */
-	uint64_t adr2 = uint64_from_msg(&msg[ANSWER_0xD8_NODEADR64_B0]);
-	if (adr != adr2) {
-		info(ctx, "unexpected node mac / group adr %llx!=%llx", adr, adr2 );
-		return -EPROTO;
-	}
-
-	n = -decode_status(msg[ANSWER_0xD8_STATE]);
-	dbg(ctx, "unknown-byte: %x\n", msg[ANSWER_0xD8_UNKNOWN1]);
-	return n;
+	return telegram_size;
 }
 
+size_t telegram_cct_loop(unsigned char *msg, uint64_t adr, int isgroup,
+		const struct lightify_cct_loop_spec *cctspec,
+		unsigned int number_of_specs, const uint8_t static_bytes[8]) {
 
-
-/** Helper function for cctloop to calculate the value required
- * out of a CCT parameter.
- *
- * (Determined by experiments, it seems that there are 3 sections)
- *
- * Data from the experiments:
- *
- * | CCT   | value |
- * |-------|-------|
- * | 6500  | 150   |
- * | 6000  | 163   |
- * | 5000  | 200   |
- * | 4500  | 220   |
- * | 3400  | 290   |
- * | 3000  | 325   |
- * | 2500  | 390   |
- *
- * @param cct
- * @return
- */
-static uint16_t cct_to_cctloop(uint16_t cct) {
-
-	float tmp;
-	if (cct <= 3000 ) {
-		tmp = 743.3 - 0.14 * (float) cct;
-	} else if ( cct <= 4500) {
-		tmp = 527.7 - 0.0686464 * (float) cct;
-	} else {
-		tmp = 377.95 - 0.0354 * (float) cct;
-	}
-
-	return floorf(tmp + 0.5);
-}
-
-// note: experimental API -- do not use yet.
-// WARNING: INSTABLE API.
-LIGHTIFY_EXPORT int lightify_node_request_cct_loop(struct lightify_ctx *ctx,
-		struct lightify_node *node, const struct lightify_cct_loop_spec* cctspec,
-		unsigned int number_of_specs, const uint8_t static_bytes[8])
-{
-	if (!ctx || !node || !cctspec || 15 != number_of_specs) return -EINVAL;
+	if (!cctspec || LOOP_STEPS != number_of_specs) return 0;
 
 	/* cctspec[0].delay must be 0x3C */
-	if (cctspec[0].delay != 0x3C) return -EINVAL;
+	if (cctspec[0].delay != 0x3C) return 0;
 
 	unsigned int telegram_size = QUERY_0xD9_START_OF_PROGRAMM + 1 + number_of_specs*STEP_0xD9_SIZE;
-	unsigned char msg[telegram_size +1];
-
-	uint32_t token = ++ctx->cnt;
-	fill_telegram_header(msg, telegram_size, token, 0, 0xd9);
 
-	uint64_t adr = lightify_node_get_nodeadr(node);
+	fill_telegram_header(msg, telegram_size, 0, isgroup ? 2 : 0, 0xd9);
 	msg_from_uint64(&msg[QUERY_0xD9_NODEADR64_B0], adr);
-
-	/* static 8 bytes: 01 ff 00 ff 00 3c 00 00
-	 * unclear meaning -- some bytes seems to change behaviour,
-	 * need to fiddle with it -- this is why this api is not stable yet.*/
-	if (!static_bytes) {
-		const unsigned char statics[8] = {0x01, 0xff, 0x00, 0xff, 0x00, 0x3c, 0x00, 0x00};
-		memcpy(&msg[QUERY_0xD9_UNKNOWN_1],statics,sizeof(statics));
-	} else {
-		memcpy(&msg[QUERY_0xD9_UNKNOWN_1],static_bytes,8);
-	}
+	memcpy(&msg[QUERY_0xD9_UNKNOWN_1], static_bytes ? static_bytes : loop_statics, 8);
 
 	// Fill colorspecs
 	uint8_t *ptr = &msg[QUERY_0xD9_START_OF_PROGRAMM];
@@ -1493,7 +1618,7 @@ LIGHTIFY_EXPORT int lightify_node_request_cct_loop(struct lightify_ctx *ctx,
 	unsigned int chksum = 0xff;
 	do {
 		*ptr++ = cctspec[i].delay; if (i) chksum -= cctspec[i].delay;
-		uint16_t cct = cct_to_cctloop(cctspec[i].cct);
+		uint16_t cct = color_cct_to_loop(cctspec[i].cct);
 		chksum -= cct;
 		*ptr++ = cct >> 8 ;
 		*ptr++ = cct & 0xFF;
@@ -1501,53 +1626,81 @@ LIGHTIFY_EXPORT int lightify_node_request_cct_loop(struct lightify_ctx *ctx,
 		i++;
 	} while (i < number_of_specs);
 
-	/* Calculate the checksum:
-	 * Checksum is: start with 0xff and substract every byte over all color-specs,
-	 * except the first byte (which is static 0x3c) */
-	uint8_t checksum = 0xff;
-	uint8_t *ptr2 = (uint8_t*) &msg[QUERY_0xD9_START_OF_PROGRAMM];
-	size_t size = number_of_specs * STEP_0xD9_SIZE;
-	for (i=1; i < size; i++) {
-			checksum -= ptr2[i];
-	}
-
 	*ptr++ = chksum;
 
-	int n = ctx->socket_write_fn(ctx,msg, telegram_size);
-	if ( n < 0 ) {
-		info(ctx,"socket_write_fn error %d\n", n);
-		return n;
-	}
-	if ( n != (int) telegram_size) {
-		info(ctx,"short write %d!=%d\n", telegram_size, n);
-		return -EIO;
-	}
+	return telegram_size;
+}
 
-	/* read the header */
-	n = ctx->socket_read_fn(ctx, msg, ANSWER_0xD9_SIZE);
-	if (n < 0) {
-		info(ctx,"socket_read_fn error %d\n", n);
-		return n;
-	}
-	if (n != ANSWER_0xD9_SIZE) {
-		info(ctx,"short read %d!=%d\n", ANSWER_0xD9_SIZE, n);
-		return -EIO;
-	}
+// note: experimental API -- do not use yet.
+// WARNING: INSTABLE API.
+LIGHTIFY_EXPORT int lightify_node_request_color_loop(struct lightify_ctx *ctx,
+		struct lightify_node *node, const struct lightify_color_loop_spec* colorspec,
+		unsigned int number_of_specs, const uint8_t static_bytes[8])
+{
+	unsigned char msg[TELEGRAM_MAX_SIZE];
+	size_t size;
 
-	n = check_header_response(msg, token, 0xD9);
-	if ( n < 0 ) {
-		info(ctx,"Invalid response (header)\n");
-		return n;
-	}
+	if (!ctx) return -EINVAL;
 
-	/* check if the node address was echoed properly */
-	uint64_t adr2 = uint64_from_msg(&msg[ANSWER_0xD9_NODEADR64_B0]);
-	if (adr != adr2) {
-		info(ctx, "unexpected node mac / group adr %llx!=%llx", adr, adr2 );
-		return -EPROTO;
-	}
+	/* no node: broadcast */
+	size = telegram_color_loop(msg, node ? lightify_node_get_nodeadr(node) : UINT64_MAX, 0,
+			colorspec, number_of_specs, static_bytes);
+	if (!size) return -EINVAL;
 
-	n = -decode_status(msg[ANSWER_0xD9_STATE]);
-	dbg(ctx, "unknown-byte: %x\n", msg[ANSWER_0xD9_UNKNOWN1]);
-	return n;
+	return request_telegram(ctx, msg, size);
+}
+
+// note: experimental API -- do not use yet.
+// WARNING: INSTABLE API.
+LIGHTIFY_EXPORT int lightify_node_request_cct_loop(struct lightify_ctx *ctx,
+		struct lightify_node *node, const struct lightify_cct_loop_spec* cctspec,
+		unsigned int number_of_specs, const uint8_t static_bytes[8])
+{
+	unsigned char msg[TELEGRAM_MAX_SIZE];
+	size_t size;
+
+	if (!ctx) return -EINVAL;
+
+	/* no node: broadcast */
+	size = telegram_cct_loop(msg, node ? lightify_node_get_nodeadr(node) : UINT64_MAX, 0,
+			cctspec, number_of_specs, static_bytes);
+	if (!size) return -EINVAL;
+
+	return request_telegram(ctx, msg, size);
+}
+
+// note: experimental API -- do not use yet.
+// WARNING: INSTABLE API.
+LIGHTIFY_EXPORT int lightify_group_request_color_loop(struct lightify_ctx *ctx,
+		struct lightify_group *group, const struct lightify_color_loop_spec* colorspec,
+		unsigned int number_of_specs, const uint8_t static_bytes[8])
+{
+	unsigned char msg[TELEGRAM_MAX_SIZE];
+	size_t size;
+
+	if (!ctx || !group) return -EINVAL;
+
+	size = telegram_color_loop(msg, lightify_group_get_id(group), 1,
+			colorspec, number_of_specs, static_bytes);
+	if (!size) return -EINVAL;
+
+	return request_telegram(ctx, msg, size);
+}
+
+// note: experimental API -- do not use yet.
+// WARNING: INSTABLE API.
+LIGHTIFY_EXPORT int lightify_group_request_cct_loop(struct lightify_ctx *ctx,
+		struct lightify_group *group, const struct lightify_cct_loop_spec* cctspec,
+		unsigned int number_of_specs, const uint8_t static_bytes[8])
+{
+	unsigned char msg[TELEGRAM_MAX_SIZE];
+	size_t size;
+
+	if (!ctx || !group) return -EINVAL;
+
+	size = telegram_cct_loop(msg, lightify_group_get_id(group), 1,
+			cctspec, number_of_specs, static_bytes);
+	if (!size) return -EINVAL;
+
+	return request_telegram(ctx, msg, size);
 }
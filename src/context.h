@@ -45,6 +45,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdlib.h>
 #include <sys/time.h>
 #include <stdarg.h>
+#include <time.h>
 
 /* Protocol versions */
 #define GW_PROT_OLD  (0)
@@ -60,6 +61,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
 struct lightify_nodes;
+struct lightify_node_store;
+struct lightify_snapshots;
+struct lightify_shm;
+struct lightify_capture;
+struct lightify_conn;
+struct lightify_wait;
 /**
  * lightify_ctx:
  *
@@ -86,11 +93,25 @@ struct lightify_ctx {
 	/** fd for network socket*/
 	int socket;
 
-	/** pointer to the first node, if any. */
-	struct lightify_node *nodes;
+	/** the nodes, in the order of the scan */
+	struct lightify_node **nodes;
+	size_t nodes_count; /**< number of nodes */
+	size_t nodes_cap; /**< allocated entries of nodes and nodestore */
 
-	/** pointer to the first group, if any */
-	struct lightify_group *groups;
+	/** the nodes' cached state, see node.c */
+	struct lightify_node_store *nodestore;
+
+	/** published snapshots of the node cache, see snapshot.c.
+	 * Also read by other threads, access atomically. */
+	struct lightify_snapshots *snapshots;
+
+	/** shared memory segment the cache is published into, see shm.c */
+	struct lightify_shm *shm;
+
+	/** the groups, in the order of the scan */
+	struct lightify_group **groups;
+	size_t groups_count; /**< number of groups */
+	size_t groups_cap; /**< allocated entries of groups */
 
 	/** request id counter*/
 	uint32_t cnt;
@@ -98,9 +119,49 @@ struct lightify_ctx {
 	/** timeout for IO */
 	struct timeval iotimeout;
 
+	/** absolute deadline (CLOCK_MONOTONIC) for all requests, if has_deadline */
+	struct timespec deadline;
+	int has_deadline;
+
+	/** time budget for a single request, zero if unlimited */
+	struct timeval req_timeout;
+
+	/** effective deadline of the request in flight, if has_req_deadline */
+	struct timespec req_deadline;
+	int has_req_deadline;
+
+	/** how long scan results are reused, zero to always scan */
+	struct timeval cache_ttl;
+
+	/** node scan result is fresh until nodes_fresh_until, if nodes_fresh */
+	struct timespec nodes_fresh_until;
+	int nodes_fresh;
+	/** group scan result is fresh until groups_fresh_until, if groups_fresh */
+	struct timespec groups_fresh_until;
+	int groups_fresh;
+
+	/** set when the framing lost track and the stream must be drained */
+	int resync;
+
+	/** framing: state, see enum frame_state */
+	int frame_state;
+	/** framing: token of the request in flight */
+	uint32_t frame_token;
+	/** framing: bytes of the current answer not yet read */
+	size_t frame_left;
+
 	/** detected protocol variant */
 	int gw_protocol_version;
 
+	/** session capture and replay state, NULL if never used */
+	struct lightify_capture *capture;
+
+	/** library managed connection, NULL if never used */
+	struct lightify_conn *conn;
+
+	/** readiness layer state, NULL when using poll() */
+	struct lightify_wait *wait;
+
 };
 
 #endif /* SRC_LIBCONTEXT_H_ */
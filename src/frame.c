@@ -0,0 +1,200 @@
+/*
+  liblightify -- library to control OSRAM's LIGHTIFY
+
+Copyright (c) 2015, Tobias Frost <tobi@coldtobi.de>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * \file frame.c
+ *
+ * Every answer starts with the common header, whose length field tells how
+ * long the frame is. The requests read their answers in pieces and may bail
+ * out in the middle, so this module counts what is left of the current frame
+ * and consumes it before the next telegram is sent. This keeps the connection
+ * usable after protocol errors without the need to reconnect.
+ */
+
+#include "liblightify-private.h"
+#include "context.h"
+#include "frame.h"
+#include "log.h"
+#include "protocol.h"
+#include "socket.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+static uint32_t frame_token(const unsigned char *msg) {
+	return msg[HEADER_REQ_ID_B0] | (msg[HEADER_REQ_ID_B1] << 8U) |
+			(msg[HEADER_REQ_ID_B2] << 16U) | ((uint32_t)msg[HEADER_REQ_ID_B3] << 24U);
+}
+
+static size_t frame_size(const unsigned char *msg) {
+	return (msg[HEADER_LEN_LSB] | (msg[HEADER_LEN_MSB] << 8U)) + 2;
+}
+
+/* read and throw away len bytes */
+static int frame_discard(struct lightify_ctx *ctx, size_t len) {
+	unsigned char buf[64];
+	int n;
+
+	while (len) {
+		n = lightify_io_read_raw(ctx, buf, len < sizeof(buf) ? len : sizeof(buf));
+		if (n <= 0) return n < 0 ? n : -EIO;
+		len -= n;
+	}
+	return 0;
+}
+
+void frame_request_sent(struct lightify_ctx *ctx, const unsigned char *msg, size_t size) {
+	if (size < HEADER_PAYLOAD_START) {
+		ctx->frame_state = FRAME_NONE;
+		return;
+	}
+	ctx->frame_token = frame_token(msg);
+	ctx->frame_state = FRAME_HEADER;
+	ctx->frame_left = 0;
+}
+
+int frame_finish(struct lightify_ctx *ctx) {
+	int n = 0;
+
+	if (ctx->frame_state == FRAME_BODY && ctx->frame_left) {
+		dbg(ctx, "frame: skipping %zu unread bytes\n", ctx->frame_left);
+		n = frame_discard(ctx, ctx->frame_left);
+	}
+	ctx->frame_state = FRAME_NONE;
+	ctx->frame_left = 0;
+	return n;
+}
+
+static int frame_read_header(struct lightify_ctx *ctx, unsigned char *msg, size_t size) {
+	int n, m;
+	int stale = 0;
+	size_t total;
+
+	n = lightify_io_read_raw(ctx, msg, size);
+
+	for (;;) {
+		if (n < HEADER_PAYLOAD_START) {
+			ctx->frame_state = FRAME_NONE;
+			if (n > 0) {
+				/* no idea where the frame ends */
+				ctx->resync = 1;
+			} else if (stale && n == 0) {
+				return -EPROTO;
+			}
+			return n;
+		}
+
+		total = frame_size(msg);
+		if (frame_token(msg) == ctx->frame_token) break;
+
+		/* answer to some earlier request -- drop it */
+		stale++;
+		dbg(ctx, "frame: dropping answer 0x%02x with token %u (%zu bytes)\n",
+				msg[HEADER_CMD], frame_token(msg), total);
+
+		if (total >= (size_t) n) {
+			m = frame_discard(ctx, total - n);
+			if (m < 0) {
+				ctx->frame_state = FRAME_NONE;
+				ctx->resync = 1;
+				return m;
+			}
+			n = lightify_io_read_raw(ctx, msg, size);
+		} else {
+			/* we've already read into the next frame */
+			n -= total;
+			memmove(msg, msg + total, n);
+			m = lightify_io_read_raw(ctx, msg + n, size - n);
+			if (m > 0) n += m;
+		}
+	}
+
+	ctx->frame_state = FRAME_BODY;
+	ctx->frame_left = total > (size_t) n ? total - n : 0;
+	return n;
+}
+
+int frame_read(struct lightify_ctx *ctx, unsigned char *msg, size_t size) {
+	int n;
+
+	switch (ctx->frame_state) {
+	case FRAME_HEADER:
+		if (size >= HEADER_PAYLOAD_START) return frame_read_header(ctx, msg, size);
+		ctx->frame_state = FRAME_NONE;
+		break;
+	case FRAME_BODY:
+		n = lightify_io_read_raw(ctx, msg, size);
+		if (n > 0) ctx->frame_left -= (size_t) n < ctx->frame_left ? (size_t) n : ctx->frame_left;
+		return n;
+	default:
+		break;
+	}
+
+	return lightify_io_read_raw(ctx, msg, size);
+}
+
+int frame_read_any(struct lightify_ctx *ctx, unsigned char *msg, size_t size) {
+	size_t total, want;
+	int n;
+
+	if (size < HEADER_PAYLOAD_START) return -EINVAL;
+	ctx->frame_state = FRAME_NONE;
+
+	n = lightify_io_read_raw(ctx, msg, HEADER_PAYLOAD_START);
+	if (n != HEADER_PAYLOAD_START) {
+		if (n > 0) ctx->resync = 1;
+		return n < 0 ? n : -EIO;
+	}
+
+	total = frame_size(msg);
+	if (total < HEADER_PAYLOAD_START) {
+		ctx->resync = 1;
+		return -EPROTO;
+	}
+
+	want = total < size ? total : size;
+	if (want > HEADER_PAYLOAD_START) {
+		n = lightify_io_read_raw(ctx, msg + HEADER_PAYLOAD_START, want - HEADER_PAYLOAD_START);
+		if (n != (int)(want - HEADER_PAYLOAD_START)) {
+			ctx->resync = 1;
+			return n < 0 ? n : -EIO;
+		}
+	}
+
+	if (total > want) {
+		n = frame_discard(ctx, total - want);
+		if (n < 0) {
+			ctx->resync = 1;
+			return n;
+		}
+	}
+	return want;
+}
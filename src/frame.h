@@ -0,0 +1,96 @@
+/*
+  liblightify -- library to control OSRAM's LIGHTIFY
+
+Copyright (c) 2015, Tobias Frost <tobi@coldtobi.de>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * \file frame.h
+ *
+ * Framing of the gateway's answers: Keeps track of the frame boundaries in
+ * the stream, so that the library can always continue with the next frame,
+ * even if a request did not consume its answer completely.
+ */
+
+#ifndef SRC_FRAME_H_
+#define SRC_FRAME_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+
+/** Framing state of the stream */
+enum frame_state {
+	FRAME_NONE = 0,	/**< no request in flight or track lost */
+	FRAME_HEADER,	/**< telegram sent, waiting for the answer's header */
+	FRAME_BODY,	/**< inside the answer, see lightify_ctx::frame_left */
+};
+
+/** A telegram has been sent: the next answer must carry its token
+ *
+ * @param ctx library context
+ * @param msg the telegram
+ * @param size size of the telegram
+ */
+void frame_request_sent(struct lightify_ctx *ctx, const unsigned char *msg, size_t size);
+
+/** Consume the rest of the current answer, if the last request left some
+ * bytes in the stream.
+ *
+ * @param ctx library context
+ * @return 0 on success, negative if the position in the stream is lost.
+ */
+int frame_finish(struct lightify_ctx *ctx);
+
+/** Read from the stream, keeping track of the frame boundaries
+ *
+ * If an answer header is expected, answers with a foreign token (e.g. of a
+ * cancelled request) are skipped, so msg always starts with the answer for
+ * the request in flight.
+ *
+ * @param ctx library context
+ * @param msg buffer
+ * @param size bytes to read
+ * @return bytes read, negative on errors. -EPROTO if only unrelated answers
+ * were received.
+ */
+int frame_read(struct lightify_ctx *ctx, unsigned char *msg, size_t size);
+
+/** Read the next complete answer, whatever its token is
+ *
+ * For requests with several telegrams in flight, which match the answers
+ * on their own. If the answer is larger than msg, the rest is discarded.
+ *
+ * @param ctx library context
+ * @param msg buffer
+ * @param size size of the buffer, at least the size of the header
+ * @return bytes stored in msg, negative on errors.
+ */
+int frame_read_any(struct lightify_ctx *ctx, unsigned char *msg, size_t size);
+
+#endif /* SRC_FRAME_H_ */
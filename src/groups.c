@@ -33,6 +33,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "groups.h"
 
 #include <errno.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -46,56 +47,178 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 struct lightify_group {
 	struct lightify_ctx *ctx;  /**< library context */
 
-	/* Linked list */
-    struct lightify_group *next; /**< linked list, next entry */
-	struct lightify_group *prev;  /**< linked list, previous entry */
+	/** position in ctx->groups */
+	size_t idx;
 
 	/** Group ID  */
 	int id;
 
 	/** Group name */
 	char *name;
+
+	/** Aggregated state of the member nodes.
+	 * Maintained incrementally by lightify_groups_node_account() whenever
+	 * a node setter changes something, so that the queries are O(1). */
+	struct {
+		int members;     /**< nodes in this group */
+		int on;          /**< members reporting on */
+		int online;      /**< members reporting LIGHTIFY_ONLINE */
+		int stale;       /**< members flagged stale */
+
+		int bri_known;   /**< members with a known brightness */
+		long bri_sum;    /**< sum of the known brightness values */
+		int bri_min;     /**< lowest bucket in bri_hist, -1 if recompute */
+		int bri_max;     /**< highest bucket in bri_hist, -1 if recompute */
+		unsigned short bri_hist[256]; /**< histogram of brightness values */
+
+		/* For the "common value" queries we keep the count, the sum and
+		 * the sum of squares: all values are equal iff n*sumsq == sum*sum */
+		int cct_known;
+		int64_t cct_sum;
+		int64_t cct_sumsq;
+
+		int col_known;
+		int64_t col_sum[4];
+		int64_t col_sumsq[4];
+	} agg;
 };
 
+/** Bitmask in the node's group address for this group, 0 if no valid id */
+static uint16_t group_mask(const struct lightify_group *grp) {
+	if (grp->id < 1 || grp->id > 16) return 0;
+	return 1U << (grp->id - 1);
+}
+
+static int clamp_bri(int bri) {
+	if (bri > 255) return 255;
+	return bri;
+}
+
+/** Add (sign=1) or remove (sign=-1) the node's state to the group's aggregates */
+static void group_account(struct lightify_group *grp, struct lightify_node *node, int sign) {
+	int bri, cct, col[4], i;
+
+	grp->agg.members += sign;
+	if (lightify_node_is_on(node) == 1) grp->agg.on += sign;
+	if (lightify_node_get_onlinestate(node) == LIGHTIFY_ONLINE) grp->agg.online += sign;
+	if (lightify_node_is_stale(node) > 0) grp->agg.stale += sign;
+
+	bri = lightify_node_get_brightness(node);
+	if (bri >= 0) {
+		bri = clamp_bri(bri);
+		grp->agg.bri_known += sign;
+		grp->agg.bri_sum += sign * bri;
+		grp->agg.bri_hist[bri] += sign;
+		if (sign > 0) {
+			if (grp->agg.bri_min >= 0 && bri < grp->agg.bri_min) grp->agg.bri_min = bri;
+			if (grp->agg.bri_max >= 0 && bri > grp->agg.bri_max) grp->agg.bri_max = bri;
+		} else {
+			/* extreme bucket emptied -- find the new one on next query */
+			if (bri == grp->agg.bri_min && !grp->agg.bri_hist[bri]) grp->agg.bri_min = -1;
+			if (bri == grp->agg.bri_max && !grp->agg.bri_hist[bri]) grp->agg.bri_max = -1;
+		}
+	}
+
+	cct = lightify_node_get_cct(node);
+	if (cct >= 0) {
+		grp->agg.cct_known += sign;
+		grp->agg.cct_sum += sign * (int64_t)cct;
+		grp->agg.cct_sumsq += sign * (int64_t)cct * cct;
+	}
+
+	col[0] = lightify_node_get_red(node);
+	col[1] = lightify_node_get_green(node);
+	col[2] = lightify_node_get_blue(node);
+	col[3] = lightify_node_get_white(node);
+	if (col[0] >= 0 && col[1] >= 0 && col[2] >= 0 && col[3] >= 0) {
+		grp->agg.col_known += sign;
+		for (i = 0; i < 4; i++) {
+			grp->agg.col_sum[i] += sign * (int64_t)col[i];
+			grp->agg.col_sumsq[i] += sign * (int64_t)col[i] * col[i];
+		}
+	}
+}
+
+/** Rebuild the aggregates from scratch, e.g. after the group id changed */
+static void group_recompute(struct lightify_group *grp) {
+	struct lightify_node *node = NULL;
+
+	memset(&grp->agg, 0, sizeof(grp->agg));
+	grp->agg.bri_min = -1;
+	grp->agg.bri_max = -1;
+
+	while ((node = lightify_group_get_next_node(grp, node))) {
+		group_account(grp, node, 1);
+	}
+}
+
+void lightify_groups_node_account(struct lightify_ctx *ctx, struct lightify_node *node, int sign) {
+	uint16_t grpadr;
+	size_t i;
+
+	if (!ctx) return;
+	grpadr = lightify_node_get_grpadr(node);
+	if (!grpadr) return;
+
+	for (i = 0; i < ctx->groups_count; i++) {
+		if (grpadr & group_mask(ctx->groups[i])) group_account(ctx->groups[i], node, sign);
+	}
+}
+
+int lightify_groups_reserve(struct lightify_ctx *ctx, size_t count) {
+	struct lightify_group **tab;
+	size_t cap;
+
+	if (!ctx) return -EINVAL;
+	if (count <= ctx->groups_cap) return 0;
+
+	cap = ctx->groups_cap ? ctx->groups_cap : 16;
+	while (cap < count) cap *= 2;
+
+	tab = realloc(ctx->groups, cap * sizeof(*tab));
+	if (!tab) return -ENOMEM;
+	ctx->groups = tab;
+	ctx->groups_cap = cap;
+	return 0;
+}
+
 int lightify_group_new(struct lightify_ctx *ctx, struct lightify_group **newgroup) {
 
-	struct lightify_group *g, *ctx_g;
+	struct lightify_group *g;
+	int err;
 	if (!ctx)
 		return -EINVAL;
 
+	err = lightify_groups_reserve(ctx, ctx->groups_count + 1);
+	if (err < 0)
+		return err;
+
 	g = calloc(1, sizeof(struct lightify_group));
 	if (!g)
 		return -ENOMEM;
 
-	ctx_g = ctx->groups;
-	if (!ctx_g) {
-		ctx->groups = g;
-	} else {
-		while (ctx_g->next)
-			ctx_g = ctx_g->next;
-		ctx_g->next = g;
-		g->prev = ctx_g;
-	}
+	g->idx = ctx->groups_count;
+	ctx->groups[ctx->groups_count++] = g;
 	*newgroup = g;
 	g->ctx = ctx;
+	g->agg.bri_min = -1;
+	g->agg.bri_max = -1;
 	return 0;
 }
 
 int lightify_group_remove(struct lightify_group *grp) {
 	if (!grp) return -EINVAL;
 
-	struct lightify_group *next = grp->next;
-	struct lightify_group *prev = grp->prev;
+	struct lightify_ctx *ctx = grp->ctx;
+	size_t i;
 
-	if (prev) {
-		prev->next = next;
-	} else {
-		// first grp
-		grp->ctx->groups=next;
+	/* close the gap, keeping the order */
+	ctx->groups_count--;
+	for (i = grp->idx; i < ctx->groups_count; i++) {
+		ctx->groups[i] = ctx->groups[i + 1];
+		ctx->groups[i]->idx = i;
 	}
 
-	if (next) next->prev = prev;
-
 	if (grp->name) free(grp->name);
 	free(grp);
 	return 0;
@@ -122,6 +245,7 @@ LIGHTIFY_EXPORT  const char *lightify_group_get_name(struct lightify_group *grp)
 int lightify_group_set_id(struct lightify_group *grp, int id) {
 	if(!grp) return -EINVAL;
 	grp->id = id;
+	group_recompute(grp);
 	return 0;
 }
 
@@ -133,23 +257,105 @@ LIGHTIFY_EXPORT int lightify_group_get_id(struct lightify_group *grp) {
 // #FIXME export and document
 LIGHTIFY_EXPORT struct lightify_group *lightify_group_get_next(struct lightify_ctx *ctx, struct lightify_group *current) {
 	if (!ctx) return NULL;
-	if (!current) return ctx->groups;
-	return current->next;
+	if (!current) return ctx->groups_count ? ctx->groups[0] : NULL;
+	if (current->idx + 1 >= ctx->groups_count) return NULL;
+	return ctx->groups[current->idx + 1];
 }
 
 LIGHTIFY_EXPORT struct lightify_group *lightify_group_get_previous(struct lightify_ctx *ctx, struct lightify_group *current) {
 	if (!ctx) return NULL;
-	if (!current) return NULL;
-	return current->prev;
+	if (!current || !current->idx) return NULL;
+	return ctx->groups[current->idx - 1];
 }
 
 // #FIXME export and document
 LIGHTIFY_EXPORT struct lightify_node *lightify_group_get_next_node(struct lightify_group *grp, struct lightify_node *lastnode) {
 	if (!grp) return NULL;
-	uint16_t grpmask = 1 << (grp->id-1);
+	uint16_t grpmask = group_mask(grp);
+	if (!grpmask) return NULL;
 
 	while ( (lastnode = lightify_node_get_next(grp->ctx, lastnode))) {
 		if ( grpmask & lightify_node_get_grpadr(lastnode)) return lastnode;
 	}
 	return NULL;
 }
+
+LIGHTIFY_EXPORT int lightify_group_get_member_count(struct lightify_group *grp) {
+	if (!grp) return -EINVAL;
+	return grp->agg.members;
+}
+
+LIGHTIFY_EXPORT int lightify_group_is_all_on(struct lightify_group *grp) {
+	if (!grp) return -EINVAL;
+	return grp->agg.members && grp->agg.on == grp->agg.members;
+}
+
+LIGHTIFY_EXPORT int lightify_group_is_any_on(struct lightify_group *grp) {
+	if (!grp) return -EINVAL;
+	return grp->agg.on > 0;
+}
+
+LIGHTIFY_EXPORT int lightify_group_get_online_count(struct lightify_group *grp) {
+	if (!grp) return -EINVAL;
+	return grp->agg.online;
+}
+
+LIGHTIFY_EXPORT int lightify_group_get_stale_count(struct lightify_group *grp) {
+	if (!grp) return -EINVAL;
+	return grp->agg.stale;
+}
+
+LIGHTIFY_EXPORT int lightify_group_get_brightness_avg(struct lightify_group *grp) {
+	if (!grp) return -EINVAL;
+	if (!grp->agg.bri_known) return -ENODATA;
+	return (grp->agg.bri_sum + grp->agg.bri_known / 2) / grp->agg.bri_known;
+}
+
+LIGHTIFY_EXPORT int lightify_group_get_brightness_min(struct lightify_group *grp) {
+	int i;
+	if (!grp) return -EINVAL;
+	if (!grp->agg.bri_known) return -ENODATA;
+	if (grp->agg.bri_min < 0) {
+		for (i = 0; !grp->agg.bri_hist[i]; i++);
+		grp->agg.bri_min = i;
+	}
+	return grp->agg.bri_min;
+}
+
+LIGHTIFY_EXPORT int lightify_group_get_brightness_max(struct lightify_group *grp) {
+	int i;
+	if (!grp) return -EINVAL;
+	if (!grp->agg.bri_known) return -ENODATA;
+	if (grp->agg.bri_max < 0) {
+		for (i = 255; !grp->agg.bri_hist[i]; i--);
+		grp->agg.bri_max = i;
+	}
+	return grp->agg.bri_max;
+}
+
+static int all_equal(int n, int64_t sum, int64_t sumsq) {
+	return n > 0 && n * sumsq == sum * sum;
+}
+
+LIGHTIFY_EXPORT int lightify_group_get_cct(struct lightify_group *grp) {
+	if (!grp) return -EINVAL;
+	/* every member must know its CCT and all must agree */
+	if (grp->agg.cct_known != grp->agg.members) return -ENODATA;
+	if (!all_equal(grp->agg.cct_known, grp->agg.cct_sum, grp->agg.cct_sumsq)) return -ENODATA;
+	return grp->agg.cct_sum / grp->agg.cct_known;
+}
+
+LIGHTIFY_EXPORT int lightify_group_get_rgbw(struct lightify_group *grp, int *r, int *g, int *b, int *w) {
+	int i, col[4];
+	if (!grp) return -EINVAL;
+	if (grp->agg.col_known != grp->agg.members) return -ENODATA;
+	for (i = 0; i < 4; i++) {
+		if (!all_equal(grp->agg.col_known, grp->agg.col_sum[i], grp->agg.col_sumsq[i])) return -ENODATA;
+		col[i] = grp->agg.col_sum[i] / grp->agg.col_known;
+	}
+	if (r) *r = col[0];
+	if (g) *g = col[1];
+	if (b) *b = col[2];
+	if (w) *w = col[3];
+	return 0;
+}
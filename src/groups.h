@@ -41,6 +41,16 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "config.h"
 #endif
 
+#include <stdlib.h>
+
+/** Make room for count groups, so that adding them needs no reallocation
+ *
+ * @param ctx  Library context
+ * @param count total number of groups expected
+ * @return negative on error. >=0 is success.
+ */
+int lightify_groups_reserve(struct lightify_ctx *ctx, size_t count);
+
 /** Generate a new group object
  *
  * @param ctx  Library context
@@ -68,11 +78,22 @@ int lightify_group_set_name(struct lightify_group *grp, const unsigned char *nam
  */
 int lightify_group_set_id(struct lightify_group *grp, int id);
 
-/** Remove group from linked list and free memory associated.
+/** Remove group from the context and free memory associated.
  *
  * @param grp to operate on
  * @return negative on error. >=0 is success.
  */
 int lightify_group_remove(struct lightify_group *grp);
 
+/** Add or remove a node's state to / from the aggregates of its groups
+ *
+ * Node setters call this with sign=-1 before and sign=1 after changing
+ * a value, so that the per-group aggregates always reflect the cache.
+ *
+ * @param ctx context the node belongs to
+ * @param node which changes
+ * @param sign 1 to add, -1 to remove
+ */
+void lightify_groups_node_account(struct lightify_ctx *ctx, struct lightify_node *node, int sign);
+
 #endif /* SRC_GROUPS_H_ */
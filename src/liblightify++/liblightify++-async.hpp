@@ -0,0 +1,333 @@
+/*
+ liblightify -- library to control OSRAM's LIGHTIFY
+
+ Copyright (c) 2015, Tobias Frost <tobi@coldtobi.de>
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+
+ * Neither the name of the author nor the
+ names of its contributors may be used to endorse or promote products
+ derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * \file liblightify++-async.hpp
+ *
+ * Asynchronous layer on top of the C++ wrapper.
+ *
+ * Every request is queued and executed by a library owned I/O thread (or by
+ * an executor supplied by the application). The caller immediately gets a
+ * Lightify_Task, which can be waited on, turned into a std::future or, with
+ * C++20, be co_await'ed.
+ *
+ * Requires C++11.
+ */
+
+#ifndef SRC_LIBLIGHTIFY___LIGHTIFY___ASYNC_HPP_
+#define SRC_LIBLIGHTIFY___LIGHTIFY___ASYNC_HPP_
+
+#include <liblightify++/liblightify++.hpp>
+
+#if __cplusplus < 201103L
+#error "liblightify++-async.hpp requires C++11"
+#endif
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#include <coroutine>
+#define LIGHTIFY_HAVE_COROUTINES 1
+#endif
+
+/** Handle for a queued request.
+ *
+ * The result is the return value of the synchronous counterpart, that is
+ * negative on errors.
+ *
+ * \note With co_await, the coroutine is resumed on the thread that executed
+ * the request (the I/O thread or an executor's thread). Don't block there on
+ * other requests of the same Lightify_Async object.
+ */
+class Lightify_Task {
+	friend class Lightify_Async;
+
+	struct State {
+		State() : done(false), result(0) {}
+		std::mutex lock;
+		std::condition_variable cv;
+		bool done;
+		int result;
+		std::promise<int> promise;
+#ifdef LIGHTIFY_HAVE_COROUTINES
+		std::coroutine_handle<> waiter;
+#endif
+	};
+
+	explicit Lightify_Task(std::shared_ptr<State> s) : _state(std::move(s)) {}
+
+	static void Complete(const std::shared_ptr<State> &s, int result) {
+#ifdef LIGHTIFY_HAVE_COROUTINES
+		std::coroutine_handle<> waiter;
+#endif
+		{
+			std::lock_guard<std::mutex> l(s->lock);
+			s->result = result;
+			s->done = true;
+#ifdef LIGHTIFY_HAVE_COROUTINES
+			std::swap(waiter, s->waiter);
+#endif
+		}
+		s->promise.set_value(result);
+		s->cv.notify_all();
+#ifdef LIGHTIFY_HAVE_COROUTINES
+		if (waiter) waiter.resume();
+#endif
+	}
+
+public:
+	/** Has the request been executed? */
+	bool IsDone(void) const {
+		std::lock_guard<std::mutex> l(_state->lock);
+		return _state->done;
+	}
+
+	/** Wait for the request and return its result */
+	int Get(void) const {
+		std::unique_lock<std::mutex> l(_state->lock);
+		_state->cv.wait(l, [this] { return _state->done; });
+		return _state->result;
+	}
+
+	/** Get a std::future for the result
+	 *
+	 * \note can only be called once per request. */
+	std::future<int> GetFuture(void) {
+		return _state->promise.get_future();
+	}
+
+#ifdef LIGHTIFY_HAVE_COROUTINES
+	bool await_ready(void) const noexcept {
+		std::lock_guard<std::mutex> l(_state->lock);
+		return _state->done;
+	}
+
+	bool await_suspend(std::coroutine_handle<> h) noexcept {
+		std::lock_guard<std::mutex> l(_state->lock);
+		if (_state->done) return false; // completed meanwhile, continue.
+		_state->waiter = h;
+		return true;
+	}
+
+	int await_resume(void) const noexcept {
+		std::lock_guard<std::mutex> l(_state->lock);
+		return _state->result;
+	}
+#endif
+
+private:
+	std::shared_ptr<State> _state;
+};
+
+/** Queue requests for a Lightify object and execute them in the background
+ *
+ * The library context is not thread safe, so all requests are executed one
+ * after another, in the order they have been queued.
+ *
+ * The node and group objects passed must stay valid until their requests have
+ * completed. A rescan keeps the objects whose node or group is still there;
+ * only those of vanished nodes and groups become invalid.
+ */
+class Lightify_Async {
+public:
+	/// Executor: runs the passed job, e.g. on a thread pool.
+	typedef std::function<void(std::function<void()>)> Executor;
+
+	/** Use a library owned I/O thread */
+	explicit Lightify_Async(Lightify &lightify)
+		: _lightify(lightify), _stop(false) {
+		_thread = std::thread(&Lightify_Async::_run, this);
+	}
+
+	/** Use an application provided executor to run the requests.
+	 *
+	 * The executor will be called once for every request. It must not run
+	 * the job synchronously within the call. */
+	Lightify_Async(Lightify &lightify, Executor executor)
+		: _lightify(lightify), _executor(std::move(executor)), _stop(false) {
+	}
+
+	/** Waits until all queued requests have been executed. */
+	~Lightify_Async() {
+		{
+			std::unique_lock<std::mutex> l(_lock);
+			_stop = true;
+			_cv.notify_all();
+			_idle.wait(l, [this] { return _queue.empty() && !_busy; });
+		}
+		if (_thread.joinable()) _thread.join();
+	}
+
+	Lightify_Async(const Lightify_Async &) = delete;
+	Lightify_Async &operator=(const Lightify_Async &) = delete;
+
+	/** Queue any function working on the Lightify object. */
+	Lightify_Task Submit(std::function<int(Lightify &)> fn) {
+		std::shared_ptr<Lightify_Task::State> s = std::make_shared<Lightify_Task::State>();
+		Lightify &l = _lightify;
+		bool post;
+		{
+			std::lock_guard<std::mutex> g(_lock);
+			_queue.push_back([s, fn, &l] { Lightify_Task::Complete(s, fn(l)); });
+			// with an executor, one job drains the queue at a time.
+			post = _executor && !_busy;
+			if (post) _busy = true;
+		}
+		if (post) {
+			_executor([this] { _drain(); });
+		} else {
+			_cv.notify_one();
+		}
+		return Lightify_Task(s);
+	}
+
+	// Node requests, see Lightify_Node.
+
+	Lightify_Task TurnOnOff(Lightify_Node &node, bool onoff) {
+		Lightify_Node *n = &node;
+		return Submit([n, onoff](Lightify &) { return n->TurnOnOff(onoff); });
+	}
+
+	Lightify_Task SetCCT(Lightify_Node &node, int cct, int time) {
+		Lightify_Node *n = &node;
+		return Submit([n, cct, time](Lightify &) { return n->SetCCT(cct, time); });
+	}
+
+	Lightify_Task SetRGBW(Lightify_Node &node, int red, int green, int blue,
+			int white, int time) {
+		Lightify_Node *n = &node;
+		return Submit([=](Lightify &) {
+			return n->SetRGBW(red, green, blue, white, time); });
+	}
+
+	Lightify_Task SetBrightness(Lightify_Node &node, int level, int time) {
+		Lightify_Node *n = &node;
+		return Submit([n, level, time](Lightify &) { return n->SetBrightness(level, time); });
+	}
+
+	Lightify_Task UpdateNodeInfo(Lightify_Node &node) {
+		Lightify_Node *n = &node;
+		return Submit([n](Lightify &) { return n->UpdateNodeInfo(); });
+	}
+
+	// Group requests, see Lightify_Group
+
+	Lightify_Task TurnOnOff(Lightify_Group &group, bool onoff) {
+		Lightify_Group *g = &group;
+		return Submit([g, onoff](Lightify &) { return g->TurnOnOff(onoff); });
+	}
+
+	Lightify_Task SetCCT(Lightify_Group &group, int cct, int time) {
+		Lightify_Group *g = &group;
+		return Submit([g, cct, time](Lightify &) { return g->SetCCT(cct, time); });
+	}
+
+	Lightify_Task SetRGBW(Lightify_Group &group, int red, int green, int blue,
+			int white, int time) {
+		Lightify_Group *g = &group;
+		return Submit([=](Lightify &) {
+			return g->SetRGBW(red, green, blue, white, time); });
+	}
+
+	Lightify_Task SetBrightness(Lightify_Group &group, int level, int time) {
+		Lightify_Group *g = &group;
+		return Submit([g, level, time](Lightify &) { return g->SetBrightness(level, time); });
+	}
+
+	// Requests of the Lightify object
+
+	Lightify_Task TurnAllOnOff(bool onoff) {
+		return Submit([onoff](Lightify &l) { return l.TurnAllOnOff(onoff); });
+	}
+
+	/** \note invalidates the objects of nodes which vanished when executed */
+	Lightify_Task ScanNodes(void) {
+		return Submit([](Lightify &l) { return l.ScanNodes(); });
+	}
+
+	/** \note invalidates the objects of groups which vanished when executed */
+	Lightify_Task ScanGroups(void) {
+		return Submit([](Lightify &l) { return l.ScanGroups(); });
+	}
+
+private:
+	/* I/O thread */
+	void _run(void) {
+		std::unique_lock<std::mutex> l(_lock);
+		for (;;) {
+			_cv.wait(l, [this] { return _stop || !_queue.empty(); });
+			if (_queue.empty()) break; // stopped and nothing left.
+			std::function<void()> job = std::move(_queue.front());
+			_queue.pop_front();
+			_busy = true;
+			l.unlock();
+			job();
+			l.lock();
+			_busy = false;
+			if (_queue.empty()) _idle.notify_all();
+		}
+	}
+
+	/* executor job: run queued requests until the queue is empty */
+	void _drain(void) {
+		std::unique_lock<std::mutex> l(_lock);
+		while (!_queue.empty()) {
+			std::function<void()> job = std::move(_queue.front());
+			_queue.pop_front();
+			l.unlock();
+			job();
+			l.lock();
+		}
+		_busy = false;
+		_idle.notify_all();
+	}
+
+	Lightify &_lightify;
+	Executor _executor;
+
+	std::mutex _lock;
+	std::condition_variable _cv;
+	std::condition_variable _idle;
+	std::deque<std::function<void()> > _queue;
+	bool _busy = false;
+	bool _stop;
+	std::thread _thread;
+};
+
+#endif /* SRC_LIBLIGHTIFY___LIGHTIFY___ASYNC_HPP_ */
@@ -57,6 +57,166 @@
 #include <stdexcept>
 #endif
 
+/// Opt-in: define LIGHTIFY_USE_STL before including this header to make
+/// the Lightify object movable (but not copyable). Requires C++11.
+#ifdef LIGHTIFY_USE_STL
+#if __cplusplus < 201103L
+#error "LIGHTIFY_USE_STL requires C++11"
+#endif
+#include <utility>
+#endif
+
+#include <new>
+#include <stdlib.h>
+
+#if __cplusplus >= 201103L
+#include <array>
+#include <stdint.h>
+
+/** Typed telegram definitions and builders
+ *
+ * Each telegram is a type with its command, size and fields. Fields know
+ * their offset and width, and are checked at compile time to lie within
+ * the telegram and outside the header. Telegrams are plain std::array
+ * buffers; the builders only store bytes at constant offsets.
+ *
+ * With C++17, the builders are constexpr and frames can be built at
+ * compile time.
+ *
+ * Send them with Lightify::Send() (or lightify_request_telegram()), which
+ * fills in the token.
+ */
+namespace lightify_telegram {
+
+#if __cplusplus >= 201703L
+#define LIGHTIFY_TELEGRAM_CONSTEXPR constexpr
+#else
+#define LIGHTIFY_TELEGRAM_CONSTEXPR inline
+#endif
+
+/// size of the common header
+static const size_t HEADER_SIZE = 8;
+
+/// Flags: address a group instead of a node
+static const unsigned char FLAG_GROUP = 0x02;
+
+/// Address for broadcasts
+static const uint64_t BROADCAST = ~(uint64_t) 0;
+
+/** Layout of a telegram: command and total size */
+template <unsigned char CMD, size_t SIZE>
+struct Layout {
+	static_assert(SIZE > HEADER_SIZE, "telegram must have a payload");
+	static const unsigned char command = CMD;
+	static const size_t size = SIZE;
+	typedef std::array<unsigned char, SIZE> Buffer;
+};
+
+/** Little endian field at OFFSET, WIDTH bytes, within telegram T */
+template <class T, size_t OFFSET, size_t WIDTH>
+struct Field {
+	static_assert(OFFSET >= HEADER_SIZE, "field overlaps header");
+	static_assert(OFFSET + WIDTH <= T::size, "field exceeds telegram");
+	static_assert(WIDTH >= 1 && WIDTH <= 8, "invalid field width");
+	typedef T Telegram;
+	static const size_t offset = OFFSET;
+	static const size_t width = WIDTH;
+};
+
+/** Store value into field F */
+template <class F>
+LIGHTIFY_TELEGRAM_CONSTEXPR void Put(typename F::Telegram::Buffer &buf, uint64_t value) {
+	for (size_t i = 0; i < F::width; i++) {
+		buf[F::offset + i] = (unsigned char) (value >> (8 * i));
+	}
+}
+
+/** Fill the header of telegram T (token left zero) */
+template <class T>
+LIGHTIFY_TELEGRAM_CONSTEXPR void PutHeader(typename T::Buffer &buf, unsigned char flags) {
+	buf[0] = (T::size - 2) & 0xff;
+	buf[1] = (T::size - 2) >> 8;
+	buf[2] = flags;
+	buf[3] = T::command;
+	buf[4] = buf[5] = buf[6] = buf[7] = 0;
+}
+
+/// 0x31: set brightness
+struct Brightness : Layout<0x31, 19> {
+	typedef Field<Brightness, 8, 8> Address;
+	typedef Field<Brightness, 16, 1> Level;
+	typedef Field<Brightness, 17, 2> Fadetime;
+};
+
+/// 0x32: on / off
+struct OnOff : Layout<0x32, 17> {
+	typedef Field<OnOff, 8, 8> Address;
+	typedef Field<OnOff, 16, 1> State;
+};
+
+/// 0x33: colour temperature
+struct CCT : Layout<0x33, 20> {
+	typedef Field<CCT, 8, 8> Address;
+	typedef Field<CCT, 16, 2> Kelvin;
+	typedef Field<CCT, 18, 2> Fadetime;
+};
+
+/// 0x36: colour
+struct RGBW : Layout<0x36, 22> {
+	typedef Field<RGBW, 8, 8> Address;
+	typedef Field<RGBW, 16, 1> Red;
+	typedef Field<RGBW, 17, 1> Green;
+	typedef Field<RGBW, 18, 1> Blue;
+	typedef Field<RGBW, 19, 1> White;
+	typedef Field<RGBW, 20, 2> Fadetime;
+};
+
+/** Build 0x31 into buf. adr is a MAC, group id (with group=true) or BROADCAST */
+LIGHTIFY_TELEGRAM_CONSTEXPR Brightness::Buffer &BuildBrightness(Brightness::Buffer &buf,
+		uint64_t adr, unsigned int level, unsigned int fadetime, bool group = false) {
+	PutHeader<Brightness>(buf, group ? FLAG_GROUP : 0);
+	Put<Brightness::Address>(buf, adr);
+	Put<Brightness::Level>(buf, level);
+	Put<Brightness::Fadetime>(buf, fadetime);
+	return buf;
+}
+
+/** Build 0x32 into buf */
+LIGHTIFY_TELEGRAM_CONSTEXPR OnOff::Buffer &BuildOnOff(OnOff::Buffer &buf,
+		uint64_t adr, bool on, bool group = false) {
+	PutHeader<OnOff>(buf, group ? FLAG_GROUP : 0);
+	Put<OnOff::Address>(buf, adr);
+	Put<OnOff::State>(buf, on ? 1 : 0);
+	return buf;
+}
+
+/** Build 0x33 into buf */
+LIGHTIFY_TELEGRAM_CONSTEXPR CCT::Buffer &BuildCCT(CCT::Buffer &buf,
+		uint64_t adr, unsigned int kelvin, unsigned int fadetime, bool group = false) {
+	PutHeader<CCT>(buf, group ? FLAG_GROUP : 0);
+	Put<CCT::Address>(buf, adr);
+	Put<CCT::Kelvin>(buf, kelvin);
+	Put<CCT::Fadetime>(buf, fadetime);
+	return buf;
+}
+
+/** Build 0x36 into buf */
+LIGHTIFY_TELEGRAM_CONSTEXPR RGBW::Buffer &BuildRGBW(RGBW::Buffer &buf,
+		uint64_t adr, unsigned int r, unsigned int g, unsigned int b,
+		unsigned int w, unsigned int fadetime, bool group = false) {
+	PutHeader<RGBW>(buf, group ? FLAG_GROUP : 0);
+	Put<RGBW::Address>(buf, adr);
+	Put<RGBW::Red>(buf, r);
+	Put<RGBW::Green>(buf, g);
+	Put<RGBW::Blue>(buf, b);
+	Put<RGBW::White>(buf, w);
+	Put<RGBW::Fadetime>(buf, fadetime);
+	return buf;
+}
+
+} // namespace lightify_telegram
+#endif
+
 class Lightify_Node {
 	friend class Lightify;
 protected:
@@ -235,6 +395,51 @@ public:
 		return lightify_group_get_name(_group);
 	}
 
+	/** Number of known member nodes */
+	int GetMemberCount() {
+		return lightify_group_get_member_count(_group);
+	}
+
+	/** All members on? (from cache) */
+	int IsAllOn() {
+		return lightify_group_is_all_on(_group);
+	}
+
+	/** Any member on? (from cache) */
+	int IsAnyOn() {
+		return lightify_group_is_any_on(_group);
+	}
+
+	int GetOnlineCount() {
+		return lightify_group_get_online_count(_group);
+	}
+
+	int GetStaleCount() {
+		return lightify_group_get_stale_count(_group);
+	}
+
+	int GetBrightnessAvg() {
+		return lightify_group_get_brightness_avg(_group);
+	}
+
+	int GetBrightnessMin() {
+		return lightify_group_get_brightness_min(_group);
+	}
+
+	int GetBrightnessMax() {
+		return lightify_group_get_brightness_max(_group);
+	}
+
+	/** Common CCT of all members, -ENODATA if they disagree */
+	int GetCCT() {
+		return lightify_group_get_cct(_group);
+	}
+
+	/** Common colour of all members, -ENODATA if they disagree */
+	int GetRGBW(int &red, int &green, int &blue, int &white) {
+		return lightify_group_get_rgbw(_group, &red, &green, &blue, &white);
+	}
+
 	/** Turn on / off */
 	int TurnOnOff(bool onoff) {
 		return lightify_group_request_onoff(_ctx, _group, onoff);
@@ -295,6 +500,234 @@ private:
 	struct lightify_ctx *_ctx;
 };
 
+/** Range over the nodes or groups of the last scan, e.g for range-for. */
+template <class T> class Lightify_Range {
+public:
+	class iterator {
+	public:
+		explicit iterator(T * const *p) : _p(p) {}
+		T &operator*() const { return **_p; }
+		T *operator->() const { return *_p; }
+		iterator &operator++() { ++_p; return *this; }
+		bool operator==(const iterator &other) const { return _p == other._p; }
+		bool operator!=(const iterator &other) const { return _p != other._p; }
+	private:
+		T * const *_p;
+	};
+
+	Lightify_Range(T * const *first, size_t count) : _first(first), _count(count) {}
+
+	iterator begin() const { return iterator(_first); }
+	iterator end() const { return iterator(_first + _count); }
+	size_t size() const { return _count; }
+
+private:
+	T * const *_first;
+	size_t _count;
+};
+
+/** Storage for the node and group objects of the wrapper.
+ *
+ * Objects live in chunks which are neither moved nor freed until the pool is
+ * destroyed, so pointers to them stay valid. On a rescan an object is found
+ * again by its key (MAC or group id) and reused; slots of objects which
+ * vanished are recycled. Once the pool has grown to the number of objects,
+ * rescans don't allocate anymore.
+ */
+template <class T> class Lightify_Pool {
+public:
+	Lightify_Pool() : _chunks(NULL), _chunk_used(CHUNK), _order(NULL),
+		_keys(NULL), _count(0), _cap(0), _spare(NULL), _nspare(0),
+		_slots(0), _index(NULL), _index_size(0), _epoch(0) {}
+
+	~Lightify_Pool() {
+		free(_order);
+		free(_keys);
+		free(_spare);
+		free(_index);
+		while (_chunks) {
+			union chunk_hdr *c = _chunks;
+			_chunks = c->next;
+			free(c);
+		}
+	}
+
+	/** Start a new scan, expecting n objects. Returns negative on error */
+	int Begin(size_t n) {
+		_count = 0;
+		_epoch++;
+		return _grow(n);
+	}
+
+	/** Get the slot for key: The object of the last scan with the same
+	 * key, if any, else a recycled or new slot. NULL on out of memory. */
+	T *Acquire(unsigned long long key) {
+		struct index_entry *e = _lookup(key);
+		T *obj;
+		if (_count == _cap && _grow(_cap ? 2 * _cap : (size_t) CHUNK) < 0) return NULL;
+
+		if (e && e->epoch != _epoch) {
+			e->epoch = _epoch;
+			obj = e->obj;
+		} else if (_nspare) {
+			obj = _spare[--_nspare];
+		} else {
+			obj = _new_slot();
+			if (!obj) return NULL;
+		}
+		_order[_count] = obj;
+		_keys[_count++] = key;
+		return obj;
+	}
+
+	/** Scan done: recycle the objects not seen and index the new ones. */
+	int End(void) {
+		size_t i;
+		for (i = 0; i < _index_size; i++) {
+			if (_index[i].obj && _index[i].epoch != _epoch) _spare[_nspare++] = _index[i].obj;
+		}
+
+		if (_index_size < 2 * _count || !_index) {
+			size_t n = 16;
+			while (n < 2 * _count) n *= 2;
+			struct index_entry *tmp = (struct index_entry*) realloc(_index, n * sizeof(*tmp));
+			if (!tmp) {
+				_count = 0;
+				return -ENOMEM;
+			}
+			_index = tmp;
+			_index_size = n;
+		}
+		memset(_index, 0, _index_size * sizeof(*_index));
+		for (i = 0; i < _count; i++) {
+			struct index_entry *e = _slot(_keys[i]);
+			e->key = _keys[i];
+			e->obj = _order[i];
+			e->epoch = _epoch;
+		}
+		return 0;
+	}
+
+	/** Object for key, NULL if not found in the last scan */
+	T *Find(unsigned long long key) const {
+		struct index_entry *e = _lookup(key);
+		return e ? e->obj : NULL;
+	}
+
+	/** i-th object of the last scan */
+	T *At(size_t i) const {
+		return i < _count ? _order[i] : NULL;
+	}
+
+	size_t Count(void) const {
+		return _count;
+	}
+
+	Lightify_Range<T> Range(void) const {
+		return Lightify_Range<T>(_order, _count);
+	}
+
+	void Swap(Lightify_Pool &other) {
+		_swap(_chunks, other._chunks);
+		_swap(_chunk_used, other._chunk_used);
+		_swap(_order, other._order);
+		_swap(_keys, other._keys);
+		_swap(_count, other._count);
+		_swap(_cap, other._cap);
+		_swap(_spare, other._spare);
+		_swap(_nspare, other._nspare);
+		_swap(_slots, other._slots);
+		_swap(_index, other._index);
+		_swap(_index_size, other._index_size);
+		_swap(_epoch, other._epoch);
+	}
+
+private:
+	enum { CHUNK = 32 };
+
+	union chunk_hdr {
+		union chunk_hdr *next;
+		long double align_ld;
+		long long align_ll;
+		void *align_p;
+	};
+
+	struct index_entry {
+		unsigned long long key;
+		T *obj;
+		unsigned long epoch;
+	};
+
+	template <class V> static void _swap(V &a, V &b) {
+		V tmp = a;
+		a = b;
+		b = tmp;
+	}
+
+	T *_new_slot(void) {
+		if (_chunk_used == CHUNK) {
+			union chunk_hdr *c = (union chunk_hdr*) malloc(sizeof(*c) + CHUNK * sizeof(T));
+			T **spare = (T**) realloc(_spare, (_slots + CHUNK) * sizeof(T*));
+			if (spare) _spare = spare;
+			if (!c || !spare) {
+				free(c);
+				return NULL;
+			}
+			c->next = _chunks;
+			_chunks = c;
+			_chunk_used = 0;
+			_slots += CHUNK;
+		}
+		return reinterpret_cast<T*>(_chunks + 1) + _chunk_used++;
+	}
+
+	int _grow(size_t n) {
+		if (n <= _cap) return 0;
+		T **order = (T**) realloc(_order, n * sizeof(T*));
+		if (order) _order = order;
+		unsigned long long *keys = (unsigned long long*) realloc(_keys, n * sizeof(*keys));
+		if (keys) _keys = keys;
+		if (!order || !keys) return -ENOMEM;
+		_cap = n;
+		return 0;
+	}
+
+	struct index_entry *_slot(unsigned long long key) const {
+		size_t mask = _index_size - 1;
+		size_t i = (size_t) ((key ^ (key >> 31)) * 0x9E3779B97F4A7C15ULL >> 32) & mask;
+		while (_index[i].obj && _index[i].key != key) i = (i + 1) & mask;
+		return &_index[i];
+	}
+
+	struct index_entry *_lookup(unsigned long long key) const {
+		if (!_index) return NULL;
+		struct index_entry *e = _slot(key);
+		return e->obj ? e : NULL;
+	}
+
+	union chunk_hdr *_chunks;
+	size_t _chunk_used;
+
+	/// objects of the current scan, in the order of the library
+	T **_order;
+	unsigned long long *_keys;
+	size_t _count;
+	size_t _cap;
+
+	/// recycled slots
+	T **_spare;
+	size_t _nspare;
+	size_t _slots;
+
+	/// open addressing hash: key -> object
+	struct index_entry *_index;
+	size_t _index_size;
+	unsigned long _epoch;
+
+	Lightify_Pool(const Lightify_Pool &);
+	Lightify_Pool &operator=(const Lightify_Pool &);
+};
+
 /** Lightify-Class to encapsulate the library context and offer
  * access to the management functionality.
  *
@@ -313,10 +746,6 @@ public:
 		_port = port;
 		_sockfd = -1;
 		_ctx = NULL;
-		_nodesmap = NULL;
-		_groupsmap = NULL;
-		_no_nodes = 0;
-		_no_groups = 0;
 
 		int err = lightify_new(&_ctx, NULL);
 #ifdef LIGHTIFY_ALLOW_THROW
@@ -330,10 +759,35 @@ public:
 		if (_ctx) lightify_free(_ctx);
 		if (_host) free(_host);
 		if (_sockfd != -1) close(_sockfd);
-		_free_nodemap();
-		_free_groupmap();
 	}
 
+#ifdef LIGHTIFY_USE_STL
+	/// Move constructor: takes over context, connection and scanned objects.
+	Lightify(Lightify &&other) noexcept
+		: _ctx(other._ctx), _host(other._host), _port(other._port),
+		  _sockfd(other._sockfd) {
+		other._ctx = NULL;
+		other._host = NULL;
+		other._sockfd = -1;
+		_nodes.Swap(other._nodes);
+		_groups.Swap(other._groups);
+	}
+
+	/// Move assignment -- the resources of this object are released with other.
+	Lightify &operator=(Lightify &&other) noexcept {
+		std::swap(_ctx, other._ctx);
+		std::swap(_host, other._host);
+		std::swap(_port, other._port);
+		std::swap(_sockfd, other._sockfd);
+		_nodes.Swap(other._nodes);
+		_groups.Swap(other._groups);
+		return *this;
+	}
+
+	Lightify(const Lightify &) = delete;
+	Lightify &operator=(const Lightify &) = delete;
+#endif
+
 	/** Open socket / prepare communication
 	  * returns 0 on success, negative on error.*/
 	int Open(void) {
@@ -406,73 +860,69 @@ err_out:
 	}
 
 	/** Scan for nodes
-	 \note: This invalidates all previously known node information! */
+	 *
+	 * \note Node objects of nodes found again stay valid (same MAC), all
+	 * others are invalid after the scan.
+	 *
+	 * \return number of detected nodes, negative on error.
+	 */
 	int ScanNodes(void) {
 
 		int err;
+		size_t i;
 		if (_sockfd == -1) return -EBADF;
-		_free_nodemap();
+
+		// the library frees its nodes on scan
+		for (i = 0; i < _nodes.Count(); i++) _nodes.At(i)->_node = NULL;
+
 		err = lightify_node_request_scan(_ctx);
-		if (err < 0) return err;
+		if (err < 0) {
+			_nodes.Begin(0);
+			_nodes.End();
+			return err;
+		}
 
-		struct lean_nodemap *last_inserted = NULL;
+		if (_nodes.Begin(err) < 0) return -ENOMEM;
 		struct lightify_node *node = NULL;
 		while ((node = lightify_node_get_next(_ctx, node))) {
-			struct lean_nodemap *nm = new lean_nodemap();
-			if (!nm) return -ENOMEM;
-			nm->next = 0;
-			nm->node = new Lightify_Node(_ctx,node);
-			if (!nm->node) {
-				delete nm;
-				return -ENOMEM;
-			}
-
-			if (!last_inserted) {
-				_nodesmap = nm;
-			} else {
-				last_inserted->next = nm;
-			}
-			last_inserted = nm;
-			_no_nodes ++;
+			Lightify_Node *obj = _nodes.Acquire(lightify_node_get_nodeadr(node));
+			if (!obj) break;
+			new (obj) Lightify_Node(_ctx, node);
 		}
-		return _no_nodes;
-
+		if (_nodes.End() < 0 || node) return -ENOMEM;
+		return _nodes.Count();
 	}
 
 	/** Scan for known groups and generate a Group object for every returned group.
 	 *
-	 * \note Scanning will invalidate all previous objects.
+	 * \note Group objects of groups found again stay valid (same id), all
+	 * others are invalid after the scan.
 	 *
 	 * \return number of detected groups, negative on error.
 	 * */
 	int ScanGroups(void) {
 		int err;
+		size_t i;
 		if (_sockfd == -1) return -EBADF;
-		_free_groupmap();
+
+		for (i = 0; i < _groups.Count(); i++) _groups.At(i)->_group = NULL;
+
 		err = lightify_group_request_scan(_ctx);
-		if (err < 0) return err;
+		if (err < 0) {
+			_groups.Begin(0);
+			_groups.End();
+			return err;
+		}
 
-		struct lean_groupmap *last_inserted = NULL;
+		if (_groups.Begin(err) < 0) return -ENOMEM;
 		struct lightify_group *group = NULL;
-		while ( (group = lightify_group_get_next(_ctx, group))) {
-			struct lean_groupmap *gm = new lean_groupmap();
-			if (!gm) return -ENOMEM;
-			gm->next = NULL;
-			gm-> group = new Lightify_Group(_ctx, group);
-			if (!gm->group) {
-				delete gm;
-				return -ENOMEM;
-			}
-
-			if (!last_inserted) {
-				_groupsmap = gm;
-			} else {
-				last_inserted->next = gm;
-			}
-			last_inserted = gm;
-			_no_groups++;
+		while ((group = lightify_group_get_next(_ctx, group))) {
+			Lightify_Group *obj = _groups.Acquire(lightify_group_get_id(group));
+			if (!obj) break;
+			new (obj) Lightify_Group(_ctx, group);
 		}
-		return _no_groups;
+		if (_groups.End() < 0 || group) return -ENOMEM;
+		return _groups.Count();
 	}
 
 	/** Get direct access to the lighitfy context
@@ -484,6 +934,16 @@ err_out:
 		return _ctx;
 	}
 
+#if __cplusplus >= 201103L
+	/** Send a telegram built with the lightify_telegram builders
+	 *
+	 * \returns negative on error, see lightify_request_telegram() */
+	template <size_t N>
+	int Send(std::array<unsigned char, N> &telegram) {
+		return lightify_request_telegram(_ctx, telegram.data(), N);
+	}
+#endif
+
 	/** Actions that can be broadcasted. */
 	int TurnAllOnOff(bool onoff)
 	{
@@ -492,12 +952,7 @@ err_out:
 
 	/** Get the node object for a given MAC address */
 	Lightify_Node *GetNode(long long mac) {
-		struct lean_nodemap *nm = _nodesmap;
-		while(nm) {
-			if (nm->node->GetMAC() == mac) return nm->node;
-			nm = nm->next;
-		}
-		return NULL;
+		return _nodes.Find(mac);
 	}
 
 	/** Get node at Pos X
@@ -506,10 +961,8 @@ err_out:
 	 *
 	 */
 	Lightify_Node* GetNodeAtPosX(int x) const {
-		if (x >= _no_nodes) return NULL;
-		struct lean_nodemap *nm = _nodesmap;
-		while(nm && x--) nm = nm->next;
-		return (nm ? nm->node : NULL);
+		if (x < 0) return NULL;
+		return _nodes.At(x);
 	}
 
 	/** Get Group at Pos X
@@ -518,10 +971,18 @@ err_out:
 	 *
 	 */
 	Lightify_Group* GetGroupAtPosX(int pos) const {
-		if (pos >= _no_groups) return NULL;
-		struct lean_groupmap *gm = _groupsmap;
-		while(pos--) gm = gm->next;
-		return gm->group;
+		if (pos < 0) return NULL;
+		return _groups.At(pos);
+	}
+
+	/** All nodes of the last scan, e.g for range-for */
+	Lightify_Range<Lightify_Node> Nodes(void) const {
+		return _nodes.Range();
+	}
+
+	/** All groups of the last scan, e.g for range-for */
+	Lightify_Range<Lightify_Group> Groups(void) const {
+		return _groups.Range();
 	}
 
 	/** Get the library context -- for direct library access.
@@ -561,60 +1022,22 @@ err_out:
 
 
 	int GetNodesCount(void) {
-		return _no_nodes;
+		return _nodes.Count();
 	}
 
 	int GetGroupsCount(void) {
-		return _no_groups;
+		return _groups.Count();
 	}
 
 
 private:
-	void _free_nodemap(void) {
-		struct lean_nodemap *nmtmp, *nm = _nodesmap;
-		while (nm) {
-			nmtmp = nm->next;
-			delete nm->node;
-			delete nm;
-			nm = nmtmp;
-		}
-		_nodesmap = NULL;
-		_no_nodes = 0;
-	}
-
-	void _free_groupmap(void) {
-		struct lean_groupmap *gmtmp, *gm = _groupsmap;
-		while (gm) {
-			gmtmp = gm->next;
-			delete gm->group;
-			delete gm;
-			gm = gmtmp;
-		}
-		_groupsmap = NULL;
-		_no_groups = 0;
-	}
-
 	struct lightify_ctx *_ctx;
 	char *_host;
 	unsigned int _port;
 	int _sockfd;
 
-	// this is to avoid avoid STL...
-	struct lean_nodemap {
-		struct lean_nodemap *next;
-		Lightify_Node *node;
-	};
-
-	struct lean_groupmap {
-		struct lean_groupmap *next;
-		Lightify_Group *group;
-	};
-
-	struct lean_nodemap *_nodesmap;
-	struct lean_groupmap *_groupsmap;
-
-	int _no_nodes;
-	int _no_groups;
+	Lightify_Pool<Lightify_Node> _nodes;
+	Lightify_Pool<Lightify_Group> _groups;
 };
 
 
@@ -34,6 +34,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <stdint.h>
 #include <stdlib.h>
 #include <sys/time.h>
+#include <time.h>
 
 
 #ifdef __cplusplus
@@ -50,6 +51,13 @@ extern "C" {
 
 /** \defgroup API_GROUP Group manipulation and state */
 
+/** \defgroup API_CAPTURE Session recording and replay */
+/** \defgroup API_BATCH Pipelined batches of commands */
+/** \defgroup API_COLOR Colour conversions */
+/** \defgroup API_SHM Sharing the cache with other processes */
+/** \defgroup API_RECONCILE Reaching a desired state */
+/** \defgroup API_VGROUP Virtual groups */
+
 /** \mainpage API Documentation for liblightify
  *
  *  \section ll_CAPI C API Documentation
@@ -62,6 +70,7 @@ extern "C" {
  *  - Library callbacks (e.g I/O) \ref API_CALLBACK
  *  - Nodes (Lamp) related: \ref API_NODE
  *  - Group relatedNode manipulation and state: \ref API_GROUP
+ *  - Recording and replaying gateway sessions: \ref API_CAPTURE
  *
  *  \subsections ll_CAPI_NodeCache Node Information Cache
  *
@@ -121,6 +130,15 @@ enum lightify_node_online_state {
 	LIGHTIFY_ONLINE = 2,    /**< online */
 };
 
+/** How the default I/O functions wait for the socket to become ready
+ *
+ * \ingroup API_IO
+ */
+enum lightify_wait_method {
+	LIGHTIFY_WAIT_POLL = 0, /**< poll(), default */
+	LIGHTIFY_WAIT_EPOLL,    /**< epoll, optionally shared between contexts */
+};
+
 /** lightyfy_ctx
  *
  * library user context.
@@ -160,6 +178,33 @@ struct lightify_cct_loop_spec {
 	uint8_t brightness; /**< brightness */
 };
 
+/** lightify_hsv
+ *
+ * A colour as hue, saturation and value. The hue covers the full circle with
+ * 0..255, like in struct lightify_color_loop_spec.
+ *
+ * \ingroup API_COLOR
+ */
+struct lightify_hsv {
+	uint8_t hue; /**< hue, 0..255 */
+	uint8_t saturation; /**< saturation, 0..255 */
+	uint8_t value; /**< value, 0..255 */
+};
+
+/** lightify_rgbw
+ *
+ * A colour as red, green, blue and white components, ready for
+ * lightify_node_request_rgbw().
+ *
+ * \ingroup API_COLOR
+ */
+struct lightify_rgbw {
+	uint8_t red; /**< red, 0..255 */
+	uint8_t green; /**< green, 0..255 */
+	uint8_t blue; /**< blue, 0..255 */
+	uint8_t white; /**< white, 0..255 */
+};
+
 /** callback to roll your own I/O: Writing
  *
  * if the default function is overriden, this function is called whenever the
@@ -280,7 +325,8 @@ int lightify_skt_getfd(struct lightify_ctx *ctx);
  * @return 0 on success, negative on errors.
  *
  * \note the timeout is only used if the socket is setup using
- * O_NONBLOCK.
+ * O_NONBLOCK. It bounds a complete read or write, including all retries
+ * after partial transfers.
  *
  * \note used by the default I/O implementation, write_to_socket() and
  * read_from_socket(), see there.
@@ -303,6 +349,204 @@ int lightify_skt_setiotimeout(struct lightify_ctx *ctx, struct timeval tv);
  */
 struct timeval lightify_skt_getiotimeout(struct lightify_ctx *ctx);
 
+/** Set an absolute deadline for requests
+ *
+ * All following requests must complete before the deadline, else they are
+ * cancelled and return -ETIMEDOUT. This includes all I/O retries and
+ * reconnects of the library managed connection.
+ *
+ * Any answer of a cancelled request still arriving later is dropped before
+ * the next request is sent (default I/O functions only).
+ *
+ * @param ctx library context
+ * @param deadline absolute time on CLOCK_MONOTONIC, NULL to remove.
+ * @return 0 on success, negative on errors.
+ *
+ * \ingroup API_IO
+ */
+int lightify_set_deadline(struct lightify_ctx *ctx, const struct timespec *deadline);
+
+/** Set a time budget for every single request
+ *
+ * Like lightify_set_deadline(), but the deadline is computed when each
+ * request starts. If both are set, the earlier one is effective.
+ *
+ * Unlike lightify_skt_setiotimeout(), this also works with custom I/O
+ * functions, though the library can only check the deadline between calls
+ * to them.
+ *
+ * @param ctx library context
+ * @param tv time allowed for one request, zero to disable (default)
+ * @return 0 on success, negative on errors.
+ *
+ * \ingroup API_IO
+ */
+int lightify_set_request_timeout(struct lightify_ctx *ctx, struct timeval tv);
+
+/** Select how the default I/O functions wait for the socket.
+ *
+ * The default is poll(). With LIGHTIFY_WAIT_EPOLL, the socket is registered
+ * once with an epoll instance instead of for every wait. Several contexts
+ * driven from the same loop can share one instance by passing the same epfd.
+ *
+ * \note a shared epoll instance must only be used by one thread at a time.
+ *
+ * @param ctx library context
+ * @param method the method to use
+ * @param epfd epoll instance to use with LIGHTIFY_WAIT_EPOLL, or -1 to let
+ * the library create one for this context. The library does not close a
+ * passed instance. Ignored for LIGHTIFY_WAIT_POLL.
+ * @return 0 on success, negative on errors (-ENOTSUP if not available)
+ *
+ * \ingroup API_IO
+ */
+int lightify_skt_setwaitmethod(struct lightify_ctx *ctx,
+		enum lightify_wait_method method, int epfd);
+
+
+/** Set the gateway's address for the library managed connection
+ *
+ * Instead of setting up the socket on its own and passing it with
+ * lightify_skt_setfd(), the application can let the library handle the
+ * connection. See lightify_conn_open().
+ *
+ * @param ctx library context
+ * @param host hostname or IP of the gateway
+ * @param port port, usually 4000
+ * @return 0 on success, negative on error.
+ *
+ * \ingroup API_IO
+ */
+int lightify_conn_set_host(struct lightify_ctx *ctx, const char *host, unsigned int port);
+
+/** Set the timeout for a single connection attempt
+ *
+ * @param ctx library context
+ * @param tv timeout. Default is 2 seconds.
+ * @return 0 on success, negative on error.
+ *
+ * \ingroup API_IO
+ */
+int lightify_conn_set_timeout(struct lightify_ctx *ctx, struct timeval tv);
+
+/** Configure reconnection behaviour
+ *
+ * When (re-)connecting, the library tries up to attempts times. Between the
+ * attempts it waits, starting with initial and doubling the delay on every
+ * retry, up to max.
+ *
+ * @param ctx library context
+ * @param initial delay before the second attempt. Default 50ms
+ * @param max maximum delay between two attempts. Default 2s
+ * @param attempts number of attempts, at least 1. Default 5.
+ * @return 0 on success, negative on error.
+ *
+ * \ingroup API_IO
+ */
+int lightify_conn_set_backoff(struct lightify_ctx *ctx, struct timeval initial,
+		struct timeval max, int attempts);
+
+/** Enable or disable the replay of requests after a reconnect.
+ *
+ * If the connection breaks during a request and replay is enabled, the
+ * library will send the telegram again after it reconnected and the request
+ * will complete as if nothing happened. Only telegrams which are safe to be
+ * repeated (queries and commands setting absolute values) are replayed.
+ *
+ * If disabled, the request fails, but the connection is still re-established
+ * on the next request.
+ *
+ * @param ctx library context
+ * @param enable 0 to disable, else enable (default)
+ * @return 0 on success, negative on error.
+ *
+ * \ingroup API_IO
+ */
+int lightify_conn_set_replay(struct lightify_ctx *ctx, int enable);
+
+/** Open the library managed connection
+ *
+ * Connects to the gateway configured with lightify_conn_set_host(). The
+ * socket is non-blocking, so the timeout set with lightify_skt_setiotimeout()
+ * applies.
+ *
+ * As long as the connection is managed, the library will reconnect on I/O
+ * errors, see lightify_conn_set_backoff() and lightify_conn_set_replay().
+ *
+ * \note Only effective with the default I/O functions, see lightify_set_socket_fn().
+ *
+ * @param ctx library context
+ * @return 0 on success, negative on error.
+ *
+ * \ingroup API_IO
+ */
+int lightify_conn_open(struct lightify_ctx *ctx);
+
+/** Close the library managed connection
+ *
+ * @param ctx library context
+ * @return 0 on success, negative on error (-EBADF if not opened)
+ *
+ * \ingroup API_IO
+ */
+int lightify_conn_close(struct lightify_ctx *ctx);
+
+/** Send a prebuilt set-telegram
+ *
+ * For applications building telegrams on their own, e.g. with the
+ * typed builders of the C++ wrapper. Supported are the commands
+ * 0x31 (brightness), 0x32 (on/off), 0x33 (CCT), 0x36 (RGBW) and the loop
+ * programs 0xD8 (colour) and 0xD9 (CCT).
+ *
+ * The library fills in the token, sends the telegram and checks the
+ * gateway's answer. The cache of the addressed nodes (the node, the group's
+ * members or all nodes for broadcasts) is updated like with the
+ * lightify_node_request_*() and lightify_group_request_*() functions.
+ *
+ * @param ctx library context
+ * @param msg the telegram; the token field is overwritten.
+ * @param size size of the telegram, must match the command.
+ * @return 0 on success, negative on error. -EINVAL for unsupported commands
+ * or inconsistent length.
+ *
+ * \ingroup API_IO
+ */
+int lightify_request_telegram(struct lightify_ctx *ctx, unsigned char *msg, size_t size);
+
+/** Set how long scan results are reused
+ *
+ * Within ttl after a successful lightify_node_request_scan() or
+ * lightify_group_request_scan(), further scans return the cached result
+ * immediately without talking to the gateway. The node and group caches
+ * age independently.
+ *
+ * Changing the ttl invalidates both caches.
+ *
+ * @param ctx context
+ * @param ttl maximum age of a scan result, zero to always scan (default)
+ * @return 0 on success, negative on errors.
+ *
+ * \ingroup API_NODE_CACHE
+ *
+ * \sa lightify_cache_invalidate
+ */
+int lightify_set_cache_ttl(struct lightify_ctx *ctx, struct timeval ttl);
+
+/** Force the next scans to ask the gateway
+ *
+ * Marks the cached node and group scans as outdated, regardless of the ttl
+ * set with lightify_set_cache_ttl(). The cached information itself stays
+ * available until the next scan.
+ *
+ * \note lightify_request_telegram() does this implicitly, as the library
+ * cannot know what a raw telegram changes.
+ *
+ * @param ctx context
+ * @return 0 on success, negative on errors.
+ *
+ * \ingroup API_NODE_CACHE
+ */
+int lightify_cache_invalidate(struct lightify_ctx *ctx);
 
 /** Ask the gateway to provide informations about attached nodes
  *
@@ -320,6 +564,9 @@ struct timeval lightify_skt_getiotimeout(struct lightify_ctx *ctx);
  * parsed. This can be checked via the API to retrieve node pointers. If there
  * are some. the call partially succeeded.
  *
+ * \note if a cache ttl is set and the last scan is recent enough, the cached
+ * nodes are kept and their number is returned, see lightify_set_cache_ttl().
+ *
  * \ingroup API_NODE
  */
 int lightify_node_request_scan(struct lightify_ctx *ctx);
@@ -586,6 +833,291 @@ int lightify_node_get_onlinestate(struct lightify_node* node);
  */
 uint32_t lightify_node_get_fwversion(struct lightify_node *node);
 
+/** Fields of struct lightify_node_state, to select what
+ * lightify_nodes_export_masked() fills in.
+ *
+ * \ingroup API_NODE_CACHE
+ */
+enum lightify_node_state_field {
+	LIGHTIFY_STATE_ADDRESS = 1 << 0,   /**< node_address, zone_address, group_address */
+	LIGHTIFY_STATE_NAME = 1 << 1,      /**< name */
+	LIGHTIFY_STATE_TYPE = 1 << 2,      /**< node_type, fwversion */
+	LIGHTIFY_STATE_ONLINE = 1 << 3,    /**< online_state, is_stale */
+	LIGHTIFY_STATE_ONOFF = 1 << 4,     /**< is_on */
+	LIGHTIFY_STATE_BRIGHTNESS = 1 << 5,/**< brightness */
+	LIGHTIFY_STATE_CCT = 1 << 6,       /**< cct */
+	LIGHTIFY_STATE_RGBW = 1 << 7,      /**< red, green, blue, white */
+	LIGHTIFY_STATE_ALL = 0xff,         /**< everything */
+};
+
+/** Cached state of a node, as plain data
+ *
+ * Filled by lightify_nodes_export(). The values are those the getters
+ * like lightify_node_get_cct() return.
+ *
+ * \ingroup API_NODE_CACHE
+ */
+struct lightify_node_state {
+	uint64_t node_address;  /**< MAC of the node */
+	uint16_t zone_address;  /**< zone address */
+	uint16_t group_address; /**< group membership bitmask */
+	uint32_t fwversion;     /**< see lightify_node_get_fwversion() */
+	int node_type;          /**< enum lightify_node_type */
+	int online_state;       /**< enum lightify_node_online_state, negative if unknown */
+	int is_stale;           /**< 1 if the cached state is not trusted */
+	int is_on;              /**< 0 off, 1 on, negative if unknown */
+	int brightness;         /**< brightness, negative if unknown */
+	int cct;                /**< CCT, negative if unknown */
+	int red;                /**< red, negative if unknown */
+	int green;              /**< green, negative if unknown */
+	int blue;               /**< blue, negative if unknown */
+	int white;              /**< white, negative if unknown */
+	char name[17];          /**< name, NUL terminated */
+};
+
+/** Copy the cached state of all nodes into an array
+ *
+ * One call instead of a getter per node and field, e.g. to snapshot the
+ * whole cache. The nodes are in the order of lightify_node_get_next().
+ *
+ * @param ctx library context
+ * @param out array to fill, may be NULL if cap is 0
+ * @param cap number of elements in out
+ * @return number of nodes in the cache, negative on error. If this is more
+ *  than cap, only the first cap nodes have been copied.
+ *
+ * \ingroup API_NODE_CACHE
+ */
+int lightify_nodes_export(struct lightify_ctx *ctx, struct lightify_node_state *out,
+		size_t cap);
+
+/** Copy selected fields of the cached state of all nodes into an array
+ *
+ * Like lightify_nodes_export(), but only the fields selected by mask are
+ * written; the others are left untouched.
+ *
+ * @param ctx library context
+ * @param out array to fill, may be NULL if cap is 0
+ * @param cap number of elements in out
+ * @param mask bitwise or of enum lightify_node_state_field
+ * @return number of nodes in the cache, negative on error.
+ *
+ * \ingroup API_NODE_CACHE
+ */
+int lightify_nodes_export_masked(struct lightify_ctx *ctx,
+		struct lightify_node_state *out, size_t cap, unsigned int mask);
+
+/** A changed node, as reported by lightify_nodes_diff()
+ *
+ * \ingroup API_NODE_CACHE
+ */
+struct lightify_node_delta {
+	uint32_t index;  /**< index of the node in the snapshots */
+	uint32_t fields; /**< what changed, enum lightify_node_state_field */
+};
+
+/** Compare two snapshots of the node cache
+ *
+ * The snapshots are arrays as filled by lightify_nodes_export(); the nodes
+ * are matched by their position. For a cheap comparison, both should be
+ * taken with the same mask into zero-initialized arrays.
+ *
+ * @param prev older snapshot, n elements
+ * @param cur newer snapshot, n elements
+ * @param n number of nodes to compare
+ * @param bitmap if not NULL, (n + 63) / 64 words, bit i is set if node i changed
+ * @param delta if not NULL, receives the changed nodes in ascending order
+ * @param delta_cap number of elements in delta
+ * @return number of changed nodes, negative on error. If this is more than
+ *  delta_cap, only the first delta_cap changes are in delta.
+ *
+ * \ingroup API_NODE_CACHE
+ */
+int lightify_nodes_diff(const struct lightify_node_state *prev,
+		const struct lightify_node_state *cur, size_t n, uint64_t *bitmap,
+		struct lightify_node_delta *delta, size_t delta_cap);
+
+/** lightify_snapshot
+ *
+ * An immutable, published version of the node cache.
+ *
+ * The library context is not thread safe. Snapshots let other threads read
+ * the node state without locking while the thread owning the context keeps
+ * talking to the gateway: that thread calls lightify_snapshot_publish()
+ * after updating the cache, readers use lightify_snapshot_acquire() and
+ * lightify_snapshot_release().
+ *
+ * \note opaque on purpose. Only use the API to access it.
+ * \ingroup API_NODE_CACHE
+ */
+struct lightify_snapshot;
+
+/** Publish the current node cache as a new snapshot
+ *
+ * Only the nodes changed since the last publication are copied, the rest
+ * is taken over from the previous snapshot. If nothing changed, no new
+ * version is published. Older versions are freed when the last reader
+ * released them.
+ *
+ * Must be called from the thread using the context.
+ *
+ * @param ctx library context
+ * @return 0 on success, negative on error
+ *
+ * \ingroup API_NODE_CACHE
+ */
+int lightify_snapshot_publish(struct lightify_ctx *ctx);
+
+/** Get the latest published snapshot, from any thread
+ *
+ * Lock free. The snapshot stays valid until lightify_snapshot_release();
+ * hold it only briefly, as it keeps the library from freeing old versions.
+ *
+ * @param ctx library context
+ * @param snap where to store the snapshot
+ * @return reader id to pass to lightify_snapshot_release() (>= 0), negative on
+ *  error: -ENODATA if nothing has been published yet, -EBUSY if too many
+ *  readers hold a snapshot.
+ *
+ * \ingroup API_NODE_CACHE
+ */
+int lightify_snapshot_acquire(struct lightify_ctx *ctx,
+		const struct lightify_snapshot **snap);
+
+/** Release a snapshot obtained by lightify_snapshot_acquire()
+ *
+ * @param ctx library context
+ * @param reader the reader id returned by lightify_snapshot_acquire()
+ * @return 0 on success, negative on error
+ *
+ * \ingroup API_NODE_CACHE
+ */
+int lightify_snapshot_release(struct lightify_ctx *ctx, int reader);
+
+/** Access the nodes of a snapshot
+ *
+ * @param snap snapshot
+ * @param count if not NULL, receives the number of nodes
+ * @return array of the nodes' state, in the order of lightify_node_get_next()
+ *
+ * \ingroup API_NODE_CACHE
+ */
+const struct lightify_node_state *lightify_snapshot_get_nodes(
+		const struct lightify_snapshot *snap, size_t *count);
+
+/** Version of a snapshot
+ *
+ * @param snap snapshot
+ * @return version, increased by every publication with changes. 0 on error.
+ *
+ * \ingroup API_NODE_CACHE
+ */
+uint64_t lightify_snapshot_get_version(const struct lightify_snapshot *snap);
+
+/** Cached state of a group, as plain data
+ *
+ * \ingroup API_SHM
+ */
+struct lightify_group_state {
+	int id;           /**< group id */
+	int member_count; /**< number of known member nodes */
+	char name[17];    /**< name, NUL terminated */
+};
+
+/** lightify_shm
+ *
+ * A shared memory segment with a published cache, attached read-only.
+ *
+ * \note opaque on purpose. Only use the API to access it.
+ * \ingroup API_SHM
+ */
+struct lightify_shm;
+
+/** Publish the node and group cache into a POSIX shared memory segment
+ *
+ * The first call creates the segment (see shm_open(3), the name should start
+ * with a slash), later calls update it. Call it whenever the cache has been
+ * refreshed; other processes can then read the state via
+ * lightify_attach_shm() instead of talking to the gateway themselves.
+ *
+ * @param ctx library context
+ * @param name name of the segment, or NULL to update the existing one
+ * @return 0 on success, negative on error
+ *
+ * \ingroup API_SHM
+ */
+int lightify_shm_publish(struct lightify_ctx *ctx, const char *name);
+
+/** Stop publishing and remove the segment
+ *
+ * Also done by lightify_free(). Attached readers keep their mapping.
+ *
+ * @param ctx library context
+ * @return 0 on success, negative on error
+ *
+ * \ingroup API_SHM
+ */
+int lightify_shm_close(struct lightify_ctx *ctx);
+
+/** Attach read-only to a segment published by lightify_shm_publish()
+ *
+ * No library context is needed.
+ *
+ * @param name name of the segment
+ * @param shm where to store the handle
+ * @return 0 on success, negative on error (-EPROTO if the segment has an
+ *  unknown layout)
+ *
+ * \ingroup API_SHM
+ */
+int lightify_attach_shm(const char *name, struct lightify_shm **shm);
+
+/** Detach from a segment
+ *
+ * @param shm handle from lightify_attach_shm()
+ * @return 0 on success, negative on error
+ *
+ * \ingroup API_SHM
+ */
+int lightify_detach_shm(struct lightify_shm *shm);
+
+/** Copy the published nodes
+ *
+ * The copy is consistent: it is never mixed from two publications.
+ *
+ * @param shm handle from lightify_attach_shm()
+ * @param out array to fill, may be NULL if cap is 0
+ * @param cap number of elements in out
+ * @return number of published nodes, negative on error. If this is more
+ *  than cap, only the first cap nodes have been copied.
+ *
+ * \ingroup API_SHM
+ */
+int lightify_shm_get_nodes(struct lightify_shm *shm,
+		struct lightify_node_state *out, size_t cap);
+
+/** Copy the published groups
+ *
+ * @param shm handle from lightify_attach_shm()
+ * @param out array to fill, may be NULL if cap is 0
+ * @param cap number of elements in out
+ * @return number of published groups, negative on error. If this is more
+ *  than cap, only the first cap groups have been copied.
+ *
+ * \ingroup API_SHM
+ */
+int lightify_shm_get_groups(struct lightify_shm *shm,
+		struct lightify_group_state *out, size_t cap);
+
+/** Number of publications so far, to cheaply detect changes
+ *
+ * @param shm handle from lightify_attach_shm()
+ * @return generation, 0 on error or if nothing was published yet
+ *
+ * \ingroup API_SHM
+ */
+uint64_t lightify_shm_get_generation(struct lightify_shm *shm);
+
 // Node manipulation API -- will talk to the node
 
 /** Turn lamp on or off
@@ -708,6 +1240,9 @@ int lightify_group_get_id(struct lightify_group *grp);
  * @param ctx context
  * @return negative on error, else number of retrieved groups (might be zero)
  *
+ * \note if a cache ttl is set and the last scan is recent enough, the cached
+ * groups are kept and their number is returned, see lightify_set_cache_ttl().
+ *
  * \ingroup API_GROUP
  */
 int lightify_group_request_scan(struct lightify_ctx *ctx);
@@ -724,52 +1259,153 @@ int lightify_group_request_scan(struct lightify_ctx *ctx);
  */
 struct lightify_node *lightify_group_get_next_node(struct lightify_group *grp, struct lightify_node *lastnode);
 
-/** Request group to be turned off or on
+/** Get the number of known nodes in the group
  *
- * @param ctx context
- * @param group group ptr
- * @param onoff on or off ( true or false)
- * @return >=0 on success. negative on error.
+ * The group aggregates below are maintained incrementally from the node
+ * cache, so all of them are cheap to query. They reflect what the library
+ * believes about the nodes, i.e. the state after the last scan or command.
+ *
+ * @param grp group
+ * @return number of members or negative on error
  *
  * \ingroup API_GROUP
  */
-int lightify_group_request_onoff(struct lightify_ctx *ctx, struct lightify_group *group, int onoff);
+int lightify_group_get_member_count(struct lightify_group *grp);
 
-/** Set group CCT
+/** Check if all nodes of the group are on
  *
- * @param ctx context
- * @param group group
- * @param cct CCT
- * @param fadetime time in 1/10 secs
- * @return >=0 on success. negative on error.
+ * @param grp group
+ * @return 1 if all members are on, 0 if not (or the group is empty), negative on error
  *
  * \ingroup API_GROUP
  */
-int lightify_group_request_cct(struct lightify_ctx *ctx, struct lightify_group *group, unsigned int cct, unsigned int fadetime);
+int lightify_group_is_all_on(struct lightify_group *grp);
 
-/** Set RGBW values
+/** Check if at least one node of the group is on
  *
- * \note some lamps cannot set white, also white and rgb might be exclusive.
- *
- * @param ctx context
- * @param group
- * @param r red
- * @param g green
- * @param b blue
- * @param w white
- * @param fadetime
- * @return >=0 on success. negative on error.
+ * @param grp group
+ * @return 1 if any member is on, 0 if none, negative on error
  *
  * \ingroup API_GROUP
  */
-int lightify_group_request_rgbw(struct lightify_ctx *ctx,
-		struct lightify_group *group, unsigned int r, unsigned int g,
-		unsigned int b,unsigned int w,unsigned int fadetime) ;
+int lightify_group_is_any_on(struct lightify_group *grp);
 
-/** Set Group brightness
+/** Get the number of group members the gateway reports as online
  *
- * @param ctx
- * @param group
+ * @param grp group
+ * @return number of online members or negative on error
+ *
+ * \ingroup API_GROUP
+ */
+int lightify_group_get_online_count(struct lightify_group *grp);
+
+/** Get the number of group members whose cached state is stale
+ *
+ * @param grp group
+ * @return number of stale members or negative on error
+ *
+ * \ingroup API_GROUP
+ */
+int lightify_group_get_stale_count(struct lightify_group *grp);
+
+/** Get the average brightness of the group
+ *
+ * @param grp group
+ * @return rounded average over the members with known brightness,
+ * -ENODATA if none is known, other negative values on error
+ *
+ * \ingroup API_GROUP
+ */
+int lightify_group_get_brightness_avg(struct lightify_group *grp);
+
+/** Get the lowest brightness within the group
+ *
+ * @param grp group
+ * @return brightness, -ENODATA if none is known, other negative values on error
+ *
+ * \ingroup API_GROUP
+ */
+int lightify_group_get_brightness_min(struct lightify_group *grp);
+
+/** Get the highest brightness within the group
+ *
+ * @param grp group
+ * @return brightness, -ENODATA if none is known, other negative values on error
+ *
+ * \ingroup API_GROUP
+ */
+int lightify_group_get_brightness_max(struct lightify_group *grp);
+
+/** Get the colour temperature shared by all group members
+ *
+ * @param grp group
+ * @return CCT, -ENODATA if the members disagree or any is unknown,
+ * other negative values on error
+ *
+ * \ingroup API_GROUP
+ */
+int lightify_group_get_cct(struct lightify_group *grp);
+
+/** Get the RGBW colour shared by all group members
+ *
+ * @param grp group
+ * @param r where to store red, may be NULL
+ * @param g where to store green, may be NULL
+ * @param b where to store blue, may be NULL
+ * @param w where to store white, may be NULL
+ * @return 0 on success, -ENODATA if the members disagree or any is unknown,
+ * other negative values on error
+ *
+ * \ingroup API_GROUP
+ */
+int lightify_group_get_rgbw(struct lightify_group *grp, int *r, int *g, int *b, int *w);
+
+/** Request group to be turned off or on
+ *
+ * @param ctx context
+ * @param group group ptr
+ * @param onoff on or off ( true or false)
+ * @return >=0 on success. negative on error.
+ *
+ * \ingroup API_GROUP
+ */
+int lightify_group_request_onoff(struct lightify_ctx *ctx, struct lightify_group *group, int onoff);
+
+/** Set group CCT
+ *
+ * @param ctx context
+ * @param group group
+ * @param cct CCT
+ * @param fadetime time in 1/10 secs
+ * @return >=0 on success. negative on error.
+ *
+ * \ingroup API_GROUP
+ */
+int lightify_group_request_cct(struct lightify_ctx *ctx, struct lightify_group *group, unsigned int cct, unsigned int fadetime);
+
+/** Set RGBW values
+ *
+ * \note some lamps cannot set white, also white and rgb might be exclusive.
+ *
+ * @param ctx context
+ * @param group
+ * @param r red
+ * @param g green
+ * @param b blue
+ * @param w white
+ * @param fadetime
+ * @return >=0 on success. negative on error.
+ *
+ * \ingroup API_GROUP
+ */
+int lightify_group_request_rgbw(struct lightify_ctx *ctx,
+		struct lightify_group *group, unsigned int r, unsigned int g,
+		unsigned int b,unsigned int w,unsigned int fadetime) ;
+
+/** Set Group brightness
+ *
+ * @param ctx
+ * @param group
  * @param level
  * @param fadetime
  * @return >=0 on success. negative on error.
@@ -779,6 +1415,431 @@ int lightify_group_request_rgbw(struct lightify_ctx *ctx,
 int lightify_group_request_brightness(struct lightify_ctx *ctx,
 		struct lightify_group *group, unsigned int level, unsigned int fadetime) ;
 
+/** Opaque batch of set commands
+ *
+ * A batch collects commands and sends them pipelined: up to a "window" of
+ * telegrams are in flight at the same time instead of waiting for every
+ * answer before sending the next. The node cache is updated as with the
+ * individual requests.
+ *
+ * \note If the connection breaks while telegrams are in flight, those
+ * fail; they are not replayed by the managed connection.
+ *
+ * \ingroup API_BATCH
+ */
+struct lightify_batch;
+
+/** Create a new, empty batch
+ *
+ * @param ctx library context
+ * @param batch where to store the batch
+ * @return 0 on success, negative on error.
+ *
+ * \ingroup API_BATCH
+ */
+int lightify_batch_new(struct lightify_ctx *ctx, struct lightify_batch **batch);
+
+/** Free the batch
+ *
+ * @param batch to free
+ * @return 0 on success, negative on error.
+ *
+ * \ingroup API_BATCH
+ */
+int lightify_batch_free(struct lightify_batch *batch);
+
+/** Set how many telegrams may be in flight at the same time
+ *
+ * @param batch batch
+ * @param window at least 1. Default is 8.
+ * @return 0 on success, negative on error.
+ *
+ * \ingroup API_BATCH
+ */
+int lightify_batch_set_window(struct lightify_batch *batch, unsigned int window);
+
+/** Remove all commands from the batch, e.g. to reuse it
+ *
+ * @param batch batch
+ * @return 0 on success, negative on error.
+ *
+ * \ingroup API_BATCH
+ */
+int lightify_batch_clear(struct lightify_batch *batch);
+
+/** Get the number of commands in the batch
+ *
+ * @param batch batch
+ * @return number of commands, negative on error.
+ *
+ * \ingroup API_BATCH
+ */
+int lightify_batch_get_count(struct lightify_batch *batch);
+
+/** Add a prebuilt telegram to the batch
+ *
+ * See lightify_request_telegram() for the supported telegrams. The telegram
+ * is copied.
+ *
+ * @param batch batch
+ * @param msg telegram
+ * @param size its size
+ * @return index of the command within the batch, negative on error.
+ *
+ * \ingroup API_BATCH
+ */
+int lightify_batch_add_telegram(struct lightify_batch *batch,
+		const unsigned char *msg, size_t size);
+
+/** Add switching on or off to the batch
+ *
+ * The command addresses either node or group; if both are NULL it is
+ * broadcasted to all nodes.
+ *
+ * @param batch batch
+ * @param node node or NULL
+ * @param group group or NULL
+ * @param onoff on or off
+ * @return index of the command within the batch, negative on error.
+ *
+ * \ingroup API_BATCH
+ */
+int lightify_batch_add_onoff(struct lightify_batch *batch,
+		struct lightify_node *node, struct lightify_group *group, int onoff);
+
+/** Add setting the brightness to the batch
+ *
+ * See lightify_batch_add_onoff() for the addressing.
+ *
+ * @param batch batch
+ * @param node node or NULL
+ * @param group group or NULL
+ * @param level brightness 0..100
+ * @param fadetime in 1/10 seconds
+ * @return index of the command within the batch, negative on error.
+ *
+ * \ingroup API_BATCH
+ */
+int lightify_batch_add_brightness(struct lightify_batch *batch,
+		struct lightify_node *node, struct lightify_group *group,
+		unsigned int level, unsigned int fadetime);
+
+/** Add setting the CCT to the batch
+ *
+ * See lightify_batch_add_onoff() for the addressing.
+ *
+ * @param batch batch
+ * @param node node or NULL
+ * @param group group or NULL
+ * @param cct colour temperature
+ * @param fadetime in 1/10 seconds
+ * @return index of the command within the batch, negative on error.
+ *
+ * \ingroup API_BATCH
+ */
+int lightify_batch_add_cct(struct lightify_batch *batch,
+		struct lightify_node *node, struct lightify_group *group,
+		unsigned int cct, unsigned int fadetime);
+
+/** Add setting the colour to the batch
+ *
+ * See lightify_batch_add_onoff() for the addressing.
+ *
+ * @param batch batch
+ * @param node node or NULL
+ * @param group group or NULL
+ * @param r red
+ * @param g green
+ * @param b blue
+ * @param w white
+ * @param fadetime in 1/10 seconds
+ * @return index of the command within the batch, negative on error.
+ *
+ * \ingroup API_BATCH
+ */
+int lightify_batch_add_rgbw(struct lightify_batch *batch,
+		struct lightify_node *node, struct lightify_group *group,
+		unsigned int r, unsigned int g, unsigned int b, unsigned int w,
+		unsigned int fadetime);
+
+/** Add a colour loop program to the batch
+ *
+ * See lightify_node_request_color_loop() for the program and
+ * lightify_batch_add_onoff() for the addressing.
+ *
+ * @param batch batch
+ * @param node node or NULL
+ * @param group group or NULL
+ * @param colorspec the program
+ * @param number_of_specs size of the program (must be 15)
+ * @param static_bytes NULL or 8 static bytes
+ * @return index of the command within the batch, negative on error.
+ *
+ * \ingroup API_BATCH
+ */
+int lightify_batch_add_color_loop(struct lightify_batch *batch,
+		struct lightify_node *node, struct lightify_group *group,
+		const struct lightify_color_loop_spec *colorspec,
+		unsigned int number_of_specs, const uint8_t static_bytes[8]);
+
+/** Add a CCT loop program to the batch
+ *
+ * See lightify_node_request_cct_loop() for the program and
+ * lightify_batch_add_onoff() for the addressing.
+ *
+ * @param batch batch
+ * @param node node or NULL
+ * @param group group or NULL
+ * @param cctspec the program
+ * @param number_of_specs size of the program (must be 15)
+ * @param static_bytes NULL or 8 static bytes
+ * @return index of the command within the batch, negative on error.
+ *
+ * \ingroup API_BATCH
+ */
+int lightify_batch_add_cct_loop(struct lightify_batch *batch,
+		struct lightify_node *node, struct lightify_group *group,
+		const struct lightify_cct_loop_spec *cctspec,
+		unsigned int number_of_specs, const uint8_t static_bytes[8]);
+
+/** Send all commands of the batch
+ *
+ * Returns when every command has been answered or failed. The results
+ * are available with lightify_batch_get_result().
+ *
+ * @param batch batch
+ * @return number of failed commands, negative on error.
+ *
+ * \ingroup API_BATCH
+ */
+int lightify_batch_run(struct lightify_batch *batch);
+
+/** Get the result of a command after lightify_batch_run()
+ *
+ * @param batch batch
+ * @param index as returned when adding the command
+ * @return 0 on success, negative error of the command; -EAGAIN if the
+ * batch has not been run yet.
+ *
+ * \ingroup API_BATCH
+ */
+int lightify_batch_get_result(struct lightify_batch *batch, unsigned int index);
+
+/** Get the time a command took from sending to its answer
+ *
+ * @param batch batch
+ * @param index as returned when adding the command
+ * @return microseconds, negative on error.
+ *
+ * \ingroup API_BATCH
+ */
+long lightify_batch_get_latency(struct lightify_batch *batch, unsigned int index);
+
+/** Desired state of a node, see lightify_reconcile()
+ *
+ * Only the attributes selected in fields are looked at.
+ *
+ * \ingroup API_RECONCILE
+ */
+struct lightify_desired_state {
+	uint64_t node_address; /**< MAC of the node */
+	unsigned int fields;   /**< LIGHTIFY_STATE_ONOFF, _BRIGHTNESS, _CCT and / or _RGBW */
+	int is_on;             /**< 0 off, else on */
+	int brightness;        /**< brightness 0..100 */
+	int cct;               /**< colour temperature */
+	int red;               /**< red */
+	int green;             /**< green */
+	int blue;              /**< blue */
+	int white;             /**< white */
+};
+
+/** Plan the telegrams to bring the nodes into the desired state
+ *
+ * The desired state is compared with the node cache. Only attributes which
+ * differ, are unknown or belong to a stale node are set. Where all nodes
+ * want the same, a broadcast is used; where all members of a group do, a
+ * group command; the remaining nodes get their own commands.
+ *
+ * Nodes not in desired are left alone, but prevent broadcasts and commands
+ * to their groups. A node should not want both a CCT and a colour.
+ *
+ * @param ctx library context
+ * @param desired array of desired states, at most one per node
+ * @param n number of elements in desired
+ * @param fadetime in 1/10 seconds, for brightness, CCT and colour
+ * @param batch the telegrams are appended to it
+ * @return number of telegrams added, negative on error: -ENOENT if a node
+ * is not in the cache, -EINVAL for invalid values or a node given twice. On
+ * errors the batch might already contain a part of the plan.
+ *
+ * \ingroup API_RECONCILE
+ *
+ * \sa lightify_reconcile
+ */
+int lightify_reconcile_plan(struct lightify_ctx *ctx,
+		const struct lightify_desired_state *desired, size_t n,
+		unsigned int fadetime, struct lightify_batch *batch);
+
+/** Bring the nodes into the desired state
+ *
+ * Plans the telegrams with lightify_reconcile_plan() and sends them as a
+ * pipelined batch. The node cache is updated as the answers arrive.
+ *
+ * @param ctx library context
+ * @param desired array of desired states, at most one per node
+ * @param n number of elements in desired
+ * @param fadetime in 1/10 seconds
+ * @return number of failed telegrams (0 if all succeeded or nothing needed
+ * to be sent), negative on error.
+ *
+ * \ingroup API_RECONCILE
+ */
+int lightify_reconcile(struct lightify_ctx *ctx,
+		const struct lightify_desired_state *desired, size_t n,
+		unsigned int fadetime);
+
+/** Opaque virtual group
+ *
+ * A named set of nodes kept by the library, with no limit on the number
+ * of groups or members. Commands to it are sent as one pipelined batch,
+ * using a broadcast or the gateway's groups where they match the set
+ * exactly and node commands for the rest.
+ *
+ * The members are identified by their MAC, so the group stays valid
+ * across scans. Members not in the node cache are skipped.
+ *
+ * \ingroup API_VGROUP
+ */
+struct lightify_vgroup;
+
+/** Create a new, empty virtual group
+ *
+ * @param ctx library context
+ * @param name name of the group, copied
+ * @param vgroup where to store the group
+ * @return 0 on success, negative on error.
+ *
+ * \ingroup API_VGROUP
+ */
+int lightify_vgroup_new(struct lightify_ctx *ctx, const char *name,
+		struct lightify_vgroup **vgroup);
+
+/** Free the virtual group
+ *
+ * @param vgroup to free
+ * @return 0 on success, negative on error.
+ *
+ * \ingroup API_VGROUP
+ */
+int lightify_vgroup_free(struct lightify_vgroup *vgroup);
+
+/** Get the name of the virtual group
+ *
+ * @param vgroup
+ * @return the name, NULL on error
+ *
+ * \ingroup API_VGROUP
+ */
+const char *lightify_vgroup_get_name(struct lightify_vgroup *vgroup);
+
+/** Add a node to the virtual group
+ *
+ * @param vgroup
+ * @param node_address MAC of the node; adding a member again is no error
+ * @return 0 on success, negative on error.
+ *
+ * \ingroup API_VGROUP
+ */
+int lightify_vgroup_add_node(struct lightify_vgroup *vgroup, uint64_t node_address);
+
+/** Remove a node from the virtual group
+ *
+ * @param vgroup
+ * @param node_address MAC of the node
+ * @return 0 on success, -ENOENT if it is no member, negative on error.
+ *
+ * \ingroup API_VGROUP
+ */
+int lightify_vgroup_remove_node(struct lightify_vgroup *vgroup, uint64_t node_address);
+
+/** Get the number of members, including those not in the node cache
+ *
+ * @param vgroup
+ * @return number of members, negative on error.
+ *
+ * \ingroup API_VGROUP
+ */
+int lightify_vgroup_get_member_count(struct lightify_vgroup *vgroup);
+
+/** Iterate over the members in the node cache
+ *
+ * @param vgroup
+ * @param lastnode NULL to get the first member
+ * @return next member, NULL if there are no more.
+ *
+ * \ingroup API_VGROUP
+ */
+struct lightify_node *lightify_vgroup_get_next_node(struct lightify_vgroup *vgroup,
+		struct lightify_node *lastnode);
+
+/** Request the virtual group to be turned off or on
+ *
+ * See lightify_group_request_onoff(). Failed nodes are marked stale.
+ *
+ * @param ctx context
+ * @param vgroup virtual group
+ * @param onoff on or off
+ * @return >=0 on success, negative on error; the first error if some
+ * telegrams failed.
+ *
+ * \ingroup API_VGROUP
+ */
+int lightify_vgroup_request_onoff(struct lightify_ctx *ctx,
+		struct lightify_vgroup *vgroup, int onoff);
+
+/** Set the CCT of the virtual group, see lightify_vgroup_request_onoff()
+ *
+ * @param ctx context
+ * @param vgroup virtual group
+ * @param cct CCT
+ * @param fadetime time in 1/10 secs
+ * @return >=0 on success. negative on error.
+ *
+ * \ingroup API_VGROUP
+ */
+int lightify_vgroup_request_cct(struct lightify_ctx *ctx,
+		struct lightify_vgroup *vgroup, unsigned int cct, unsigned int fadetime);
+
+/** Set the colour of the virtual group, see lightify_vgroup_request_onoff()
+ *
+ * @param ctx context
+ * @param vgroup virtual group
+ * @param r red
+ * @param g green
+ * @param b blue
+ * @param w white
+ * @param fadetime time in 1/10 secs
+ * @return >=0 on success. negative on error.
+ *
+ * \ingroup API_VGROUP
+ */
+int lightify_vgroup_request_rgbw(struct lightify_ctx *ctx,
+		struct lightify_vgroup *vgroup, unsigned int r, unsigned int g,
+		unsigned int b, unsigned int w, unsigned int fadetime);
+
+/** Set the brightness of the virtual group, see lightify_vgroup_request_onoff()
+ *
+ * @param ctx context
+ * @param vgroup virtual group
+ * @param level brightness
+ * @param fadetime time in 1/10 secs
+ * @return >=0 on success. negative on error.
+ *
+ * \ingroup API_VGROUP
+ */
+int lightify_vgroup_request_brightness(struct lightify_ctx *ctx,
+		struct lightify_vgroup *vgroup, unsigned int level, unsigned int fadetime);
+
 /** Request color loop
  *
  * Request the lamp to enter color loop mode.
@@ -796,7 +1857,7 @@ int lightify_group_request_brightness(struct lightify_ctx *ctx,
  * your own 8 bytes.
  *
  * @param ctx
- * @param node
+ * @param node node or NULL to broadcast the loop to all nodes
  * @param colorspec
  * @param number_of_specs how big is the loop. (Must be exactly 15 for the time being)
  * @param static_bytes 8-bytes to send as static bytes, instead of the hardcoded ones.
@@ -837,7 +1898,7 @@ int lightify_node_request_color_loop(struct lightify_ctx *ctx,
  * your own 8 bytes.
  *
  * @param ctx
- * @param node
+ * @param node node or NULL to broadcast the loop to all nodes
  * @param cctspecs
  * @param number_of_specs how big is the loop. (Must be exactly 15 for the time being)
  * @param static_bytes 8-bytes to send as static bytes, instead of the hardcoded ones.
@@ -861,6 +1922,175 @@ int lightify_node_request_cct_loop(struct lightify_ctx *ctx,
 		struct lightify_node *node, const struct lightify_cct_loop_spec* cctspec,
 		unsigned int number_of_specs, const uint8_t static_bytes[8]);
 
+/** Request color loop for a whole group
+ *
+ * Like lightify_node_request_color_loop(), but one telegram addresses all
+ * members of the group, so they start the loop in sync.
+ *
+ * @param ctx library context
+ * @param group group
+ * @param colorspec the program
+ * @param number_of_specs how big is the loop. (Must be exactly 15 for the time being)
+ * @param static_bytes 8-bytes to send as static bytes, or NULL
+ * @return negative on error, 0 on success.
+ *
+ * \ingroup API_GROUP
+ */
+int lightify_group_request_color_loop(struct lightify_ctx *ctx,
+		struct lightify_group *group,
+		const struct lightify_color_loop_spec* colorspec,
+		unsigned int number_of_specs, const uint8_t static_bytes[8]);
+
+/** Request cct loop for a whole group
+ *
+ * Like lightify_node_request_cct_loop(), but one telegram addresses all
+ * members of the group, so they start the loop in sync.
+ *
+ * @param ctx library context
+ * @param group group
+ * @param cctspec the program
+ * @param number_of_specs how big is the loop. (Must be exactly 15 for the time being)
+ * @param static_bytes 8-bytes to send as static bytes, or NULL
+ * @return negative on error, 0 on success.
+ *
+ * \ingroup API_GROUP
+ */
+int lightify_group_request_cct_loop(struct lightify_ctx *ctx,
+		struct lightify_group *group,
+		const struct lightify_cct_loop_spec* cctspec,
+		unsigned int number_of_specs, const uint8_t static_bytes[8]);
+
+/** Start recording the gateway session into a capture file
+ *
+ * Every chunk of data passing through the I/O callbacks (see
+ * lightify_set_socket_fn()) will be written to the file, together with
+ * a timestamp and the direction.
+ *
+ * The capture can be fed back later using lightify_replay_start(), for
+ * example to reproduce problems or to benchmark without a gateway.
+ *
+ * @param ctx library context
+ * @param filename file to record into. Will be overwritten if it exists.
+ * @return 0 on success, negative on error (e.g -EBUSY if a capture is already running)
+ *
+ * \ingroup API_CAPTURE
+ */
+int lightify_capture_start(struct lightify_ctx *ctx, const char *filename);
+
+/** Stop a running capture and close the capture file.
+ *
+ * @param ctx library context
+ * @return 0 on success, negative on error (-EBADF if there was no capture running)
+ *
+ * \ingroup API_CAPTURE
+ */
+int lightify_capture_stop(struct lightify_ctx *ctx);
+
+/** Replay a recorded session
+ *
+ * Installs a replay transport via lightify_set_socket_fn(), which will
+ * answer the library's requests with the recorded answers.
+ *
+ * The telegrams sent by the library are compared against the recorded ones,
+ * differences are logged. To get identical telegrams (the request tokens!)
+ * the session must be replayed on a fresh context with the same sequence of
+ * requests.
+ *
+ * @param ctx library context
+ * @param filename capture file, as written by lightify_capture_start()
+ * @param realtime if non-zero, answers are delayed to match the recorded timing,
+ *    otherwise the replay runs at maximum speed.
+ * @return 0 on success, negative on error (-EPROTO if the file is no capture)
+ *
+ * \ingroup API_CAPTURE
+ */
+int lightify_replay_start(struct lightify_ctx *ctx, const char *filename, int realtime);
+
+/** Stop the replay and reinstate the default I/O functions
+ *
+ * @param ctx library context
+ * @return 0 on success, negative on error
+ *
+ * \ingroup API_CAPTURE
+ */
+int lightify_replay_stop(struct lightify_ctx *ctx);
+
+/** Colour of a black body with the given colour temperature
+ *
+ * Uses a table in 100K steps between 1000K and 12000K and interpolates
+ * linearly; temperatures outside are clamped. The white component is 0.
+ *
+ * @param cct colour temperature in Kelvin
+ * @param out where to store the colour
+ * @return 0 on success, negative on error
+ *
+ * \ingroup API_COLOR
+ */
+int lightify_color_cct_to_rgbw(unsigned int cct, struct lightify_rgbw *out);
+
+/** Convert a HSV colour to RGBW
+ *
+ * The desaturated part of the colour is put on the white channel.
+ *
+ * @param in colour to convert
+ * @param out where to store the colour
+ * @return 0 on success, negative on error
+ *
+ * \ingroup API_COLOR
+ */
+int lightify_color_hsv_to_rgbw(const struct lightify_hsv *in, struct lightify_rgbw *out);
+
+/** Gamma correction
+ *
+ * Maps a perceived level to the linear output level (gamma 2.2), so that
+ * ramps of the input look even.
+ *
+ * @param level perceived level, 0..255
+ * @return linear level, 0..255
+ *
+ * \ingroup API_COLOR
+ */
+uint8_t lightify_color_gamma(uint8_t level);
+
+/** Convert an array of colour temperatures, e.g. a frame of an animation
+ *
+ * See lightify_color_cct_to_rgbw()
+ *
+ * @param cct n colour temperatures in Kelvin
+ * @param out n colours
+ * @param n number of elements
+ * @return 0 on success, negative on error
+ *
+ * \ingroup API_COLOR
+ */
+int lightify_color_cct_to_rgbw_n(const uint16_t *cct, struct lightify_rgbw *out, size_t n);
+
+/** Convert an array of HSV colours, e.g. a frame of an animation
+ *
+ * See lightify_color_hsv_to_rgbw()
+ *
+ * @param in n colours to convert
+ * @param out n colours
+ * @param n number of elements
+ * @return 0 on success, negative on error
+ *
+ * \ingroup API_COLOR
+ */
+int lightify_color_hsv_to_rgbw_n(const struct lightify_hsv *in,
+		struct lightify_rgbw *out, size_t n);
+
+/** Gamma correct an array of levels
+ *
+ * See lightify_color_gamma(). in and out may be the same array.
+ *
+ * @param in n perceived levels
+ * @param out n linear levels
+ * @param n number of elements
+ * @return 0 on success, negative on error
+ *
+ * \ingroup API_COLOR
+ */
+int lightify_color_gamma_n(const uint8_t *in, uint8_t *out, size_t n);
 
 #ifdef __cplusplus
 } /* extern "C" */
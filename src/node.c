@@ -30,6 +30,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "liblightify-private.h"
 #include "node.h"
 #include "context.h"
+#include "groups.h"
 
 #include <stdint.h>
 #include <stdlib.h>
@@ -38,82 +39,157 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #define MAX_NODE_NANE_LEN (16)
 
-/** Information about the nodes (e.g. lamps)
- * kind of cache, will reflet state when last queried. */
+/** Node state store, one array per field ("structure of arrays").
+ *
+ * Scans over a field of all nodes, e.g. which nodes are on, touch one small
+ * contiguous array. The values are stored as compact as their range
+ * allows; -1 still means "unknown". Entry i belongs to ctx->nodes[i]. */
+#define NODE_STORE_FIELDS \
+	NODE_STORE_FIELD(uint64_t, node_address)  /**< MAC of node */ \
+	NODE_STORE_FIELD(uint16_t, zone_address)  /**< Zone address (16 bit short ZLL address)*/ \
+	NODE_STORE_FIELD(uint16_t, group_address) /**< Group address */ \
+	NODE_STORE_FIELD(uint16_t, node_type)     /**< enum lightify_node_type */ \
+	NODE_STORE_FIELD(uint32_t, fwversion)     /**< mayor.minor.maint.build */ \
+	NODE_STORE_FIELD(int32_t, cct)            /**< CCT */ \
+	NODE_STORE_FIELD(int16_t, red)            /**< red value */ \
+	NODE_STORE_FIELD(int16_t, green)          /**< green value */ \
+	NODE_STORE_FIELD(int16_t, blue)           /**< blue value */ \
+	NODE_STORE_FIELD(int16_t, white)          /**< white value */ \
+	NODE_STORE_FIELD(int16_t, brightness)     /**< brightness */ \
+	NODE_STORE_FIELD(int8_t, is_on)           /**< 0=off, 1=on, -1=unknown */ \
+	NODE_STORE_FIELD(int8_t, online_status)   /**< enum lightify_node_online_state */ \
+	NODE_STORE_FIELD(int8_t, is_stale)        /**< 1 if not updated by the last command */ \
+	NODE_STORE_FIELD(uint8_t, dirty)          /**< changed since the last snapshot */
+
+struct lightify_node_store {
+#define NODE_STORE_FIELD(type, field) type *field;
+	NODE_STORE_FIELDS
+#undef NODE_STORE_FIELD
+};
+
+/** Access a node's field in the store */
+#define NODE_FIELD(node, field) ((node)->ctx->nodestore->field[(node)->idx])
+
+/** Set a cached value which is not part of the group aggregates */
+#define NODE_SET(node, field, value) do { \
+		if (NODE_FIELD(node, field) == (value)) break; \
+		NODE_FIELD(node, field) = (value); \
+		NODE_FIELD(node, dirty) = 1; \
+	} while (0)
+
+/** Update a cached value, keeping the group aggregates in sync.
+ * The node is taken out of its groups' aggregates, changed and put back. */
+#define NODE_UPDATE(node, field, value) do { \
+		if (NODE_FIELD(node, field) == (value)) break; \
+		lightify_groups_node_account((node)->ctx, (node), -1); \
+		NODE_FIELD(node, field) = (value); \
+		NODE_FIELD(node, dirty) = 1; \
+		lightify_groups_node_account((node)->ctx, (node), 1); \
+	} while (0)
+
+/** A node as handed out by the API. The state lives in the context's
+ * store, the handle only knows where. */
 struct lightify_node {
 
 	/** pointer to the context */
 	struct lightify_ctx *ctx;
 
-	/* linked list */
-	struct lightify_node *next;
-	struct lightify_node *prev;
+	/** position in ctx->nodes and the store */
+	size_t idx;
 
-	/* node address and groups */
-	uint64_t node_address;  /**< MAC of node */
-	uint16_t zone_address;	/**< Zone address (16 bit short ZLL address)*/
-	uint16_t group_address;	/**< Group address */
+	/** 16 bytes max, NUL terminated */
+	char name[MAX_NODE_NANE_LEN + 1];
+	int has_name;
+};
 
-	/** lamp type */
-	enum lightify_node_type node_type;
+int lightify_nodes_reserve(struct lightify_ctx *ctx, size_t count) {
+	struct lightify_node **tab;
+	struct lightify_node_store *store;
+	size_t cap;
 
-	/** name -- 16 bytes max, but we'll allocate memory for it. */
-	char *name;
+	if (!ctx) return -EINVAL;
+	if (count <= ctx->nodes_cap) return 0;
 
-	int red; 	/**< red value */
-	int green; 	/**< green value */
-	int blue; 	/**< blue value */
-	int white; 	/**< white value */
-	int cct; 	/**< CCT */
+	if (!ctx->nodestore) {
+		ctx->nodestore = calloc(1, sizeof(*ctx->nodestore));
+		if (!ctx->nodestore) return -ENOMEM;
+	}
+	store = ctx->nodestore;
 
-	int brightness; /**< brightness */
+	cap = ctx->nodes_cap ? ctx->nodes_cap : 16;
+	while (cap < count) cap *= 2;
 
-	int is_on; /**< lamp on/off status. (0=off, 1=on, -1=unknown) */
-	enum lightify_node_online_state online_status;
+	/* on failure the arrays grown so far just stay bigger than needed */
+#define NODE_STORE_FIELD(type, field) { \
+		type *t = realloc(store->field, cap * sizeof(type)); \
+		if (!t) return -ENOMEM; \
+		store->field = t; \
+	}
+	NODE_STORE_FIELDS
+#undef NODE_STORE_FIELD
 
-	/** what we  believe is the firmware version
-	 * stuffed into one long -- 4 bytes: mayor.minor.maint.build */
-	uint32_t fwversion;
+	tab = realloc(ctx->nodes, cap * sizeof(*tab));
+	if (!tab) return -ENOMEM;
+	ctx->nodes = tab;
+	ctx->nodes_cap = cap;
+	return 0;
+}
 
-	/** do we have confidence in the node status?
-	 * Set to 1 if we did not get updated information on this node or a command
-	 */
-	int is_stale;
-};
+void lightify_nodes_release(struct lightify_ctx *ctx) {
+	struct lightify_node_store *store;
+
+	if (!ctx) return;
+	store = ctx->nodestore;
+	if (store) {
+#define NODE_STORE_FIELD(type, field) free(store->field);
+		NODE_STORE_FIELDS
+#undef NODE_STORE_FIELD
+		free(store);
+	}
+	free(ctx->nodes);
+	ctx->nodestore = NULL;
+	ctx->nodes = NULL;
+	ctx->nodes_cap = 0;
+}
 
 int lightify_node_new(struct lightify_ctx *ctx, struct lightify_node** newnode) {
 
 	struct lightify_node *n;
-	struct lightify_node *m;
+	struct lightify_node_store *store;
+	size_t idx;
+	int err;
 
 	if (!ctx) return -EINVAL;
 
+	err = lightify_nodes_reserve(ctx, ctx->nodes_count + 1);
+	if (err < 0) return err;
+
 	n = calloc(1,sizeof(struct lightify_node));
 
 	if (!n) return -ENOMEM;
 
 	*newnode = n;
 
-	n->red = -1;
-	n->green = -1;
-	n->blue = -1;
-	n->white = -1;
-	n->cct = -1;
-	n->brightness = -1;
-	n->is_on = -1;
-	n->online_status = -1;
+	store = ctx->nodestore;
+	idx = ctx->nodes_count;
 
-	n->ctx = ctx;
-	m = ctx->nodes;
+#define NODE_STORE_FIELD(type, field) store->field[idx] = 0;
+	NODE_STORE_FIELDS
+#undef NODE_STORE_FIELD
 
-	if (!m) {
-		ctx->nodes = n;
-		return 0;
-	}
+	store->red[idx] = -1;
+	store->green[idx] = -1;
+	store->blue[idx] = -1;
+	store->white[idx] = -1;
+	store->cct[idx] = -1;
+	store->brightness[idx] = -1;
+	store->is_on[idx] = -1;
+	store->online_status[idx] = -1;
+	store->dirty[idx] = 1;
 
-	while(m->next) m=m->next;
-	n->prev = m;
-	m->next = n;
+	n->ctx = ctx;
+	n->idx = idx;
+	ctx->nodes[ctx->nodes_count++] = n;
 
 	return 0;
 }
@@ -122,206 +198,303 @@ int lightify_node_remove(struct lightify_node* node) {
 
 	if (!node) return -EINVAL;
 
-	struct lightify_node *next = node->next;
-	struct lightify_node *prev = node->prev;
-
-	if (prev) {
-		prev->next = next;
-	} else {
-		// first node
-		node->ctx->nodes=next;
+	lightify_groups_node_account(node->ctx, node, -1);
+
+	struct lightify_ctx *ctx = node->ctx;
+	struct lightify_node_store *store = ctx->nodestore;
+	size_t i;
+
+	/* close the gap, keeping the order */
+	ctx->nodes_count--;
+	for (i = node->idx; i < ctx->nodes_count; i++) {
+		ctx->nodes[i] = ctx->nodes[i + 1];
+		ctx->nodes[i]->idx = i;
+#define NODE_STORE_FIELD(type, field) store->field[i] = store->field[i + 1];
+		NODE_STORE_FIELDS
+#undef NODE_STORE_FIELD
+		store->dirty[i] = 1;
 	}
 
-	if (next) next->prev = prev;
-
-	if (node->name) free(node->name);
-
 	free(node);
 
 	return 0;
 }
 
 struct lightify_node* lightify_node_get_nextnode(struct lightify_node *node) {
-	if (!node) return NULL;
-	return node->next;
+	if (!node || node->idx + 1 >= node->ctx->nodes_count) return NULL;
+	return node->ctx->nodes[node->idx + 1];
 }
 
 struct lightify_node* lightify_node_get_prevnode(struct lightify_node *node) {
-	if (!node) return NULL;
-	return node->prev;
+	if (!node || !node->idx) return NULL;
+	return node->ctx->nodes[node->idx - 1];
 }
 
 
 int lightify_node_set_name(struct lightify_node* node, char *name) {
 	if (!node) return -EINVAL;
 
-	if (node->name) free(node->name);
-	node->name = NULL;
-
-	if(name) {
-		node->name = strndup(name, MAX_NODE_NANE_LEN);
-		if (!node->name) return -ENOMEM;
+	NODE_FIELD(node, dirty) = 1;
+	node->has_name = (name != NULL);
+	if (name) {
+		strncpy(node->name, name, MAX_NODE_NANE_LEN);
+		node->name[MAX_NODE_NANE_LEN] = '\0';
 	}
 	return 0;
 }
 
 LIGHTIFY_EXPORT const char* lightify_node_get_name(struct lightify_node* node) {
-	if (!node) return NULL;
+	if (!node || !node->has_name) return NULL;
 	return node->name;
 }
 
 int lightify_node_set_nodeadr(struct lightify_node* node, uint64_t adr) {
 	if(!node) return -EINVAL;
-	node->node_address=adr;
+	NODE_SET(node, node_address, adr);
 	return 0;
 }
 
 LIGHTIFY_EXPORT uint64_t lightify_node_get_nodeadr(struct lightify_node* node) {
 	if (!node) return 0;
-	return node->node_address;
+	return NODE_FIELD(node, node_address);
 }
 
 int lightify_node_set_zoneadr(struct lightify_node* node, uint16_t adr) {
 	if(!node) return -EINVAL;
-	node->zone_address=adr;
+	NODE_SET(node, zone_address, adr);
 	return 0;
 }
 
 LIGHTIFY_EXPORT uint16_t lightify_node_get_zoneadr(struct lightify_node* node) {
 	if (!node) return 0;
-	return node->zone_address;
+	return NODE_FIELD(node, zone_address);
 }
 
 int lightify_node_set_grpadr(struct lightify_node* node, uint16_t adr) {
 	if(!node) return -EINVAL;
-	node->group_address=adr;
+	NODE_UPDATE(node, group_address, adr);
 	return 0;
 }
 
 LIGHTIFY_EXPORT uint16_t lightify_node_get_grpadr(struct lightify_node* node) {
 	if (!node) return 0;
-	return node->group_address;
+	return NODE_FIELD(node, group_address);
 }
 
 int lightify_node_set_lamptype(struct lightify_node* node, enum lightify_node_type type) {
 	if(!node) return -EINVAL;
-	node->node_type = type;
+	NODE_SET(node, node_type, type);
 	return 0;
 }
 
 LIGHTIFY_EXPORT enum lightify_node_type lightify_node_get_lamptype(struct lightify_node* node) {
 	if(!node) return -EINVAL;
-	return node->node_type;
+	return NODE_FIELD(node, node_type);
 }
 
 int lightify_node_set_red(struct lightify_node* node, int red) {
 	if(!node) return -EINVAL;
-	node->red = red;
+	NODE_UPDATE(node, red, red);
 	return 0;
 }
 
 LIGHTIFY_EXPORT int lightify_node_get_red(struct lightify_node* node) {
 	if(!node) return -EINVAL;
-	return node->red;
+	return NODE_FIELD(node, red);
 }
 
 int lightify_node_set_blue(struct lightify_node* node, int blue) {
 	if(!node) return -EINVAL;
-	node->blue = blue;
+	NODE_UPDATE(node, blue, blue);
 	return 0;
 }
 
 LIGHTIFY_EXPORT int lightify_node_get_blue(struct lightify_node* node) {
 	if(!node) return -EINVAL;
-	return node->blue;
+	return NODE_FIELD(node, blue);
 }
 
 int lightify_node_set_green(struct lightify_node* node, int green) {
 	if(!node) return -EINVAL;
-	node->green = green;
+	NODE_UPDATE(node, green, green);
 	return 0;
 }
 
 LIGHTIFY_EXPORT int lightify_node_get_green(struct lightify_node* node) {
 	if(!node) return -EINVAL;
-	return node->green;
+	return NODE_FIELD(node, green);
 }
 
 int lightify_node_set_white(struct lightify_node* node, int white) {
 	if(!node) return -EINVAL;
-	node->white = white;
+	NODE_UPDATE(node, white, white);
 	return 0;
 }
 
 LIGHTIFY_EXPORT int lightify_node_get_white(struct lightify_node* node) {
 	if(!node) return -EINVAL;
-	return node->white;
+	return NODE_FIELD(node, white);
 }
 
 int lightify_node_set_cct(struct lightify_node* node, int cct) {
 	if(!node) return -EINVAL;
-	node->cct = cct;
+	NODE_UPDATE(node, cct, cct);
 	return 0;
 }
 
 LIGHTIFY_EXPORT int lightify_node_get_cct(struct lightify_node* node) {
 	if(!node) return -EINVAL;
-	return node->cct;
+	return NODE_FIELD(node, cct);
 }
 
 int lightify_node_set_brightness(struct lightify_node* node, int brightness) {
 	if(!node) return -EINVAL;
-	node->brightness = brightness;
+	NODE_UPDATE(node, brightness, brightness);
 	return 0;
 }
 
 LIGHTIFY_EXPORT int lightify_node_get_brightness(struct lightify_node* node) {
 	if(!node) return -EINVAL;
-	return node->brightness;
+	return NODE_FIELD(node, brightness);
 }
 
 
 int lightify_node_set_onoff(struct lightify_node* node, uint8_t on) {
 	if (!node) return -EINVAL;
-	node->is_on= on;
+	NODE_UPDATE(node, is_on, on);
 	return 0;
 }
 
 LIGHTIFY_EXPORT int lightify_node_is_on(struct lightify_node* node) {
 	if(!node) return -EINVAL;
-	return node->is_on;
+	return NODE_FIELD(node, is_on);
 }
 
 int lightify_node_set_online_status(struct lightify_node* node, uint8_t state) {
 	if (!node) return -EINVAL;
-	node->online_status= state;
+	NODE_UPDATE(node, online_status, state);
 	return 0;
 }
 
 LIGHTIFY_EXPORT int lightify_node_get_onlinestate(struct lightify_node* node) {
 	if(!node) return -EINVAL;
-	return node->online_status;
+	return NODE_FIELD(node, online_status);
 }
 
 LIGHTIFY_EXPORT int lightify_node_is_stale(struct lightify_node *node) {
 	if(!node) return -EINVAL;
-	return node->is_stale;
+	return NODE_FIELD(node, is_stale);
 }
 
 int lightify_node_set_stale(struct lightify_node *node, int stale) {
 	if(!node) return -EINVAL;
-	node->is_stale = stale;
+	NODE_UPDATE(node, is_stale, stale);
 	return 0;
 }
 
 LIGHTIFY_EXPORT uint32_t lightify_node_get_fwversion(struct lightify_node *node) {
 	if(!node) return 0;
-	return node->fwversion;
+	return NODE_FIELD(node, fwversion);
 }
 
 int lightify_node_set_fwversion(struct lightify_node *node, uint8_t mayor, uint8_t minor, uint8_t maint, uint8_t build) {
 	if(!node) return -EINVAL;
 	uint32_t version = mayor << 24U | minor << 16U | maint << 8U | build;
-	node->fwversion = version;
+	NODE_SET(node, fwversion, version);
 	return 0;
 }
+
+LIGHTIFY_EXPORT int lightify_nodes_export_masked(struct lightify_ctx *ctx,
+		struct lightify_node_state *out, size_t cap, unsigned int mask) {
+	const struct lightify_node_store *store;
+	size_t i, n;
+
+	if (!ctx || (cap && !out)) return -EINVAL;
+
+	n = ctx->nodes_count < cap ? ctx->nodes_count : cap;
+	store = ctx->nodestore;
+
+	/* field by field, each a linear walk through one array of the store */
+	if (mask & LIGHTIFY_STATE_ADDRESS) {
+		for (i = 0; i < n; i++) out[i].node_address = store->node_address[i];
+		for (i = 0; i < n; i++) out[i].zone_address = store->zone_address[i];
+		for (i = 0; i < n; i++) out[i].group_address = store->group_address[i];
+	}
+	if (mask & LIGHTIFY_STATE_NAME) {
+		for (i = 0; i < n; i++) {
+			memcpy(out[i].name, ctx->nodes[i]->name, sizeof(out[i].name));
+			if (!ctx->nodes[i]->has_name) out[i].name[0] = '\0';
+		}
+	}
+	if (mask & LIGHTIFY_STATE_TYPE) {
+		for (i = 0; i < n; i++) out[i].node_type = store->node_type[i];
+		for (i = 0; i < n; i++) out[i].fwversion = store->fwversion[i];
+	}
+	if (mask & LIGHTIFY_STATE_ONLINE) {
+		for (i = 0; i < n; i++) out[i].online_state = store->online_status[i];
+		for (i = 0; i < n; i++) out[i].is_stale = store->is_stale[i];
+	}
+	if (mask & LIGHTIFY_STATE_ONOFF) {
+		for (i = 0; i < n; i++) out[i].is_on = store->is_on[i];
+	}
+	if (mask & LIGHTIFY_STATE_BRIGHTNESS) {
+		for (i = 0; i < n; i++) out[i].brightness = store->brightness[i];
+	}
+	if (mask & LIGHTIFY_STATE_CCT) {
+		for (i = 0; i < n; i++) out[i].cct = store->cct[i];
+	}
+	if (mask & LIGHTIFY_STATE_RGBW) {
+		for (i = 0; i < n; i++) out[i].red = store->red[i];
+		for (i = 0; i < n; i++) out[i].green = store->green[i];
+		for (i = 0; i < n; i++) out[i].blue = store->blue[i];
+		for (i = 0; i < n; i++) out[i].white = store->white[i];
+	}
+
+	return ctx->nodes_count;
+}
+
+LIGHTIFY_EXPORT int lightify_nodes_export(struct lightify_ctx *ctx,
+		struct lightify_node_state *out, size_t cap) {
+	return lightify_nodes_export_masked(ctx, out, cap, LIGHTIFY_STATE_ALL);
+}
+
+/* the whole state of node i */
+static void node_export_one(const struct lightify_ctx *ctx, size_t i,
+		struct lightify_node_state *st) {
+	const struct lightify_node_store *store = ctx->nodestore;
+
+	st->node_address = store->node_address[i];
+	st->zone_address = store->zone_address[i];
+	st->group_address = store->group_address[i];
+	st->fwversion = store->fwversion[i];
+	st->node_type = store->node_type[i];
+	st->online_state = store->online_status[i];
+	st->is_stale = store->is_stale[i];
+	st->is_on = store->is_on[i];
+	st->brightness = store->brightness[i];
+	st->cct = store->cct[i];
+	st->red = store->red[i];
+	st->green = store->green[i];
+	st->blue = store->blue[i];
+	st->white = store->white[i];
+	memcpy(st->name, ctx->nodes[i]->name, sizeof(st->name));
+	if (!ctx->nodes[i]->has_name) st->name[0] = '\0';
+}
+
+int lightify_nodes_export_dirty(struct lightify_ctx *ctx,
+		struct lightify_node_state *out, int all) {
+	struct lightify_node_store *store;
+	size_t i;
+	int n = 0;
+
+	if (!ctx || (ctx->nodes_count && !out)) return -EINVAL;
+	store = ctx->nodestore;
+
+	for (i = 0; i < ctx->nodes_count; i++) {
+		if (!all && !store->dirty[i]) continue;
+		node_export_one(ctx, i, &out[i]);
+		store->dirty[i] = 0;
+		n++;
+	}
+	return n;
+}
@@ -43,12 +43,41 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #endif
 
 #include <stdint.h>
+#include <stdlib.h>
 
 struct lightify_node;
+struct lightify_node_state;
 
 // IMPORTANT NOTE //
 // THIS API WILL ONLY MODIFY THE CACHED DATA -- They do NOT query the actual hardware.
 
+/** Make room for count nodes, so that adding them needs no reallocation
+ *
+ * @param ctx
+ * @param count total number of nodes expected
+ * @return 0 on success, <0 on errors, like ENOMEM, EINVAL
+ */
+int lightify_nodes_reserve(struct lightify_ctx *ctx, size_t count);
+
+/** Free the node storage of the context. All nodes must have been removed.
+ *
+ * @param ctx
+ */
+void lightify_nodes_release(struct lightify_ctx *ctx);
+
+/** Export the state of the nodes changed since the last call
+ *
+ * Nodes whose cached state did not change are not written, so out can be
+ * a copy of the previous export.
+ *
+ * @param ctx
+ * @param out ctx->nodes_count elements
+ * @param all export all nodes, changed or not
+ * @return number of nodes exported, <0 on errors
+ */
+int lightify_nodes_export_dirty(struct lightify_ctx *ctx,
+		struct lightify_node_state *out, int all);
+
 /** Create new node entry and attach it to the ctx
  *
  * @param ctx
@@ -65,14 +94,14 @@ int lightify_node_new(struct lightify_ctx *ctx, struct lightify_node** newnode);
 int lightify_node_remove(struct lightify_node* node);
 
 
-/** Get the next node in the linked list
+/** Get the next node in the context
  *
  * @param node
  * @return next node or NULL
  */
 struct lightify_node* lightify_node_get_nextnode(struct lightify_node *node);
 
-/** Get the previous node in the linked list
+/** Get the previous node in the context
  *
  * @param node
  * @return next node or NULL
@@ -0,0 +1,60 @@
+/*
+  liblightify -- library to control OSRAM's LIGHTIFY
+
+Copyright (c) 2015, Tobias Frost <tobi@coldtobi.de>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * \file protocol.h
+ *
+ * Definitions of the gateway protocol shared between the modules.
+ */
+
+#ifndef SRC_PROTOCOL_H_
+#define SRC_PROTOCOL_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/** Layout of the header common to all telegrams and answers.
+ *
+ * The length field does not count itself, so the total size of a
+ * telegram is the length field + 2.
+ */
+enum msg_header {
+	HEADER_LEN_LSB,
+	HEADER_LEN_MSB,
+	HEADER_FLAGS,
+	HEADER_CMD,
+	HEADER_REQ_ID_B0,
+	HEADER_REQ_ID_B1,
+	HEADER_REQ_ID_B2,
+	HEADER_REQ_ID_B3,
+	HEADER_PAYLOAD_START
+};
+
+#endif /* SRC_PROTOCOL_H_ */
@@ -0,0 +1,338 @@
+/*
+  liblightify -- library to control OSRAM's LIGHTIFY
+
+Copyright (c) 2015, Tobias Frost <tobi@coldtobi.de>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/** \file reconcile.c
+ *
+ * Bringing the nodes into a desired state with as few telegrams as possible.
+ *
+ * Every attribute (CCT, colour, brightness, on/off) is planned on its own,
+ * as each needs its own telegram anyway. Only nodes whose cached value
+ * differs (or is unknown or stale) need a command. Those are covered by
+ *
+ * - one broadcast, if every known node wants the same value,
+ * - else group commands, if all members of a group want the same value.
+ *   The group reaching most of the remaining nodes is picked first; a group
+ *   only pays off if it replaces at least two node commands.
+ * - and node commands for the rest.
+ *
+ * Two groups wanting different values cannot share a node, so the order
+ * the groups are picked in never matters for correctness.
+ *
+ * Brightness is planned before on/off, as setting a level switches the
+ * node on (or off, for level 0); the planner predicts that, so no extra
+ * on/off telegram is needed in that case.
+ */
+
+#include "liblightify-private.h"
+#include "context.h"
+#include "log.h"
+#include "reconcile.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RECONCILE_FIELDS (LIGHTIFY_STATE_ONOFF | LIGHTIFY_STATE_BRIGHTNESS | \
+		LIGHTIFY_STATE_CCT | LIGHTIFY_STATE_RGBW)
+
+/* the attributes in the order their commands are sent */
+static const unsigned int reconcile_order[] = {
+	LIGHTIFY_STATE_CCT,
+	LIGHTIFY_STATE_RGBW,
+	LIGHTIFY_STATE_BRIGHTNESS,
+	LIGHTIFY_STATE_ONOFF,
+};
+
+struct reconcile_plan {
+	struct lightify_ctx *ctx;
+	struct lightify_batch *batch;
+	unsigned int fadetime;
+	size_t count;
+	/** predicted state after the commands planned so far */
+	struct lightify_node_state *state;
+	/** desired state per node, NULL if the node is not mentioned */
+	const struct lightify_desired_state **want;
+	/** per node: still needs a command for the current attribute */
+	unsigned char *need;
+	/** send even if the cache says the value is already set */
+	int force;
+};
+
+/* The value of an attribute as one comparable key, negative if unknown */
+static int64_t state_key(const struct lightify_node_state *st, unsigned int field) {
+	switch (field) {
+	case LIGHTIFY_STATE_ONOFF: return st->is_on;
+	case LIGHTIFY_STATE_BRIGHTNESS: return st->brightness;
+	case LIGHTIFY_STATE_CCT: return st->cct;
+	case LIGHTIFY_STATE_RGBW:
+		if (st->red < 0 || st->green < 0 || st->blue < 0 || st->white < 0) return -1;
+		return st->red | st->green << 8 | st->blue << 16 | (int64_t) st->white << 24;
+	}
+	return -1;
+}
+
+static int64_t desired_key(const struct lightify_desired_state *d, unsigned int field) {
+	switch (field) {
+	case LIGHTIFY_STATE_ONOFF: return d->is_on != 0;
+	case LIGHTIFY_STATE_BRIGHTNESS: return d->brightness;
+	case LIGHTIFY_STATE_CCT: return d->cct;
+	case LIGHTIFY_STATE_RGBW:
+		return d->red | d->green << 8 | d->blue << 16 | (int64_t) d->white << 24;
+	}
+	return -1;
+}
+
+/* Predict the cache of node i after the command has been answered */
+static void predict(struct reconcile_plan *p, size_t i, const struct lightify_desired_state *d,
+		unsigned int field) {
+	struct lightify_node_state *st = &p->state[i];
+
+	switch (field) {
+	case LIGHTIFY_STATE_ONOFF:
+		st->is_on = d->is_on != 0;
+		break;
+	case LIGHTIFY_STATE_BRIGHTNESS:
+		st->brightness = d->brightness;
+		st->is_on = d->brightness != 0;
+		break;
+	case LIGHTIFY_STATE_CCT:
+		st->cct = d->cct;
+		break;
+	case LIGHTIFY_STATE_RGBW:
+		st->red = d->red;
+		st->green = d->green;
+		st->blue = d->blue;
+		st->white = d->white;
+		break;
+	}
+	p->need[i] = 0;
+}
+
+/* Add the command for the node, the group or -- if both are NULL -- all nodes */
+static int emit(struct reconcile_plan *p, struct lightify_node *node,
+		struct lightify_group *group, const struct lightify_desired_state *d,
+		unsigned int field) {
+	int n = -EINVAL;
+
+	switch (field) {
+	case LIGHTIFY_STATE_ONOFF:
+		n = lightify_batch_add_onoff(p->batch, node, group, d->is_on);
+		break;
+	case LIGHTIFY_STATE_BRIGHTNESS:
+		n = lightify_batch_add_brightness(p->batch, node, group, d->brightness, p->fadetime);
+		break;
+	case LIGHTIFY_STATE_CCT:
+		n = lightify_batch_add_cct(p->batch, node, group, d->cct, p->fadetime);
+		break;
+	case LIGHTIFY_STATE_RGBW:
+		n = lightify_batch_add_rgbw(p->batch, node, group, d->red, d->green,
+				d->blue, d->white, p->fadetime);
+		break;
+	}
+	if (n < 0) return n;
+	p->count++;
+	return 0;
+}
+
+static uint16_t group_bit(struct lightify_group *grp) {
+	int id = lightify_group_get_id(grp);
+	return (id >= 1 && id <= 16) ? 1U << (id - 1) : 0;
+}
+
+/* If all members want the same value for field, return one of them, else
+ * NULL. *needing is the number of members still needing a command. */
+static const struct lightify_desired_state *group_target(struct reconcile_plan *p,
+		uint16_t mask, unsigned int field, size_t *needing) {
+	const struct lightify_desired_state *d = NULL;
+	size_t i;
+
+	*needing = 0;
+	if (!mask) return NULL;
+	for (i = 0; i < p->ctx->nodes_count; i++) {
+		if (!(p->state[i].group_address & mask)) continue;
+		if (!p->want[i] || !(p->want[i]->fields & field)) return NULL;
+		if (d && desired_key(d, field) != desired_key(p->want[i], field)) return NULL;
+		d = p->want[i];
+		*needing += p->need[i];
+	}
+	return d;
+}
+
+static int plan_field(struct reconcile_plan *p, unsigned int field) {
+	struct lightify_ctx *ctx = p->ctx;
+	const struct lightify_desired_state *d;
+	size_t i, needing, best_needing;
+	struct lightify_group *best;
+	int n;
+
+	needing = 0;
+	for (i = 0; i < ctx->nodes_count; i++) {
+		p->need[i] = 0;
+		if (!p->want[i] || !(p->want[i]->fields & field)) continue;
+		p->need[i] = p->force || p->state[i].is_stale || state_key(&p->state[i], field) < 0 ||
+				state_key(&p->state[i], field) != desired_key(p->want[i], field);
+		needing += p->need[i];
+	}
+	if (!needing) return 0;
+
+	/* broadcast, if everyone wants the same */
+	d = p->want[0];
+	for (i = 0; d && i < ctx->nodes_count; i++) {
+		if (!p->want[i] || !(p->want[i]->fields & field) ||
+				desired_key(d, field) != desired_key(p->want[i], field)) d = NULL;
+	}
+	if (d && needing >= 2) {
+		n = emit(p, NULL, NULL, d, field);
+		if (n < 0) return n;
+		for (i = 0; i < ctx->nodes_count; i++) predict(p, i, d, field);
+		return 0;
+	}
+
+	/* groups, greedy */
+	for (;;) {
+		const struct lightify_desired_state *best_d = NULL;
+		best = NULL;
+		best_needing = 1;
+		for (i = 0; i < ctx->groups_count; i++) {
+			d = group_target(p, group_bit(ctx->groups[i]), field, &needing);
+			if (d && needing > best_needing) {
+				best = ctx->groups[i];
+				best_d = d;
+				best_needing = needing;
+			}
+		}
+		if (!best) break;
+
+		n = emit(p, NULL, best, best_d, field);
+		if (n < 0) return n;
+		for (i = 0; i < ctx->nodes_count; i++) {
+			if (p->state[i].group_address & group_bit(best)) predict(p, i, best_d, field);
+		}
+	}
+
+	/* the rest one by one */
+	for (i = 0; i < ctx->nodes_count; i++) {
+		if (!p->need[i]) continue;
+		n = emit(p, ctx->nodes[i], NULL, p->want[i], field);
+		if (n < 0) return n;
+		predict(p, i, p->want[i], field);
+	}
+	return 0;
+}
+
+/* Map the desired states to the nodes of the cache */
+static int reconcile_map(struct reconcile_plan *p,
+		const struct lightify_desired_state *desired, size_t n) {
+	const struct lightify_desired_state *d;
+	size_t i, j;
+
+	for (j = 0; j < n; j++) {
+		d = &desired[j];
+		if (d->fields & ~RECONCILE_FIELDS) return -EINVAL;
+		if (d->brightness < 0 || d->cct < 0 || d->red < 0 || d->green < 0 ||
+				d->blue < 0 || d->white < 0) return -EINVAL;
+
+		for (i = 0; i < p->ctx->nodes_count; i++) {
+			if (p->state[i].node_address == d->node_address) break;
+		}
+		if (i == p->ctx->nodes_count) {
+			info(p->ctx, "reconcile: node %016llx not known\n",
+					(unsigned long long) d->node_address);
+			return -ENOENT;
+		}
+		if (p->want[i]) return -EINVAL;
+		p->want[i] = d;
+	}
+	return 0;
+}
+
+int reconcile_plan(struct lightify_ctx *ctx,
+		const struct lightify_desired_state *desired, size_t n,
+		unsigned int fadetime, struct lightify_batch *batch, int force) {
+	struct reconcile_plan p;
+	size_t i;
+	int ret;
+
+	if (!ctx || !batch || (n && !desired)) return -EINVAL;
+
+	memset(&p, 0, sizeof(p));
+	p.ctx = ctx;
+	p.batch = batch;
+	p.fadetime = fadetime;
+	p.force = force;
+	p.state = calloc(ctx->nodes_count + 1, sizeof(*p.state));
+	p.want = calloc(ctx->nodes_count + 1, sizeof(*p.want));
+	p.need = calloc(ctx->nodes_count + 1, 1);
+	if (!p.state || !p.want || !p.need) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	ret = lightify_nodes_export(ctx, p.state, ctx->nodes_count);
+	if (ret < 0) goto out;
+
+	ret = reconcile_map(&p, desired, n);
+	if (ret < 0) goto out;
+
+	for (i = 0; i < sizeof(reconcile_order) / sizeof(reconcile_order[0]); i++) {
+		ret = plan_field(&p, reconcile_order[i]);
+		if (ret < 0) goto out;
+	}
+	ret = p.count;
+	dbg(ctx, "reconcile: %d telegrams for %zu nodes\n", ret, n);
+
+out:
+	free(p.state);
+	free(p.want);
+	free(p.need);
+	return ret;
+}
+
+LIGHTIFY_EXPORT int lightify_reconcile_plan(struct lightify_ctx *ctx,
+		const struct lightify_desired_state *desired, size_t n,
+		unsigned int fadetime, struct lightify_batch *batch) {
+	return reconcile_plan(ctx, desired, n, fadetime, batch, 0);
+}
+
+LIGHTIFY_EXPORT int lightify_reconcile(struct lightify_ctx *ctx,
+		const struct lightify_desired_state *desired, size_t n,
+		unsigned int fadetime) {
+	struct lightify_batch *batch;
+	int ret;
+
+	ret = lightify_batch_new(ctx, &batch);
+	if (ret < 0) return ret;
+
+	ret = lightify_reconcile_plan(ctx, desired, n, fadetime, batch);
+	if (ret > 0) ret = lightify_batch_run(batch);
+
+	lightify_batch_free(batch);
+	return ret;
+}
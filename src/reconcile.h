@@ -0,0 +1,64 @@
+/*
+  liblightify -- library to control OSRAM's LIGHTIFY
+
+Copyright (c) 2015, Tobias Frost <tobi@coldtobi.de>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * \file reconcile.h
+ *
+ * The fan-out planner of reconcile.c, shared with the virtual groups.
+ */
+
+#ifndef SRC_RECONCILE_H_
+#define SRC_RECONCILE_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+
+struct lightify_ctx;
+struct lightify_batch;
+struct lightify_desired_state;
+
+/** Plan the telegrams for the desired states, see lightify_reconcile_plan()
+ *
+ * @param ctx library context
+ * @param desired array of desired states
+ * @param n number of elements in desired
+ * @param fadetime in 1/10 seconds
+ * @param batch the telegrams are appended to it
+ * @param force if set, every selected attribute is sent, even if the cache
+ * says it is already in the desired state
+ * @return number of telegrams added, negative on error
+ */
+int reconcile_plan(struct lightify_ctx *ctx,
+		const struct lightify_desired_state *desired, size_t n,
+		unsigned int fadetime, struct lightify_batch *batch, int force);
+
+#endif /* SRC_RECONCILE_H_ */
@@ -0,0 +1,358 @@
+/*
+  liblightify -- library to control OSRAM's LIGHTIFY
+
+Copyright (c) 2015, Tobias Frost <tobi@coldtobi.de>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/** \file shm.c
+ *
+ * Sharing the node and group cache with other processes.
+ *
+ * The owner of a context publishes its cache into a POSIX shared memory
+ * segment; other processes attach read-only and never talk to the gateway.
+ *
+ * Segment layout: struct shm_header, followed by node_cap records of
+ * struct lightify_node_state and group_cap records of struct
+ * lightify_group_state.
+ *
+ * Consistency is kept by a sequence lock: the owner makes seq odd before
+ * changing anything and even again afterwards. Readers copy the data and
+ * retry if seq was odd or changed meanwhile. If the segment had to grow,
+ * readers notice by the size in the header and map it again.
+ */
+
+#include "liblightify-private.h"
+#include "context.h"
+#include "log.h"
+#include "shm.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SHM_MAGIC "LFYS"
+#define SHM_LAYOUT (1)
+
+/* how often a reader retries before giving up */
+#define SHM_READ_RETRIES (10000)
+
+struct shm_header {
+	char magic[4];        /**< SHM_MAGIC */
+	uint32_t layout;      /**< SHM_LAYOUT */
+	uint32_t node_size;   /**< sizeof(struct lightify_node_state) */
+	uint32_t group_size;  /**< sizeof(struct lightify_group_state) */
+	uint32_t seq;         /**< sequence lock, odd while the owner writes */
+	uint32_t reserved;
+	uint64_t size;        /**< size of the segment */
+	uint64_t generation;  /**< number of publications */
+	uint32_t node_count;  /**< valid node records */
+	uint32_t node_cap;    /**< node records the segment has room for */
+	uint32_t group_count; /**< valid group records */
+	uint32_t group_cap;   /**< group records the segment has room for */
+};
+
+/** A mapping of a segment, for the owner and for the readers */
+struct lightify_shm {
+	int fd;
+	struct shm_header *hdr;
+	size_t size;
+	char *name;
+};
+
+static size_t shm_size(uint32_t node_cap, uint32_t group_cap) {
+	return sizeof(struct shm_header) + node_cap * sizeof(struct lightify_node_state)
+			+ group_cap * sizeof(struct lightify_group_state);
+}
+
+static struct lightify_node_state *shm_nodes(struct shm_header *hdr) {
+	return (struct lightify_node_state *) (hdr + 1);
+}
+
+static struct lightify_group_state *shm_groups(struct shm_header *hdr, uint32_t node_cap) {
+	return (struct lightify_group_state *) (shm_nodes(hdr) + node_cap);
+}
+
+/* (Re-)map the segment. On failure the old mapping stays in place, so the
+ * owner can still close its writer section and readers keep a valid view. */
+static int shm_map(struct lightify_shm *shm, size_t size, int prot) {
+	void *p;
+
+	p = mmap(NULL, size, prot, MAP_SHARED, shm->fd, 0);
+	if (p == MAP_FAILED) return -errno;
+	if (shm->hdr) munmap(shm->hdr, shm->size);
+	shm->hdr = p;
+	shm->size = size;
+	return 0;
+}
+
+static void shm_unmap(struct lightify_shm *shm) {
+	if (!shm) return;
+	if (shm->hdr) munmap(shm->hdr, shm->size);
+	if (shm->fd >= 0) close(shm->fd);
+	free(shm->name);
+	free(shm);
+}
+
+/* Owner: create the segment */
+static int shm_create(struct lightify_ctx *ctx, const char *name) {
+	struct lightify_shm *shm;
+	int err;
+
+	shm = calloc(1, sizeof(*shm));
+	if (!shm) return -ENOMEM;
+	shm->name = strdup(name);
+	shm->fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (!shm->name || shm->fd < 0) {
+		err = shm->name ? -errno : -ENOMEM;
+		shm_unmap(shm);
+		return err;
+	}
+
+	err = ftruncate(shm->fd, shm_size(0, 0)) < 0 ? -errno :
+			shm_map(shm, shm_size(0, 0), PROT_READ | PROT_WRITE);
+	if (err < 0) {
+		shm_unlink(name);
+		shm_unmap(shm);
+		return err;
+	}
+
+	memcpy(shm->hdr->magic, SHM_MAGIC, sizeof(shm->hdr->magic));
+	shm->hdr->layout = SHM_LAYOUT;
+	shm->hdr->node_size = sizeof(struct lightify_node_state);
+	shm->hdr->group_size = sizeof(struct lightify_group_state);
+	shm->hdr->size = shm->size;
+
+	ctx->shm = shm;
+	info(ctx, "shm: publishing into %s\n", name);
+	return 0;
+}
+
+/* Owner: make room for the records. Called with the sequence lock held. */
+static int shm_grow(struct lightify_shm *shm, uint32_t nodes, uint32_t groups) {
+	struct shm_header *hdr = shm->hdr;
+	uint32_t node_cap = hdr->node_cap, group_cap = hdr->group_cap;
+	struct lightify_group_state *g;
+	size_t size;
+	int err;
+
+	if (nodes <= node_cap && groups <= group_cap) return 0;
+
+	while (node_cap < nodes) node_cap = node_cap ? node_cap * 2 : 16;
+	while (group_cap < groups) group_cap = group_cap ? group_cap * 2 : 16;
+
+	size = shm_size(node_cap, group_cap);
+	if (ftruncate(shm->fd, size) < 0) return -errno;
+	err = shm_map(shm, size, PROT_READ | PROT_WRITE);
+	if (err < 0) return err;
+
+	/* the groups move behind the bigger node array */
+	hdr = shm->hdr;
+	g = shm_groups(hdr, hdr->node_cap);
+	memmove(shm_groups(hdr, node_cap), g, hdr->group_count * sizeof(*g));
+
+	hdr->node_cap = node_cap;
+	hdr->group_cap = group_cap;
+	hdr->size = size;
+	return 0;
+}
+
+LIGHTIFY_EXPORT int lightify_shm_publish(struct lightify_ctx *ctx, const char *name) {
+	struct lightify_shm *shm;
+	struct lightify_group *grp = NULL;
+	struct lightify_group_state *gs;
+	uint32_t nodes, groups = 0;
+	int err;
+
+	if (!ctx) return -EINVAL;
+
+	if (name && ctx->shm && strcmp(name, ctx->shm->name)) lightify_shm_close(ctx);
+	if (!ctx->shm) {
+		if (!name) return -EINVAL;
+		err = shm_create(ctx, name);
+		if (err < 0) return err;
+	}
+	shm = ctx->shm;
+
+	while ((grp = lightify_group_get_next(ctx, grp))) groups++;
+	nodes = ctx->nodes_count;
+
+	__atomic_add_fetch(&shm->hdr->seq, 1, __ATOMIC_SEQ_CST);
+
+	err = shm_grow(shm, nodes, groups);
+	if (err >= 0) {
+		struct shm_header *hdr = shm->hdr;
+
+		lightify_nodes_export(ctx, shm_nodes(hdr), nodes);
+		gs = shm_groups(hdr, hdr->node_cap);
+		while ((grp = lightify_group_get_next(ctx, grp))) {
+			const char *gname = lightify_group_get_name(grp);
+			memset(gs, 0, sizeof(*gs));
+			gs->id = lightify_group_get_id(grp);
+			gs->member_count = lightify_group_get_member_count(grp);
+			if (gname) strncpy(gs->name, gname, sizeof(gs->name) - 1);
+			gs++;
+		}
+		hdr->node_count = nodes;
+		hdr->group_count = groups;
+		hdr->generation++;
+	}
+
+	/* the header might have moved; if growing failed, it is the old one */
+	__atomic_add_fetch(&shm->hdr->seq, 1, __ATOMIC_SEQ_CST);
+	return err < 0 ? err : 0;
+}
+
+LIGHTIFY_EXPORT int lightify_shm_close(struct lightify_ctx *ctx) {
+	if (!ctx) return -EINVAL;
+	if (!ctx->shm) return 0;
+	shm_unlink(ctx->shm->name);
+	shm_unmap(ctx->shm);
+	ctx->shm = NULL;
+	return 0;
+}
+
+void shm_free(struct lightify_ctx *ctx) {
+	lightify_shm_close(ctx);
+}
+
+LIGHTIFY_EXPORT int lightify_attach_shm(const char *name, struct lightify_shm **shmp) {
+	struct lightify_shm *shm;
+	struct stat st;
+	int err;
+
+	if (!name || !shmp) return -EINVAL;
+
+	shm = calloc(1, sizeof(*shm));
+	if (!shm) return -ENOMEM;
+	shm->fd = shm_open(name, O_RDONLY, 0);
+	if (shm->fd < 0) {
+		err = -errno;
+		shm_unmap(shm);
+		return err;
+	}
+
+	if (fstat(shm->fd, &st) < 0) {
+		err = -errno;
+	} else if ((size_t) st.st_size < sizeof(struct shm_header)) {
+		err = -EPROTO;
+	} else {
+		err = shm_map(shm, st.st_size, PROT_READ);
+	}
+
+	if (err >= 0 && (memcmp(shm->hdr->magic, SHM_MAGIC, sizeof(shm->hdr->magic)) ||
+			shm->hdr->layout != SHM_LAYOUT ||
+			shm->hdr->node_size != sizeof(struct lightify_node_state) ||
+			shm->hdr->group_size != sizeof(struct lightify_group_state))) {
+		err = -EPROTO;
+	}
+
+	if (err < 0) {
+		shm_unmap(shm);
+		return err;
+	}
+	*shmp = shm;
+	return 0;
+}
+
+LIGHTIFY_EXPORT int lightify_detach_shm(struct lightify_shm *shm) {
+	if (!shm) return -EINVAL;
+	shm_unmap(shm);
+	return 0;
+}
+
+/* Reader: copy nodes or groups consistently. Returns the number of records. */
+static int shm_read(struct lightify_shm *shm, int groups, void *out, size_t cap,
+		uint64_t *generation) {
+	struct shm_header *hdr;
+	uint32_t seq, count, node_cap;
+	size_t recsize, size;
+	int tries, err;
+	const void *src;
+
+	for (tries = 0; tries < SHM_READ_RETRIES; tries++) {
+		hdr = shm->hdr;
+		seq = __atomic_load_n(&hdr->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1) {
+			sched_yield();
+			continue;
+		}
+
+		size = __atomic_load_n(&hdr->size, __ATOMIC_RELAXED);
+		if (size > shm->size) {
+			/* the owner grew the segment */
+			err = shm_map(shm, size, PROT_READ);
+			if (err < 0) return err;
+			continue;
+		}
+
+		node_cap = hdr->node_cap;
+		if (groups) {
+			count = hdr->group_count;
+			recsize = sizeof(struct lightify_group_state);
+			src = shm_groups(hdr, node_cap);
+			if (count > hdr->group_cap) continue;
+		} else {
+			count = hdr->node_count;
+			recsize = sizeof(struct lightify_node_state);
+			src = shm_nodes(hdr);
+			if (count > node_cap) continue;
+		}
+		/* torn read of the header: must still be within our mapping */
+		if ((const char *) src + count * recsize > (const char *) hdr + shm->size) continue;
+
+		if (out) memcpy(out, src, (count < cap ? count : cap) * recsize);
+		if (generation) *generation = hdr->generation;
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&hdr->seq, __ATOMIC_RELAXED) == seq) return count;
+	}
+	return -EAGAIN;
+}
+
+LIGHTIFY_EXPORT int lightify_shm_get_nodes(struct lightify_shm *shm,
+		struct lightify_node_state *out, size_t cap) {
+	if (!shm || (cap && !out)) return -EINVAL;
+	return shm_read(shm, 0, out, cap, NULL);
+}
+
+LIGHTIFY_EXPORT int lightify_shm_get_groups(struct lightify_shm *shm,
+		struct lightify_group_state *out, size_t cap) {
+	if (!shm || (cap && !out)) return -EINVAL;
+	return shm_read(shm, 1, out, cap, NULL);
+}
+
+LIGHTIFY_EXPORT uint64_t lightify_shm_get_generation(struct lightify_shm *shm) {
+	uint64_t generation = 0;
+	if (!shm) return 0;
+	if (shm_read(shm, 0, NULL, 0, &generation) < 0) return 0;
+	return generation;
+}
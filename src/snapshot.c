@@ -0,0 +1,299 @@
+/*
+  liblightify -- library to control OSRAM's LIGHTIFY
+
+Copyright (c) 2015, Tobias Frost <tobi@coldtobi.de>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/** \file snapshot.c
+ *
+ * Snapshots of the node cache.
+ *
+ * Published snapshots are immutable and can be read by other threads
+ * without locking. The thread driving the context publishes a new version
+ * by swapping an atomic pointer; the replaced versions are freed once no
+ * reader can still see them (epoch based reclamation):
+ *
+ * - A reader claims one of SNAPSHOT_READERS slots with the current epoch,
+ *   then loads the pointer.
+ * - The writer swaps the pointer, then advances the epoch. The old version
+ *   is tagged with the epoch before the advance.
+ * - A retired version may be freed if no claimed slot has an epoch less or
+ *   equal to its tag: readers which claimed later can only see newer ones.
+ *
+ * Comparing snapshots: most nodes do not change between two polls. So every
+ * record is first compared as a whole, 16 bytes at a time with SSE2 where
+ * available, and only the records which differ are looked at field by field.
+ */
+
+#include "liblightify-private.h"
+#include "context.h"
+#include "node.h"
+#include "snapshot.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/** Maximum number of concurrent readers */
+#define SNAPSHOT_READERS (64)
+
+/** A published version of the node cache */
+struct lightify_snapshot {
+	uint64_t version; /**< increases with every published change */
+	uint64_t retired; /**< epoch at which it was replaced */
+	struct lightify_snapshot *next_retired; /**< list of retired versions */
+	size_t count; /**< number of nodes */
+	struct lightify_node_state nodes[]; /**< the nodes' state */
+};
+
+struct lightify_snapshots {
+	/** current version, swapped atomically */
+	struct lightify_snapshot *current;
+	/** global epoch, starts at 1 */
+	uint64_t epoch;
+	/** per reader: epoch when the snapshot was acquired, 0 if unused */
+	uint64_t readers[SNAPSHOT_READERS];
+
+	/* below only used by the writer */
+
+	/** replaced versions waiting to be freed */
+	struct lightify_snapshot *retired;
+	/** last version number handed out */
+	uint64_t version;
+};
+
+/* Free the retired versions no reader can see anymore */
+static void snapshot_reclaim(struct lightify_snapshots *s) {
+	struct lightify_snapshot **p = &s->retired, *snap;
+	uint64_t oldest = UINT64_MAX, e;
+	int i;
+
+	for (i = 0; i < SNAPSHOT_READERS; i++) {
+		e = __atomic_load_n(&s->readers[i], __ATOMIC_SEQ_CST);
+		if (e && e < oldest) oldest = e;
+	}
+
+	while ((snap = *p)) {
+		if (snap->retired < oldest) {
+			*p = snap->next_retired;
+			free(snap);
+		} else {
+			p = &snap->next_retired;
+		}
+	}
+}
+
+LIGHTIFY_EXPORT int lightify_snapshot_publish(struct lightify_ctx *ctx) {
+	struct lightify_snapshots *s;
+	struct lightify_snapshot *old, *snap;
+	size_t count;
+	int n, all;
+
+	if (!ctx) return -EINVAL;
+
+	s = ctx->snapshots;
+	if (!s) {
+		s = calloc(1, sizeof(*s));
+		if (!s) return -ENOMEM;
+		s->epoch = 1;
+		__atomic_store_n(&ctx->snapshots, s, __ATOMIC_RELEASE);
+	}
+
+	old = s->current;
+	count = ctx->nodes_count;
+
+	snap = malloc(sizeof(*snap) + count * sizeof(snap->nodes[0]));
+	if (!snap) return -ENOMEM;
+	snap->count = count;
+	snap->next_retired = NULL;
+
+	/* copy on write: start from the previous version, update what changed */
+	all = !old || old->count != count;
+	if (!all) memcpy(snap->nodes, old->nodes, count * sizeof(snap->nodes[0]));
+	else memset(snap->nodes, 0, count * sizeof(snap->nodes[0]));
+
+	n = lightify_nodes_export_dirty(ctx, snap->nodes, all);
+	if (n < 0 || (!n && !all)) {
+		free(snap);
+		snapshot_reclaim(s);
+		return n < 0 ? n : 0;
+	}
+
+	snap->version = ++s->version;
+	__atomic_store_n(&s->current, snap, __ATOMIC_SEQ_CST);
+
+	if (old) {
+		old->retired = __atomic_fetch_add(&s->epoch, 1, __ATOMIC_SEQ_CST);
+		old->next_retired = s->retired;
+		s->retired = old;
+	}
+	snapshot_reclaim(s);
+	return 0;
+}
+
+LIGHTIFY_EXPORT int lightify_snapshot_acquire(struct lightify_ctx *ctx,
+		const struct lightify_snapshot **snap) {
+	struct lightify_snapshots *s;
+	uint64_t epoch, expected;
+	int i;
+
+	if (!ctx || !snap) return -EINVAL;
+
+	s = __atomic_load_n(&ctx->snapshots, __ATOMIC_ACQUIRE);
+	if (!s) return -ENODATA;
+
+	epoch = __atomic_load_n(&s->epoch, __ATOMIC_SEQ_CST);
+	for (i = 0; i < SNAPSHOT_READERS; i++) {
+		expected = 0;
+		if (__atomic_compare_exchange_n(&s->readers[i], &expected, epoch, 0,
+				__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+			*snap = __atomic_load_n(&s->current, __ATOMIC_SEQ_CST);
+			return i;
+		}
+	}
+	return -EBUSY;
+}
+
+LIGHTIFY_EXPORT int lightify_snapshot_release(struct lightify_ctx *ctx, int reader) {
+	struct lightify_snapshots *s;
+
+	if (!ctx || reader < 0 || reader >= SNAPSHOT_READERS) return -EINVAL;
+	s = __atomic_load_n(&ctx->snapshots, __ATOMIC_ACQUIRE);
+	if (!s) return -EINVAL;
+
+	__atomic_store_n(&s->readers[reader], 0, __ATOMIC_SEQ_CST);
+	return 0;
+}
+
+LIGHTIFY_EXPORT const struct lightify_node_state *lightify_snapshot_get_nodes(
+		const struct lightify_snapshot *snap, size_t *count) {
+	if (!snap) return NULL;
+	if (count) *count = snap->count;
+	return snap->nodes;
+}
+
+LIGHTIFY_EXPORT uint64_t lightify_snapshot_get_version(const struct lightify_snapshot *snap) {
+	if (!snap) return 0;
+	return snap->version;
+}
+
+void snapshot_free(struct lightify_ctx *ctx) {
+	struct lightify_snapshots *s = ctx->snapshots;
+	struct lightify_snapshot *snap;
+
+	if (!s) return;
+	while ((snap = s->retired)) {
+		s->retired = snap->next_retired;
+		free(snap);
+	}
+	free(s->current);
+	free(s);
+	ctx->snapshots = NULL;
+}
+
+/* the bytes of a record that carry data, i.e. without the trailing padding */
+#define STATE_DATA_SIZE (offsetof(struct lightify_node_state, name) + \
+		sizeof(((struct lightify_node_state *) 0)->name))
+
+/* Quick check: are the two records byte-wise identical? */
+static inline int state_equal(const struct lightify_node_state *a,
+		const struct lightify_node_state *b) {
+#if defined(__SSE2__)
+	const unsigned char *pa = (const unsigned char *) a;
+	const unsigned char *pb = (const unsigned char *) b;
+	size_t i;
+
+	for (i = 0; i + 16 <= STATE_DATA_SIZE; i += 16) {
+		__m128i va = _mm_loadu_si128((const __m128i *) (pa + i));
+		__m128i vb = _mm_loadu_si128((const __m128i *) (pb + i));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) != 0xffff) return 0;
+	}
+	return 0 == memcmp(pa + i, pb + i, STATE_DATA_SIZE - i);
+#else
+	return 0 == memcmp(a, b, STATE_DATA_SIZE);
+#endif
+}
+
+/* Which fields differ, as enum lightify_node_state_field */
+static unsigned int state_changes(const struct lightify_node_state *a,
+		const struct lightify_node_state *b) {
+	unsigned int changed = 0;
+
+	if (a->node_address != b->node_address || a->zone_address != b->zone_address ||
+			a->group_address != b->group_address)
+		changed |= LIGHTIFY_STATE_ADDRESS;
+	if (strncmp(a->name, b->name, sizeof(a->name)))
+		changed |= LIGHTIFY_STATE_NAME;
+	if (a->node_type != b->node_type || a->fwversion != b->fwversion)
+		changed |= LIGHTIFY_STATE_TYPE;
+	if (a->online_state != b->online_state || a->is_stale != b->is_stale)
+		changed |= LIGHTIFY_STATE_ONLINE;
+	if (a->is_on != b->is_on)
+		changed |= LIGHTIFY_STATE_ONOFF;
+	if (a->brightness != b->brightness)
+		changed |= LIGHTIFY_STATE_BRIGHTNESS;
+	if (a->cct != b->cct)
+		changed |= LIGHTIFY_STATE_CCT;
+	if (a->red != b->red || a->green != b->green || a->blue != b->blue ||
+			a->white != b->white)
+		changed |= LIGHTIFY_STATE_RGBW;
+
+	return changed;
+}
+
+LIGHTIFY_EXPORT int lightify_nodes_diff(const struct lightify_node_state *prev,
+		const struct lightify_node_state *cur, size_t n, uint64_t *bitmap,
+		struct lightify_node_delta *delta, size_t delta_cap) {
+	size_t i, count = 0;
+	unsigned int changed;
+
+	if (n && (!prev || !cur)) return -EINVAL;
+	if (delta_cap && !delta) return -EINVAL;
+	if (n > INT32_MAX) return -EINVAL;
+
+	if (bitmap) memset(bitmap, 0, (n + 63) / 64 * sizeof(*bitmap));
+
+	for (i = 0; i < n; i++) {
+		if (state_equal(&prev[i], &cur[i])) continue;
+		changed = state_changes(&prev[i], &cur[i]);
+		if (!changed) continue; /* only bytes after the end of the name differ */
+
+		if (bitmap) bitmap[i / 64] |= (uint64_t) 1 << (i % 64);
+		if (count < delta_cap) {
+			delta[count].index = i;
+			delta[count].fields = changed;
+		}
+		count++;
+	}
+
+	return count;
+}
@@ -35,11 +35,17 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "socket.h"
 #include "context.h"
+#include "capture.h"
+#include "connection.h"
+#include "frame.h"
+#include "log.h"
+#include "wait.h"
 
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
 int write_to_socket(struct lightify_ctx *ctx, unsigned char *msg, size_t size) {
@@ -48,12 +54,16 @@ int write_to_socket(struct lightify_ctx *ctx, unsigned char *msg, size_t size) {
 	int fd = lightify_skt_getfd(ctx);
 	if (fd < 0) return -EINVAL;
 	size_t m = size; /*<< current position */
-	struct timeval to;
+	struct timespec dl;
 
 #ifdef ENABLE_DEBUG_MSGS
 	unsigned char *msg_ = msg;
 #endif
 
+	/* one deadline for the whole telegram, not per retry */
+	wait_deadline_set(&dl, lightify_skt_getiotimeout(ctx));
+	wait_deadline_clamp(ctx, &dl);
+
 	do {
 		n = write(fd, msg, m);
 		if (n < 0) {
@@ -75,20 +85,14 @@ int write_to_socket(struct lightify_ctx *ctx, unsigned char *msg, size_t size) {
 				dbg(ctx, "Short write:  %d bytes written instead of %d\n", (int)(size - m), (int)size);
 				break;
 			}
-			/* non-blocking I/O confirmed -- setup timeout and retry when socket is ready */
-			to = lightify_skt_getiotimeout(ctx);
-			fd_set myset;
-			FD_ZERO(&myset);
-			FD_SET(fd, &myset);
-			n = select(fd, NULL, &myset, NULL, &to);
+			/* non-blocking I/O confirmed -- retry when socket is ready */
+			n = wait_fd(ctx, fd, WAIT_WRITE, &dl);
 			/* fd became ready to accept new bytes. */
 			if (n > 0) continue;
-			/* error handling :EINTR means repeat. */
-			if (n < 0 && errno == EINTR) continue;
-			/* all other errors: return what we've got or the error if we didn't */
-			if (n < 0 && m == size) return -errno;
+			/* errors: return what we've got or the error if we didn't */
+			if (n < 0 && m == size) return n;
 			if (n < 0) {
-				dbg(ctx, "Write error %d: %d bytes written, instead of %d\n", -errno, (int)(size-m), (int)size);
+				dbg(ctx, "Write error %d: %d bytes written, instead of %d\n", n, (int)(size-m), (int)size);
 				break;
 			}
 			/* no byte read at all --  timeout. */
@@ -129,12 +133,16 @@ int read_from_socket(struct lightify_ctx *ctx, unsigned char *msg, size_t size )
 	int fd = lightify_skt_getfd(ctx);
 	if (fd < 0) return -EINVAL;
 	size_t m = size;
-	struct timeval to;
+	struct timespec dl;
 
 #ifdef ENABLE_DEBUG_MSGS
 	unsigned char *msg_ = msg;
 #endif
 
+	/* one deadline for the whole read, not per retry */
+	wait_deadline_set(&dl, lightify_skt_getiotimeout(ctx));
+	wait_deadline_clamp(ctx, &dl);
+
 	do {
 		n = read(fd, msg, m);
 		if (-1 == n) {
@@ -156,20 +164,14 @@ int read_from_socket(struct lightify_ctx *ctx, unsigned char *msg, size_t size )
 				dbg(ctx, "Short read: %d instead of %d\n", (int)(size-m), (int) size);
 				break; /* break out for debug message logging. */
 			}
-			to = lightify_skt_getiotimeout(ctx);
-			fd_set myset;
-			FD_ZERO(&myset);
-			FD_SET(fd, &myset);
-			i = select(fd, &myset, NULL, NULL, &to);
+			i = wait_fd(ctx, fd, WAIT_READ, &dl);
 			/* fd is now ready to be read */
 			if (i > 0) continue;
-			/* error handling: Execpt interrupted system calls means we return the error */
-			if (i < 0 && errno == EINTR) continue;
 			/* return error if we did not get any byte */
-			if (i < 0 && m == size) return -errno;
+			if (i < 0 && m == size) return i;
 			/* return what we've got, even despite the error */
 			if (i < 0) {
-				 dbg(ctx, "Read error %d:  %d bytes read, instead of %d\n", -errno, (int)(size-m), (int)size);
+				 dbg(ctx, "Read error %d:  %d bytes read, instead of %d\n", i, (int)(size-m), (int)size);
 				 break;
 			}
 			/* if no fd became ready, and we never saw a byte, we'll bail out with timeout */
@@ -205,6 +207,110 @@ int read_from_socket(struct lightify_ctx *ctx, unsigned char *msg, size_t size )
 	return size-m;
 }
 
+/* Last resort if the framing lost track: Drop whatever is in the socket, so
+ * that it won't be taken as answer to the next request. Only possible with
+ * the default I/O functions. */
+static void io_resync(struct lightify_ctx *ctx) {
+	unsigned char buf[256];
+	int n;
+
+	ctx->resync = 0;
+	if (ctx->socket_read_fn != read_from_socket || ctx->socket < 0) return;
+
+	do {
+		n = recv(ctx->socket, buf, sizeof(buf), MSG_DONTWAIT);
+		if (n > 0) dbg(ctx, "resync: dropped %d stale bytes\n", n);
+	} while (n > 0 || (n < 0 && errno == EINTR));
+}
+
+static int io_expired(struct lightify_ctx *ctx) {
+	return ctx->has_req_deadline && wait_deadline_expired(&ctx->req_deadline);
+}
+
+/* The request ran out of time: cancel it. */
+static int io_cancel(struct lightify_ctx *ctx) {
+	info(ctx, "request deadline exceeded\n");
+	return -ETIMEDOUT;
+}
+
+/* Every request starts with writing its telegram, so this is where
+ * the request deadline is computed. */
+static void io_start_request(struct lightify_ctx *ctx) {
+	struct timeval tv = ctx->req_timeout;
+
+	ctx->has_req_deadline = ctx->has_deadline;
+	ctx->req_deadline = ctx->deadline;
+
+	if (tv.tv_sec || tv.tv_usec) {
+		struct timespec dl;
+		wait_deadline_set(&dl, tv);
+		if (!ctx->has_req_deadline) {
+			ctx->req_deadline = dl;
+			ctx->has_req_deadline = 1;
+		} else {
+			wait_deadline_clamp(ctx, &dl);
+			ctx->req_deadline = dl;
+		}
+	}
+}
+
+int lightify_io_write(struct lightify_ctx *ctx, unsigned char *msg, size_t size) {
+	int n;
+
+	io_start_request(ctx);
+	/* leftovers of the previous answer? */
+	if (frame_finish(ctx) < 0) ctx->resync = 1;
+	if (ctx->resync) io_resync(ctx);
+	if (io_expired(ctx)) return io_cancel(ctx);
+
+	n = ctx->socket_write_fn(ctx, msg, size);
+
+	if (conn_is_managed(ctx)) {
+		/* connection broken? Retry once it's back. */
+		if (n != (int) size && !io_expired(ctx) && 0 == conn_reconnect(ctx)) {
+			n = ctx->socket_write_fn(ctx, msg, size);
+		}
+		conn_track_request(ctx, msg, size);
+	}
+
+	if (n > 0) capture_record(ctx, CAPTURE_DIR_TX, msg, n);
+	if (n == (int) size) frame_request_sent(ctx, msg, size);
+	if (n != (int) size && io_expired(ctx)) return io_cancel(ctx);
+	return n;
+}
+
+int lightify_io_read_raw(struct lightify_ctx *ctx, unsigned char *msg, size_t size) {
+	int n;
+
+	if (io_expired(ctx)) return io_cancel(ctx);
+
+	n = ctx->socket_read_fn(ctx, msg, size);
+
+	if (conn_is_managed(ctx)) {
+		/* answer interrupted? Reconnect and replay the telegram, then continue
+		 * where we've been. */
+		if (n != (int) size && !io_expired(ctx)) {
+			int got = n > 0 ? n : 0;
+			if (0 == conn_replay_request(ctx, msg, got)) {
+				int m = ctx->socket_read_fn(ctx, msg + got, size - got);
+				if (m >= 0) n = got + m;
+				else if (!got) n = m;
+			}
+		}
+		if (n > 0) conn_track_answer(ctx, msg, n);
+	}
+
+	if (n > 0) capture_record(ctx, CAPTURE_DIR_RX, msg, n);
+	return n;
+}
+
+int lightify_io_read(struct lightify_ctx *ctx, unsigned char *msg, size_t size) {
+	int n = frame_read(ctx, msg, size);
+
+	if (n != (int) size && io_expired(ctx)) return io_cancel(ctx);
+	return n;
+}
+
 LIGHTIFY_EXPORT int lightify_skt_setfd(struct lightify_ctx *ctx, int socket) {
 	if (!ctx) return -EINVAL;
 	ctx->socket = socket;
@@ -222,6 +328,20 @@ LIGHTIFY_EXPORT int lightify_skt_setiotimeout(struct lightify_ctx *ctx, struct t
 	return 0;
 }
 
+LIGHTIFY_EXPORT int lightify_set_deadline(struct lightify_ctx *ctx,
+		const struct timespec *deadline) {
+	if (!ctx) return -EINVAL;
+	ctx->has_deadline = (deadline != NULL);
+	if (deadline) ctx->deadline = *deadline;
+	return 0;
+}
+
+LIGHTIFY_EXPORT int lightify_set_request_timeout(struct lightify_ctx *ctx, struct timeval tv) {
+	if (!ctx || tv.tv_sec < 0 || tv.tv_usec < 0) return -EINVAL;
+	ctx->req_timeout = tv;
+	return 0;
+}
+
 LIGHTIFY_EXPORT struct timeval lightify_skt_getiotimeout(struct lightify_ctx *ctx) {
 	if (!ctx) {
 		struct timeval tv;
@@ -61,4 +61,38 @@ int write_to_socket(struct lightify_ctx *ctx, unsigned char *msg, size_t size);
 */
 int read_from_socket(struct lightify_ctx *ctx, unsigned char *msg, size_t size);
 
+/** Write a telegram to the gateway using the configured I/O callback.
+ *
+ * All library requests go through this function, so that it can
+ * also feed an active capture.
+ *
+ * @param ctx	library context
+ * @param msg   what to write
+ * @param size  how many bytes to be written
+ * @return see write_to_socket_fn
+ */
+int lightify_io_write(struct lightify_ctx *ctx, unsigned char *msg, size_t size);
+
+/** Read from the gateway using the configured I/O callback.
+ *
+ * Counterpart to lightify_io_write()
+ *
+ * @param ctx 	library context
+ * @param msg	where to store the result
+ * @param size	expected read, also buffer size of msg.
+ * @return see read_from_socket_fn
+ */
+int lightify_io_read(struct lightify_ctx *ctx, unsigned char *msg, size_t size);
+
+/** Read from the gateway, without keeping track of the frames.
+ *
+ * For the framing layer; everyone else uses lightify_io_read().
+ *
+ * @param ctx 	library context
+ * @param msg	where to store the result
+ * @param size	expected read, also buffer size of msg.
+ * @return see read_from_socket_fn
+ */
+int lightify_io_read_raw(struct lightify_ctx *ctx, unsigned char *msg, size_t size);
+
 #endif /* SRC_SOCKET_H_ */
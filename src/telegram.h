@@ -0,0 +1,141 @@
+/*
+  liblightify -- library to control OSRAM's LIGHTIFY
+
+Copyright (c) 2015, Tobias Frost <tobi@coldtobi.de>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * \file telegram.h
+ *
+ * Building and completing the telegrams of the set commands (0x31, 0x32,
+ * 0x33, 0x36) and the loop programs (0xD8, 0xD9), which all share the same
+ * answer. Used by lightify_request_telegram() and the batch API.
+ * Implemented in context.c, where the telegram layouts live.
+ */
+
+#ifndef SRC_TELEGRAM_H_
+#define SRC_TELEGRAM_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdint.h>
+#include <stdlib.h>
+
+struct lightify_color_loop_spec;
+struct lightify_cct_loop_spec;
+
+/** Number of steps of a colour or CCT loop program */
+#define LOOP_STEPS (15)
+
+/** Size of the largest telegram, the loop programs:
+ * header, address, 8 static bytes, the steps and the checksum */
+#define TELEGRAM_MAX_SIZE (8 + 8 + 8 + LOOP_STEPS * 4 + 1)
+
+/** All those commands are answered with the same 20 bytes */
+#define TELEGRAM_ANSWER_SIZE (20)
+
+/** Build a 0x32 (on/off) telegram
+ *
+ * @param msg buffer, at least TELEGRAM_MAX_SIZE bytes
+ * @param adr node MAC or group id
+ * @param isgroup whether adr is a group
+ * @param onoff on or off
+ * @return size of the telegram
+ */
+size_t telegram_onoff(unsigned char *msg, uint64_t adr, int isgroup, int onoff);
+
+/** Build a 0x31 (brightness) telegram, see telegram_onoff() */
+size_t telegram_brightness(unsigned char *msg, uint64_t adr, int isgroup,
+		unsigned int level, unsigned int fadetime);
+
+/** Build a 0x33 (CCT) telegram, see telegram_onoff() */
+size_t telegram_cct(unsigned char *msg, uint64_t adr, int isgroup,
+		unsigned int cct, unsigned int fadetime);
+
+/** Build a 0x36 (RGBW) telegram, see telegram_onoff() */
+size_t telegram_rgbw(unsigned char *msg, uint64_t adr, int isgroup,
+		unsigned int r, unsigned int g, unsigned int b, unsigned int w,
+		unsigned int fadetime);
+
+/** Build a 0xD8 (colour loop) telegram
+ *
+ * @param msg buffer, at least TELEGRAM_MAX_SIZE bytes
+ * @param adr node MAC or group id
+ * @param isgroup whether adr is a group
+ * @param colorspec the program, see lightify_node_request_color_loop()
+ * @param number_of_specs must be LOOP_STEPS
+ * @param static_bytes NULL or the 8 static bytes
+ * @return size of the telegram, 0 if the program is invalid
+ */
+size_t telegram_color_loop(unsigned char *msg, uint64_t adr, int isgroup,
+		const struct lightify_color_loop_spec *colorspec,
+		unsigned int number_of_specs, const uint8_t static_bytes[8]);
+
+/** Build a 0xD9 (CCT loop) telegram, see telegram_color_loop() */
+size_t telegram_cct_loop(unsigned char *msg, uint64_t adr, int isgroup,
+		const struct lightify_cct_loop_spec *cctspec,
+		unsigned int number_of_specs, const uint8_t static_bytes[8]);
+
+/** Check that msg is a well-formed set command or loop program
+ *
+ * @param msg telegram
+ * @param size its size
+ * @return 0 if ok, -EINVAL if not.
+ */
+int telegram_check(const unsigned char *msg, size_t size);
+
+/** Stamp the token into the telegram's header
+ *
+ * @param msg telegram
+ * @param token to use
+ */
+void telegram_set_token(unsigned char *msg, uint32_t token);
+
+/** Update the cache of the nodes addressed by the telegram
+ *
+ * The node itself, all members of the group or all nodes for broadcasts.
+ *
+ * @param ctx library context
+ * @param msg the telegram sent
+ * @param status result of the request; if negative, the nodes are
+ * marked stale.
+ */
+void telegram_update_nodes(struct lightify_ctx *ctx, const unsigned char *msg, int status);
+
+/** Evaluate the answer of a set command and update the node cache
+ *
+ * @param ctx library context
+ * @param msg the telegram sent
+ * @param answer its answer, TELEGRAM_ANSWER_SIZE bytes
+ * @return the gateway's status (negative on error), -EPROTO if the answer
+ * does not belong to the telegram
+ */
+int telegram_complete(struct lightify_ctx *ctx, const unsigned char *msg,
+		unsigned char *answer);
+
+#endif /* SRC_TELEGRAM_H_ */
@@ -36,6 +36,13 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <liblightify/liblightify.h>
 
 #include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
 
 struct lightify_ctx *_ctx;
 
@@ -773,6 +780,76 @@ START_TEST(lightify_tst_groups_basic) {
 
 }END_TEST
 
+START_TEST(lightify_tst_groups_aggregates) {
+
+	int err, r, g, b, w;
+	struct lightify_ctx *ctx;
+	struct fake_socket *mfs = calloc(1, sizeof(struct fake_socket));
+	struct lightify_group *grp1, *grp2;
+	struct lightify_node *node;
+	unsigned char groups[sizeof(req_getgroups_answer)];
+	unsigned char answer[sizeof(turnonlight_answer_node)];
+
+	err = lightify_new(&ctx, NULL);
+	ck_assert_int_eq(err, 0);
+	lightify_set_socket_fn(ctx, my_write_to_socket, my_read_from_socket);
+	lightify_set_userdata(ctx, mfs);
+
+	// group address of the sample node is 0xabcd: member of group 1 and 3
+	helper_mfs_setup_answer(mfs, scanfornodes_answer, sizeof(scanfornodes_answer));
+	ck_assert_int_eq(lightify_node_request_scan(ctx), 1);
+	node = lightify_node_get_next(ctx, NULL);
+
+	memcpy(groups, req_getgroups_answer, sizeof(groups));
+	groups[4] = 2;
+	helper_mfs_setup_answer(mfs, groups, sizeof(groups));
+	ck_assert_int_eq(lightify_group_request_scan(ctx), 3);
+
+	grp1 = lightify_group_get_next(ctx, NULL);
+	grp2 = lightify_group_get_next(ctx, grp1);
+
+	ck_assert_int_eq(lightify_group_get_member_count(grp1), 1);
+	ck_assert_int_eq(lightify_group_get_member_count(grp2), 0);
+	ck_assert_int_eq(lightify_group_get_online_count(grp1), 1);
+	ck_assert_int_eq(lightify_group_get_stale_count(grp1), 0);
+	ck_assert_int_eq(lightify_group_is_any_on(grp1), 0);
+	ck_assert_int_eq(lightify_group_is_all_on(grp1), 0);
+	ck_assert_int_eq(lightify_group_get_brightness_avg(grp1), 100);
+	ck_assert_int_eq(lightify_group_get_brightness_min(grp1), 100);
+	ck_assert_int_eq(lightify_group_get_brightness_max(grp1), 100);
+	ck_assert_int_eq(lightify_group_get_cct(grp1), 2702);
+	ck_assert_int_eq(lightify_group_get_rgbw(grp1, &r, &g, &b, &w), 0);
+	ck_assert_int_eq(r, 0xf0);
+	ck_assert_int_eq(w, 0xf3);
+
+	// empty group has nothing to report
+	ck_assert_int_eq(lightify_group_is_all_on(grp2), 0);
+	ck_assert_int_eq(lightify_group_get_brightness_avg(grp2), -ENODATA);
+	ck_assert_int_eq(lightify_group_get_brightness_min(grp2), -ENODATA);
+	ck_assert_int_eq(lightify_group_get_cct(grp2), -ENODATA);
+
+	// commands on the node update the aggregates
+	memcpy(answer, turnonlight_answer_node, sizeof(answer));
+	answer[4] = 3;
+	helper_mfs_setup_answer(mfs, answer, sizeof(answer));
+	ck_assert_int_eq(lightify_node_request_onoff(ctx, node, 1), 0);
+	ck_assert_int_eq(lightify_group_is_any_on(grp1), 1);
+	ck_assert_int_eq(lightify_group_is_all_on(grp1), 1);
+
+	// failed command marks the node stale
+	mfs->err_write = -EIO;
+	helper_mfs_setup_answer(mfs, answer, sizeof(answer));
+	ck_assert_int_lt(lightify_node_request_onoff(ctx, node, 0), 0);
+	ck_assert_int_eq(lightify_group_get_stale_count(grp1), 1);
+	ck_assert_int_eq(lightify_group_is_any_on(grp1), 0);
+
+	lightify_free(ctx);
+	free(mfs->buf_write);
+	free(mfs->buf_read);
+	free(mfs);
+
+}END_TEST
+
 Suite *liblightify_tst_groups_basic(void) {
 	Suite *s;
 	TCase *tc;
@@ -783,11 +860,1193 @@ Suite *liblightify_tst_groups_basic(void) {
 
 	tcase_add_unchecked_fixture(tc, setup, teardown);
 	tcase_add_test(tc, lightify_tst_groups_basic);
+	tcase_add_test(tc, lightify_tst_groups_aggregates);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
+
+START_TEST(lightify_tst_capture_replay) {
+
+	int err;
+	char capfile[] = "/tmp/test-lightify-capture-XXXXXX";
+	struct fake_socket *mfs = calloc(1, sizeof(struct fake_socket));
+	struct lightify_ctx *ctx2;
+	struct lightify_node *node;
+
+	int fd = mkstemp(capfile);
+	ck_assert_int_ge(fd, 0);
+	close(fd);
+
+	lightify_set_socket_fn(_ctx, my_write_to_socket, my_read_from_socket);
+	lightify_set_userdata(_ctx, mfs);
+
+	// record a node scan
+	{
+		helper_mfs_setup_answer(mfs, scanfornodes_answer,
+				sizeof(scanfornodes_answer));
+
+		err = lightify_capture_start(_ctx, capfile);
+		ck_assert_int_eq(err, 0);
+		// only one capture at a time
+		err = lightify_capture_start(_ctx, capfile);
+		ck_assert_int_eq(err, -EBUSY);
+
+		err = lightify_node_request_scan(_ctx);
+		ck_assert_int_eq(err, 1);
+
+		err = lightify_capture_stop(_ctx);
+		ck_assert_int_eq(err, 0);
+		err = lightify_capture_stop(_ctx);
+		ck_assert_int_eq(err, -EBADF);
+	}
+
+	// replay the session on a fresh context -- same tokens, same answers.
+	{
+		err = lightify_new(&ctx2, NULL);
+		ck_assert_int_eq(err, 0);
+
+		err = lightify_replay_start(ctx2, capfile, 0);
+		ck_assert_int_eq(err, 0);
+
+		err = lightify_node_request_scan(ctx2);
+		ck_assert_int_eq(err, 1);
+
+		node = lightify_node_get_next(ctx2, NULL);
+		ck_assert_ptr_ne(node, NULL);
+		ck_assert_int_eq(strcmp("Licht 01", lightify_node_get_name(node)), 0);
+		ck_assert(lightify_node_get_nodeadr(node) == 0xdeadbeef12345678);
+
+		// capture exhausted.
+		err = lightify_node_request_scan(ctx2);
+		ck_assert_int_lt(err, 0);
+
+		err = lightify_replay_stop(ctx2);
+		ck_assert_int_eq(err, 0);
+		lightify_free(ctx2);
+	}
+
+	// not a capture file
+	{
+		err = lightify_new(&ctx2, NULL);
+		ck_assert_int_eq(err, 0);
+		err = lightify_replay_start(ctx2, "/dev/null", 0);
+		ck_assert_int_eq(err, -EPROTO);
+		lightify_free(ctx2);
+	}
+
+	unlink(capfile);
+	lightify_set_socket_fn(_ctx, NULL, NULL);
+	lightify_set_userdata(_ctx, NULL);
+	free(mfs->buf_write);
+	free(mfs->buf_read);
+	free(mfs);
+
+}END_TEST
+
+Suite *liblightify_tst_capture(void) {
+	Suite *s;
+	TCase *tc;
+	s = suite_create("lightify_tst_capture");
+
+	/* Core test case */
+	tc = tcase_create("lightify_tst_capture_replay");
+
+	tcase_add_unchecked_fixture(tc, setup, teardown);
+	tcase_add_test(tc, lightify_tst_capture_replay);
 	suite_add_tcase(s, tc);
 
 	return s;
 }
 
+START_TEST(lightify_tst_conn_managed) {
+
+	int err, lfd;
+	struct sockaddr_in sin;
+	socklen_t len = sizeof(sin);
+	struct timeval tv = { 0, 1000 };
+	struct timeval tv_max = { 0, 2000 };
+
+	// misuse
+	ck_assert_int_eq(lightify_conn_set_host(NULL, "localhost", 4000), -EINVAL);
+	ck_assert_int_eq(lightify_conn_set_host(_ctx, NULL, 4000), -EINVAL);
+	ck_assert_int_eq(lightify_conn_set_host(_ctx, "localhost", 70000), -EINVAL);
+	ck_assert_int_eq(lightify_conn_set_backoff(_ctx, tv, tv_max, 0), -EINVAL);
+	ck_assert_int_eq(lightify_conn_open(NULL), -EINVAL);
+	ck_assert_int_eq(lightify_conn_close(_ctx), -EBADF);
+
+	// a listening socket to connect to.
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	ck_assert_int_ge(lfd, 0);
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	ck_assert_int_eq(bind(lfd, (struct sockaddr*) &sin, sizeof(sin)), 0);
+	ck_assert_int_eq(listen(lfd, 1), 0);
+	ck_assert_int_eq(getsockname(lfd, (struct sockaddr*) &sin, &len), 0);
+
+	err = lightify_conn_set_host(_ctx, "127.0.0.1", ntohs(sin.sin_port));
+	ck_assert_int_eq(err, 0);
+	err = lightify_conn_set_backoff(_ctx, tv, tv_max, 2);
+	ck_assert_int_eq(err, 0);
+
+	err = lightify_conn_open(_ctx);
+	ck_assert_int_eq(err, 0);
+	ck_assert_int_ge(lightify_skt_getfd(_ctx), 0);
+
+	err = lightify_conn_close(_ctx);
+	ck_assert_int_eq(err, 0);
+	ck_assert_int_eq(lightify_skt_getfd(_ctx), -1);
+
+	// nobody listening anymore -- must fail after the configured attempts.
+	close(lfd);
+	err = lightify_conn_open(_ctx);
+	ck_assert_int_lt(err, 0);
+	ck_assert_int_eq(lightify_skt_getfd(_ctx), -1);
+
+}END_TEST
+
+Suite *liblightify_tst_conn(void) {
+	Suite *s;
+	TCase *tc;
+	s = suite_create("lightify_tst_conn");
+
+	/* Core test case */
+	tc = tcase_create("lightify_tst_conn_managed");
+
+	tcase_add_unchecked_fixture(tc, setup, teardown);
+	tcase_add_test(tc, lightify_tst_conn_managed);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
+
+START_TEST(lightify_tst_wait_methods) {
+
+	int err, i, sv[2];
+	struct rlimit rl;
+	struct timeval tv = { 0, 100000 };
+	struct lightify_ctx *ctx;
+	enum lightify_wait_method methods[] = { LIGHTIFY_WAIT_POLL, LIGHTIFY_WAIT_EPOLL };
+
+	for (i = 0; i < 2; i++) {
+		err = socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+		ck_assert_int_eq(err, 0);
+		ck_assert_int_eq(fcntl(sv[0], F_SETFL, O_NONBLOCK), 0);
+
+		// fds beyond FD_SETSIZE must work, if we are allowed to have them.
+		if (0 == getrlimit(RLIMIT_NOFILE, &rl) && rl.rlim_max > 1500) {
+			rl.rlim_cur = rl.rlim_max;
+			setrlimit(RLIMIT_NOFILE, &rl);
+			if (dup2(sv[0], 1500) == 1500) {
+				close(sv[0]);
+				sv[0] = 1500;
+			}
+		}
+
+		err = lightify_new(&ctx, NULL);
+		ck_assert_int_eq(err, 0);
+		lightify_skt_setfd(ctx, sv[0]);
+		lightify_skt_setiotimeout(ctx, tv);
+		err = lightify_skt_setwaitmethod(ctx, methods[i], -1);
+		ck_assert_int_eq(err, 0);
+
+		// answer already waiting
+		err = write(sv[1], scanfornodes_answer, sizeof(scanfornodes_answer));
+		ck_assert_int_eq(err, sizeof(scanfornodes_answer));
+		err = lightify_node_request_scan(ctx);
+		ck_assert_int_eq(err, 1);
+
+		// gateway does not answer
+		err = lightify_node_request_scan(ctx);
+		ck_assert_int_eq(err, -ETIMEDOUT);
+
+		lightify_free(ctx);
+		close(sv[0]);
+		close(sv[1]);
+	}
+
+	ck_assert_int_eq(lightify_skt_setwaitmethod(NULL, LIGHTIFY_WAIT_POLL, -1), -EINVAL);
+
+}END_TEST
+
+START_TEST(lightify_tst_request_deadline) {
+
+	int err, sv[2];
+	pid_t pid;
+	struct timeval tv = { 0, 100000 };
+	struct timeval iotv = { 5, 0 };
+	struct timespec t0, t1, dl;
+	unsigned char answer[sizeof(scanfornodes_answer)];
+	unsigned char req[64];
+	struct lightify_ctx *ctx;
+
+	err = socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+	ck_assert_int_eq(err, 0);
+	ck_assert_int_eq(fcntl(sv[0], F_SETFL, O_NONBLOCK), 0);
+
+	err = lightify_new(&ctx, NULL);
+	ck_assert_int_eq(err, 0);
+	lightify_skt_setfd(ctx, sv[0]);
+	lightify_skt_setiotimeout(ctx, iotv);
+
+	ck_assert_int_eq(lightify_set_request_timeout(NULL, tv), -EINVAL);
+	ck_assert_int_eq(lightify_set_deadline(NULL, NULL), -EINVAL);
+
+	// request budget ends before the iotimeout
+	err = lightify_set_request_timeout(ctx, tv);
+	ck_assert_int_eq(err, 0);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	err = lightify_node_request_scan(ctx);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	ck_assert_int_eq(err, -ETIMEDOUT);
+	ck_assert_int_lt(t1.tv_sec - t0.tv_sec, 2);
+
+	// an expired absolute deadline cancels the request right away
+	clock_gettime(CLOCK_MONOTONIC, &dl);
+	err = lightify_set_deadline(ctx, &dl);
+	ck_assert_int_eq(err, 0);
+	err = lightify_node_request_scan(ctx);
+	ck_assert_int_eq(err, -ETIMEDOUT);
+	lightify_set_deadline(ctx, NULL);
+
+	// the late answer of the cancelled request must not confuse the next one.
+	err = read(sv[1], req, sizeof(req));
+	ck_assert_int_gt(err, 0);
+	err = write(sv[1], scanfornodes_answer, sizeof(scanfornodes_answer));
+	ck_assert_int_eq(err, sizeof(scanfornodes_answer));
+
+	memcpy(answer, scanfornodes_answer, sizeof(answer));
+	answer[4] = 3; // third token
+	pid = fork();
+	ck_assert_int_ge(pid, 0);
+	if (!pid) {
+		if (read(sv[1], req, sizeof(req)) > 0) {
+			if (write(sv[1], answer, sizeof(answer))) {};
+		}
+		_exit(0);
+	}
+
+	err = lightify_node_request_scan(ctx);
+	ck_assert_int_eq(err, 1);
+	waitpid(pid, NULL, 0);
+
+	lightify_free(ctx);
+	close(sv[0]);
+	close(sv[1]);
+
+}END_TEST
+
+Suite *liblightify_tst_wait(void) {
+	Suite *s;
+	TCase *tc;
+	s = suite_create("lightify_tst_wait");
+
+	/* Core test case */
+	tc = tcase_create("lightify_tst_wait_methods");
+
+	tcase_add_test(tc, lightify_tst_wait_methods);
+	tcase_add_test(tc, lightify_tst_request_deadline);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
+
+START_TEST(lightify_tst_framing_resync) {
+
+	int err;
+	struct lightify_ctx *ctx;
+	struct fake_socket *mfs = calloc(1, sizeof(struct fake_socket));
+	unsigned char buf[sizeof(scanfornodes_answer) + 2 * sizeof(turnonlight_answer_broadcast)];
+	size_t len;
+
+	err = lightify_new(&ctx, NULL);
+	ck_assert_int_eq(err, 0);
+	lightify_set_socket_fn(ctx, my_write_to_socket, my_read_from_socket);
+	lightify_set_userdata(ctx, mfs);
+
+	// token 1: answer with right token but wrong command -- 53 bytes
+	// followed by the answer for token 2.
+	len = sizeof(scanfornodes_answer);
+	memcpy(buf, scanfornodes_answer, len);
+	memcpy(buf + len, turnonlight_answer_broadcast, sizeof(turnonlight_answer_broadcast));
+	len += sizeof(turnonlight_answer_broadcast);
+	helper_mfs_setup_answer(mfs, buf, len);
+
+	err = lightify_node_request_onoff(ctx, NULL, 1);
+	ck_assert_int_eq(err, -EPROTO);
+	// the rest of the bad answer must be skipped.
+	err = lightify_node_request_onoff(ctx, NULL, 1);
+	ck_assert_int_eq(err, 0);
+
+	// token 3: a stray answer for token 2 in front of ours.
+	len = sizeof(turnonlight_answer_broadcast);
+	memcpy(buf, turnonlight_answer_broadcast, len);
+	memcpy(buf + len, turnonlight_answer_broadcast, len);
+	buf[len + 4] = 3;
+	helper_mfs_setup_answer(mfs, buf, 2 * len);
+
+	err = lightify_node_request_onoff(ctx, NULL, 1);
+	ck_assert_int_eq(err, 0);
+
+	lightify_free(ctx);
+	free(mfs->buf_write);
+	free(mfs->buf_read);
+	free(mfs);
+
+}END_TEST
+
+Suite *liblightify_tst_framing(void) {
+	Suite *s;
+	TCase *tc;
+	s = suite_create("lightify_tst_framing");
+
+	/* Core test case */
+	tc = tcase_create("lightify_tst_framing_resync");
+
+	tcase_add_test(tc, lightify_tst_framing_resync);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
+
+START_TEST(lightify_tst_request_telegram) {
+
+	int err;
+	struct lightify_ctx *ctx;
+	struct fake_socket *mfs = calloc(1, sizeof(struct fake_socket));
+	unsigned char telegram[sizeof(setbright_query_node)];
+	unsigned char answer[sizeof(setbright_answer_node)];
+
+	err = lightify_new(&ctx, NULL);
+	ck_assert_int_eq(err, 0);
+	lightify_set_socket_fn(ctx, my_write_to_socket, my_read_from_socket);
+	lightify_set_userdata(ctx, mfs);
+
+	// prebuilt telegram without token; the library fills in the first one.
+	memcpy(telegram, setbright_query_node, sizeof(telegram));
+	memset(&telegram[4], 0, 4);
+	memcpy(answer, setbright_answer_node, sizeof(answer));
+	answer[4] = 1;
+	helper_mfs_setup_answer(mfs, answer, sizeof(answer));
+
+	err = lightify_request_telegram(ctx, telegram, sizeof(telegram));
+	ck_assert_int_eq(err, 0);
+	ck_assert_int_eq(mfs->size_write, sizeof(telegram));
+	ck_assert_int_eq(mfs->buf_write[4], 1);
+	ck_assert_int_eq(memcmp(mfs->buf_write + 8, setbright_query_node + 8,
+			sizeof(telegram) - 8), 0);
+
+	// unsupported command, wrong sizes
+	ck_assert_int_eq(lightify_request_telegram(ctx, telegram, sizeof(telegram) - 1), -EINVAL);
+	telegram[3] = 0x68;
+	ck_assert_int_eq(lightify_request_telegram(ctx, telegram, sizeof(telegram)), -EINVAL);
+	ck_assert_int_eq(lightify_request_telegram(NULL, telegram, sizeof(telegram)), -EINVAL);
+
+	lightify_free(ctx);
+	free(mfs->buf_write);
+	free(mfs->buf_read);
+	free(mfs);
+
+}END_TEST
+
+Suite *liblightify_tst_request_telegram(void) {
+	Suite *s;
+	TCase *tc;
+	s = suite_create("lightify_tst_request_telegram");
+
+	/* Core test case */
+	tc = tcase_create("lightify_tst_request_telegram");
+
+	tcase_add_test(tc, lightify_tst_request_telegram);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
+
+START_TEST(lightify_tst_batch) {
+
+	int err;
+	struct lightify_ctx *ctx;
+	struct lightify_batch *batch;
+	struct lightify_node *node;
+	struct fake_socket *mfs = calloc(1, sizeof(struct fake_socket));
+	unsigned char answers[3 * sizeof(turnonlight_answer_node)];
+	unsigned char *a;
+
+	err = lightify_new(&ctx, NULL);
+	ck_assert_int_eq(err, 0);
+	lightify_set_socket_fn(ctx, my_write_to_socket, my_read_from_socket);
+	lightify_set_userdata(ctx, mfs);
+
+	helper_mfs_setup_answer(mfs, scanfornodes_answer, sizeof(scanfornodes_answer));
+	ck_assert_int_eq(lightify_node_request_scan(ctx), 1);
+	node = lightify_node_get_next(ctx, NULL);
+
+	ck_assert_int_eq(lightify_batch_new(ctx, &batch), 0);
+	ck_assert_int_eq(lightify_batch_set_window(batch, 0), -EINVAL);
+	ck_assert_int_eq(lightify_batch_set_window(batch, 2), 0);
+	ck_assert_int_eq(lightify_batch_add_onoff(batch, node, NULL, 1), 0);
+	ck_assert_int_eq(lightify_batch_add_cct(batch, node, NULL, 3000, 0), 1);
+	ck_assert_int_eq(lightify_batch_add_onoff(batch, NULL, NULL, 0), 2);
+	ck_assert_int_eq(lightify_batch_get_count(batch), 3);
+	ck_assert_int_eq(lightify_batch_get_result(batch, 0), -EAGAIN);
+
+	// tokens 2, 3 and 4; the gateway answers the second telegram first.
+	a = answers;
+	memcpy(a, changecct_answer_node, sizeof(changecct_answer_node));
+	a[4] = 3;
+	a += sizeof(changecct_answer_node);
+	memcpy(a, turnonlight_answer_node, sizeof(turnonlight_answer_node));
+	a[4] = 2;
+	a += sizeof(turnonlight_answer_node);
+	memcpy(a, turnofflight_answer_broadcast, sizeof(turnofflight_answer_broadcast));
+	a[4] = 4;
+	helper_mfs_setup_answer(mfs, answers, sizeof(answers));
+
+	ck_assert_int_eq(lightify_batch_run(batch), 0);
+	ck_assert_int_eq(mfs->size_write, 2 * sizeof(turnonlight_query_node) + sizeof(changecct_query_node));
+	ck_assert_int_eq(lightify_batch_get_result(batch, 0), 0);
+	ck_assert_int_eq(lightify_batch_get_result(batch, 1), 0);
+	ck_assert_int_eq(lightify_batch_get_result(batch, 2), 0);
+	ck_assert_int_ge(lightify_batch_get_latency(batch, 2), 0);
+	ck_assert_int_eq(lightify_node_get_cct(node), 3000);
+	ck_assert_int_eq(lightify_node_is_on(node), 0);
+
+	// no answers at all: every command fails and the node becomes stale
+	lightify_batch_clear(batch);
+	lightify_batch_add_cct(batch, node, NULL, 2700, 0);
+	mfs->size_read = 0;
+	ck_assert_int_eq(lightify_batch_run(batch), 1);
+	ck_assert_int_lt(lightify_batch_get_result(batch, 0), 0);
+	ck_assert_int_eq(lightify_node_is_stale(node), 1);
+
+	lightify_batch_free(batch);
+	lightify_free(ctx);
+	free(mfs->buf_write);
+	free(mfs->buf_read);
+	free(mfs);
+
+}END_TEST
+
+Suite *liblightify_tst_batch(void) {
+	Suite *s;
+	TCase *tc;
+	s = suite_create("lightify_tst_batch");
+
+	/* Core test case */
+	tc = tcase_create("lightify_tst_batch");
+
+	tcase_add_test(tc, lightify_tst_batch);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
+
+START_TEST(lightify_tst_loops) {
+
+	int err, i;
+	struct lightify_ctx *ctx;
+	struct lightify_batch *batch;
+	struct lightify_node *node;
+	struct lightify_group *group;
+	struct fake_socket *mfs = calloc(1, sizeof(struct fake_socket));
+	struct lightify_color_loop_spec spec[15];
+	struct lightify_cct_loop_spec cctspec[15];
+	unsigned char answer[sizeof(turnonlight_answer_node)];
+	unsigned char groups[sizeof(req_getgroups_answer)];
+	unsigned char *msg, checksum = 0xff;
+
+	err = lightify_new(&ctx, NULL);
+	ck_assert_int_eq(err, 0);
+	lightify_set_socket_fn(ctx, my_write_to_socket, my_read_from_socket);
+	lightify_set_userdata(ctx, mfs);
+
+	helper_mfs_setup_answer(mfs, scanfornodes_answer, sizeof(scanfornodes_answer));
+	ck_assert_int_eq(lightify_node_request_scan(ctx), 1);
+	node = lightify_node_get_next(ctx, NULL);
+
+	for (i = 0; i < 15; i++) {
+		spec[i].delay = i ? 5 : 0x3c;
+		spec[i].hue = i * 17;
+		spec[i].saturation = 0xff;
+		spec[i].brightness = 0x80;
+	}
+
+	ck_assert_int_eq(lightify_batch_new(ctx, &batch), 0);
+	ck_assert_int_eq(lightify_batch_add_color_loop(batch, node, NULL, spec, 14, NULL), -EINVAL);
+	spec[0].delay = 0;
+	ck_assert_int_eq(lightify_batch_add_color_loop(batch, node, NULL, spec, 15, NULL), -EINVAL);
+	spec[0].delay = 0x3c;
+	ck_assert_int_eq(lightify_batch_add_color_loop(batch, node, NULL, spec, 15, NULL), 0);
+
+	memcpy(answer, turnonlight_answer_node, sizeof(answer));
+	answer[3] = 0xd8;
+	answer[4] = 2;
+	helper_mfs_setup_answer(mfs, answer, sizeof(answer));
+	ck_assert_int_eq(lightify_batch_run(batch), 0);
+
+	// header, MAC, 8 static bytes, 15 steps and the checksum
+	ck_assert_int_eq(mfs->size_write, 8 + 8 + 8 + 15 * 4 + 1);
+	msg = (unsigned char *) mfs->buf_write;
+	ck_assert_int_eq(msg[3], 0xd8);
+	ck_assert_int_eq(msg[24], 0x3c);
+	ck_assert_int_eq(msg[24 + 4 * 14 + 1], 14 * 17);
+	for (i = 25; i < 24 + 15 * 4; i++) checksum -= msg[i];
+	ck_assert_int_eq(msg[24 + 15 * 4], checksum);
+
+	// no node: the cct loop is broadcast
+	for (i = 0; i < 15; i++) {
+		cctspec[i].delay = i ? 5 : 0x3c;
+		cctspec[i].cct = 2700 + i * 100;
+		cctspec[i].brightness = 0x80;
+	}
+	answer[3] = 0xd9;
+	answer[4] = 3;
+	memset(&answer[11], 0xff, 8);
+	helper_mfs_setup_answer(mfs, answer, sizeof(answer));
+	ck_assert_int_eq(lightify_node_request_cct_loop(ctx, NULL, cctspec, 15, NULL), 0);
+	msg = (unsigned char *) mfs->buf_write;
+	ck_assert_int_eq(msg[2], 0);
+	ck_assert_int_eq(msg[3], 0xd9);
+	for (i = 8; i < 16; i++) ck_assert_int_eq(msg[i], 0xff);
+
+	// group-wide loops are addressed to the group id
+	memcpy(groups, req_getgroups_answer, sizeof(groups));
+	groups[4] = 4;
+	helper_mfs_setup_answer(mfs, groups, sizeof(groups));
+	ck_assert_int_eq(lightify_group_request_scan(ctx), 3);
+	group = lightify_group_get_next(ctx, NULL);
+	ck_assert_int_eq(lightify_group_get_id(group), 1);
+
+	ck_assert_int_eq(lightify_group_request_color_loop(ctx, NULL, spec, 15, NULL), -EINVAL);
+	ck_assert_int_eq(lightify_group_request_cct_loop(ctx, NULL, cctspec, 15, NULL), -EINVAL);
+
+	answer[3] = 0xd8;
+	answer[4] = 5;
+	memset(&answer[11], 0, 8);
+	answer[11] = 1;
+	helper_mfs_setup_answer(mfs, answer, sizeof(answer));
+	ck_assert_int_eq(lightify_group_request_color_loop(ctx, group, spec, 15, NULL), 0);
+	msg = (unsigned char *) mfs->buf_write;
+	ck_assert_int_eq(mfs->size_write, 8 + 8 + 8 + 15 * 4 + 1);
+	ck_assert_int_eq(msg[2], 0x02);
+	ck_assert_int_eq(msg[3], 0xd8);
+	ck_assert_int_eq(msg[8], 1);
+	for (i = 9; i < 16; i++) ck_assert_int_eq(msg[i], 0);
+
+	answer[3] = 0xd9;
+	answer[4] = 6;
+	helper_mfs_setup_answer(mfs, answer, sizeof(answer));
+	ck_assert_int_eq(lightify_group_request_cct_loop(ctx, group, cctspec, 15, NULL), 0);
+	msg = (unsigned char *) mfs->buf_write;
+	ck_assert_int_eq(msg[2], 0x02);
+	ck_assert_int_eq(msg[3], 0xd9);
+	ck_assert_int_eq(msg[8], 1);
+	for (i = 9; i < 16; i++) ck_assert_int_eq(msg[i], 0);
+
+	lightify_batch_free(batch);
+	lightify_free(ctx);
+	free(mfs->buf_write);
+	free(mfs->buf_read);
+	free(mfs);
+
+}END_TEST
+
+Suite *liblightify_tst_loops(void) {
+	Suite *s;
+	TCase *tc;
+	s = suite_create("lightify_tst_loops");
+
+	/* Core test case */
+	tc = tcase_create("lightify_tst_loops");
+
+	tcase_add_test(tc, lightify_tst_loops);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
+
+START_TEST(lightify_tst_color) {
+
+	struct lightify_hsv hsv[4] = {
+		{ 0, 0xff, 0xff }, { 85, 0xff, 0xff }, { 170, 0xff, 0x80 }, { 42, 0, 0xff },
+	};
+	struct lightify_rgbw rgbw, frame[4];
+	uint16_t cct[3] = { 500, 2750, 6600 };
+	uint8_t levels[3] = { 0, 128, 255 };
+	int i;
+
+	ck_assert_int_eq(lightify_color_hsv_to_rgbw(&hsv[0], NULL), -EINVAL);
+	ck_assert_int_eq(lightify_color_hsv_to_rgbw(&hsv[0], &rgbw), 0);
+	ck_assert_int_eq(rgbw.red, 0xff);
+	ck_assert_int_eq(rgbw.green, 0);
+	ck_assert_int_eq(rgbw.blue, 0);
+	ck_assert_int_eq(rgbw.white, 0);
+
+	// no saturation: all on the white channel
+	ck_assert_int_eq(lightify_color_hsv_to_rgbw(&hsv[3], &rgbw), 0);
+	ck_assert_int_eq(rgbw.red + rgbw.green + rgbw.blue, 0);
+	ck_assert_int_eq(rgbw.white, 0xff);
+
+	// the frame variant gives the same results
+	ck_assert_int_eq(lightify_color_hsv_to_rgbw_n(hsv, frame, 4), 0);
+	for (i = 0; i < 4; i++) {
+		lightify_color_hsv_to_rgbw(&hsv[i], &rgbw);
+		ck_assert(0 == memcmp(&rgbw, &frame[i], sizeof(rgbw)));
+	}
+	ck_assert_int_eq(frame[1].green, 0xff);
+	ck_assert_int_eq(frame[2].blue, 0x80);
+
+	// clamped below the table, white at about 6600K
+	ck_assert_int_eq(lightify_color_cct_to_rgbw_n(cct, frame, 3), 0);
+	ck_assert_int_eq(frame[0].red, 0xff);
+	ck_assert_int_eq(frame[0].blue, 0);
+	ck_assert_int_ge(frame[1].green, 0xa0);
+	ck_assert_int_le(frame[1].green, 0xb0);
+	ck_assert_int_eq(frame[2].red, 0xff);
+	ck_assert_int_ge(frame[2].blue, 0xf0);
+
+	ck_assert_int_eq(lightify_color_gamma(0), 0);
+	ck_assert_int_eq(lightify_color_gamma(255), 255);
+	ck_assert_int_eq(lightify_color_gamma_n(levels, levels, 3), 0);
+	ck_assert_int_lt(levels[1], 64);
+	ck_assert_int_eq(levels[2], 255);
+
+}END_TEST
+
+Suite *liblightify_tst_color(void) {
+	Suite *s;
+	TCase *tc;
+	s = suite_create("lightify_tst_color");
+
+	/* Core test case */
+	tc = tcase_create("lightify_tst_color");
+
+	tcase_add_test(tc, lightify_tst_color);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
+
+START_TEST(lightify_tst_snapshots) {
+
+	struct lightify_ctx *ctx;
+	struct lightify_node *node;
+	struct fake_socket *mfs = calloc(1, sizeof(struct fake_socket));
+	const struct lightify_snapshot *snap1, *snap2, *snap3;
+	const struct lightify_node_state *st;
+	unsigned char answer[sizeof(turnonlight_answer_node)];
+	size_t count;
+	int r1, r2, r3;
+
+	ck_assert_int_eq(lightify_new(&ctx, NULL), 0);
+	lightify_set_socket_fn(ctx, my_write_to_socket, my_read_from_socket);
+	lightify_set_userdata(ctx, mfs);
+
+	ck_assert_int_eq(lightify_snapshot_acquire(ctx, &snap1), -ENODATA);
+
+	helper_mfs_setup_answer(mfs, scanfornodes_answer, sizeof(scanfornodes_answer));
+	ck_assert_int_eq(lightify_node_request_scan(ctx), 1);
+	node = lightify_node_get_next(ctx, NULL);
+
+	ck_assert_int_eq(lightify_snapshot_publish(ctx), 0);
+	r1 = lightify_snapshot_acquire(ctx, &snap1);
+	ck_assert_int_ge(r1, 0);
+	ck_assert(lightify_snapshot_get_version(snap1) == 1);
+	st = lightify_snapshot_get_nodes(snap1, &count);
+	ck_assert_int_eq(count, 1);
+	ck_assert_int_eq(strcmp(st[0].name, "Licht 01"), 0);
+	ck_assert_int_eq(st[0].is_on, 0);
+
+	// a change is published as a new version, the old one stays intact
+	memcpy(answer, turnonlight_answer_node, sizeof(answer));
+	answer[4] = 2;
+	helper_mfs_setup_answer(mfs, answer, sizeof(answer));
+	ck_assert_int_eq(lightify_node_request_onoff(ctx, node, 1), 0);
+	ck_assert_int_eq(lightify_snapshot_publish(ctx), 0);
+
+	r2 = lightify_snapshot_acquire(ctx, &snap2);
+	ck_assert_int_ge(r2, 0);
+	ck_assert_int_ne(r1, r2);
+	ck_assert(lightify_snapshot_get_version(snap2) == 2);
+	ck_assert_int_eq(lightify_snapshot_get_nodes(snap2, NULL)[0].is_on, 1);
+	ck_assert_int_eq(lightify_snapshot_get_nodes(snap1, NULL)[0].is_on, 0);
+	ck_assert(lightify_snapshot_get_nodes(snap1, NULL)[0].node_address == 0xdeadbeef12345678);
+
+	// without changes, there is no new version
+	ck_assert_int_eq(lightify_snapshot_release(ctx, r1), 0);
+	ck_assert_int_eq(lightify_snapshot_publish(ctx), 0);
+	r3 = lightify_snapshot_acquire(ctx, &snap3);
+	ck_assert_ptr_eq(snap2, snap3);
+
+	ck_assert_int_eq(lightify_snapshot_release(ctx, r2), 0);
+	ck_assert_int_eq(lightify_snapshot_release(ctx, r3), 0);
+	ck_assert_int_eq(lightify_snapshot_release(ctx, -1), -EINVAL);
+
+	lightify_free(ctx);
+	free(mfs->buf_write);
+	free(mfs->buf_read);
+	free(mfs);
+
+}END_TEST
+
+Suite *liblightify_tst_snapshots(void) {
+	Suite *s;
+	TCase *tc;
+	s = suite_create("lightify_tst_snapshots");
+
+	/* Core test case */
+	tc = tcase_create("lightify_tst_snapshots");
+
+	tcase_add_test(tc, lightify_tst_snapshots);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
+
+START_TEST(lightify_tst_shm) {
+
+	struct lightify_ctx *ctx;
+	struct fake_socket *mfs = calloc(1, sizeof(struct fake_socket));
+	struct lightify_shm *shm;
+	struct lightify_node_state nodes[2];
+	struct lightify_group_state groups[4];
+	unsigned char answer[sizeof(req_getgroups_answer)];
+	char name[64];
+
+	snprintf(name, sizeof(name), "/lightify-test-%d", (int) getpid());
+
+	ck_assert_int_eq(lightify_new(&ctx, NULL), 0);
+	lightify_set_socket_fn(ctx, my_write_to_socket, my_read_from_socket);
+	lightify_set_userdata(ctx, mfs);
+
+	helper_mfs_setup_answer(mfs, scanfornodes_answer, sizeof(scanfornodes_answer));
+	ck_assert_int_eq(lightify_node_request_scan(ctx), 1);
+
+	ck_assert_int_eq(lightify_shm_publish(ctx, NULL), -EINVAL);
+	ck_assert_int_eq(lightify_shm_publish(ctx, name), 0);
+
+	ck_assert_int_eq(lightify_attach_shm(name, &shm), 0);
+	ck_assert(lightify_shm_get_generation(shm) == 1);
+	ck_assert_int_eq(lightify_shm_get_nodes(shm, nodes, 2), 1);
+	ck_assert_int_eq(strcmp(nodes[0].name, "Licht 01"), 0);
+	ck_assert(nodes[0].node_address == 0xdeadbeef12345678);
+	ck_assert_int_eq(lightify_shm_get_groups(shm, groups, 4), 0);
+
+	// the owner updates, the segment grows for the groups
+	memcpy(answer, req_getgroups_answer, sizeof(answer));
+	answer[4] = 2;
+	helper_mfs_setup_answer(mfs, answer, sizeof(answer));
+	ck_assert_int_eq(lightify_group_request_scan(ctx), 3);
+	ck_assert_int_eq(lightify_shm_publish(ctx, NULL), 0);
+
+	ck_assert(lightify_shm_get_generation(shm) == 2);
+	ck_assert_int_eq(lightify_shm_get_groups(shm, groups, 4), 3);
+	ck_assert_int_eq(strcmp(groups[1].name, "Gruppe2"), 0);
+	ck_assert_int_eq(groups[0].member_count, 1);
+	ck_assert_int_eq(lightify_shm_get_nodes(shm, nodes, 2), 1);
+	ck_assert(nodes[0].node_address == 0xdeadbeef12345678);
+
+	ck_assert_int_eq(lightify_detach_shm(shm), 0);
+	lightify_free(ctx);
+	ck_assert_int_eq(lightify_attach_shm(name, &shm), -ENOENT);
+
+	free(mfs->buf_write);
+	free(mfs->buf_read);
+	free(mfs);
+
+}END_TEST
+
+Suite *liblightify_tst_shm(void) {
+	Suite *s;
+	TCase *tc;
+	s = suite_create("lightify_tst_shm");
+
+	/* Core test case */
+	tc = tcase_create("lightify_tst_shm");
+
+	tcase_add_test(tc, lightify_tst_shm);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
+
+START_TEST(lightify_tst_cache_ttl) {
+
+	struct lightify_ctx *ctx;
+	struct fake_socket *mfs = calloc(1, sizeof(struct fake_socket));
+	struct lightify_node *node;
+	struct timeval tv;
+	unsigned char nodes[sizeof(scanfornodes_answer)];
+	unsigned char groups[sizeof(req_getgroups_answer)];
+
+	ck_assert_int_eq(lightify_new(&ctx, NULL), 0);
+	lightify_set_socket_fn(ctx, my_write_to_socket, my_read_from_socket);
+	lightify_set_userdata(ctx, mfs);
+
+	tv.tv_sec = -1;
+	tv.tv_usec = 0;
+	ck_assert_int_eq(lightify_set_cache_ttl(ctx, tv), -EINVAL);
+	ck_assert_int_eq(lightify_set_cache_ttl(NULL, tv), -EINVAL);
+	ck_assert_int_eq(lightify_cache_invalidate(NULL), -EINVAL);
+	tv.tv_sec = 60;
+	ck_assert_int_eq(lightify_set_cache_ttl(ctx, tv), 0);
+
+	helper_mfs_setup_answer(mfs, scanfornodes_answer, sizeof(scanfornodes_answer));
+	ck_assert_int_eq(lightify_node_request_scan(ctx), 1);
+	node = lightify_node_get_next(ctx, NULL);
+	ck_assert_ptr_ne(node, NULL);
+
+	// within the ttl: nothing on the wire, the node pointer stays valid
+	helper_mfs_setup_answer(mfs, scanfornodes_answer, sizeof(scanfornodes_answer));
+	ck_assert_int_eq(lightify_node_request_scan(ctx), 1);
+	ck_assert_int_eq(mfs->size_write, 0);
+	ck_assert_ptr_eq(lightify_node_get_next(ctx, NULL), node);
+
+	// the group cache ages on its own
+	memcpy(groups, req_getgroups_answer, sizeof(groups));
+	groups[4] = 2;
+	helper_mfs_setup_answer(mfs, groups, sizeof(groups));
+	ck_assert_int_eq(lightify_group_request_scan(ctx), 3);
+	ck_assert_int_eq(mfs->size_write, sizeof(req_getgroups));
+	helper_mfs_setup_answer(mfs, groups, sizeof(groups));
+	ck_assert_int_eq(lightify_group_request_scan(ctx), 3);
+	ck_assert_int_eq(mfs->size_write, 0);
+
+	// forced refresh
+	memcpy(nodes, scanfornodes_answer, sizeof(nodes));
+	nodes[4] = 3;
+	helper_mfs_setup_answer(mfs, nodes, sizeof(nodes));
+	ck_assert_int_eq(lightify_cache_invalidate(ctx), 0);
+	ck_assert_int_eq(lightify_node_request_scan(ctx), 1);
+	ck_assert_int_eq(mfs->size_write, sizeof(scanfornodes_query));
+
+	// ttl zero: always scan
+	tv.tv_sec = 0;
+	ck_assert_int_eq(lightify_set_cache_ttl(ctx, tv), 0);
+	nodes[4] = 4;
+	helper_mfs_setup_answer(mfs, nodes, sizeof(nodes));
+	ck_assert_int_eq(lightify_node_request_scan(ctx), 1);
+	ck_assert_int_eq(mfs->size_write, sizeof(scanfornodes_query));
+
+	lightify_free(ctx);
+	free(mfs->buf_write);
+	free(mfs->buf_read);
+	free(mfs);
+
+}END_TEST
+
+Suite *liblightify_tst_cache(void) {
+	Suite *s;
+	TCase *tc;
+	s = suite_create("lightify_tst_cache");
+
+	/* Core test case */
+	tc = tcase_create("lightify_tst_cache_ttl");
+
+	tcase_add_test(tc, lightify_tst_cache_ttl);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
+
+// nodes ...00, ...01 and ...02: the first two in group 1, the last in group 2.
+// Uses the tokens 1 and 2.
+static void helper_three_nodes(struct fake_socket *mfs, struct lightify_ctx **pctx) {
+	struct lightify_ctx *ctx;
+	unsigned char nodes[11 + 3 * 42];
+	unsigned char groups[sizeof(req_getgroups_answer)];
+	unsigned char *msg;
+	int i;
+
+	ck_assert_int_eq(lightify_new(&ctx, NULL), 0);
+	lightify_set_socket_fn(ctx, my_write_to_socket, my_read_from_socket);
+	lightify_set_userdata(ctx, mfs);
+	*pctx = ctx;
+
+	memcpy(nodes, scanfornodes_answer, 11);
+	nodes[0] = sizeof(nodes) - 2;
+	nodes[9] = 3;
+	for (i = 0; i < 3; i++) {
+		msg = &nodes[11 + i * 42];
+		memcpy(msg, &scanfornodes_answer[11], 42);
+		msg[2] = i;
+		msg[16] = (i < 2) ? 0x01 : 0x02;
+		msg[17] = 0;
+	}
+	helper_mfs_setup_answer(mfs, nodes, sizeof(nodes));
+	ck_assert_int_eq(lightify_node_request_scan(ctx), 3);
+	memcpy(groups, req_getgroups_answer, sizeof(groups));
+	groups[4] = 2;
+	helper_mfs_setup_answer(mfs, groups, sizeof(groups));
+	ck_assert_int_eq(lightify_group_request_scan(ctx), 3);
+}
+
+START_TEST(lightify_tst_reconcile) {
+
+	struct lightify_ctx *ctx;
+	struct lightify_batch *batch;
+	struct fake_socket *mfs = calloc(1, sizeof(struct fake_socket));
+	struct lightify_desired_state want[3];
+	unsigned char answer[sizeof(turnonlight_answer_broadcast)];
+	unsigned char *msg;
+	int i;
+
+	helper_three_nodes(mfs, &ctx);
+
+	memset(want, 0, sizeof(want));
+	for (i = 0; i < 3; i++) {
+		want[i].node_address = 0xdeadbeef12345600ULL | i;
+		want[i].fields = LIGHTIFY_STATE_ONOFF;
+		want[i].is_on = 1;
+	}
+
+	ck_assert_int_eq(lightify_reconcile(NULL, want, 3, 0), -EINVAL);
+	want[2].node_address = 42;
+	ck_assert_int_eq(lightify_reconcile(ctx, want, 3, 0), -ENOENT);
+	want[2].node_address = want[1].node_address;
+	ck_assert_int_eq(lightify_reconcile(ctx, want, 3, 0), -EINVAL);
+	want[2].node_address = 0xdeadbeef12345602ULL;
+
+	// all off, everyone wants on: one broadcast
+	memcpy(answer, turnonlight_answer_broadcast, sizeof(answer));
+	answer[4] = 3;
+	helper_mfs_setup_answer(mfs, answer, sizeof(answer));
+	ck_assert_int_eq(lightify_reconcile(ctx, want, 3, 0), 0);
+	ck_assert_int_eq(mfs->size_write, sizeof(turnonlight_query_broadcast));
+	msg = (unsigned char *) mfs->buf_write;
+	ck_assert_int_eq(msg[3], 0x32);
+	ck_assert_int_eq(msg[8], 0xff);
+	ck_assert_int_eq(lightify_node_is_on(lightify_node_get_from_mac(ctx, want[2].node_address)), 1);
+
+	// nothing to do
+	helper_mfs_setup_answer(mfs, answer, sizeof(answer));
+	ck_assert_int_eq(lightify_reconcile(ctx, want, 3, 0), 0);
+	ck_assert_int_eq(mfs->size_write, 0);
+
+	// group 1 gets one cct, node 2 alone is cheaper on its own;
+	// dimming node 1 to 0 switches it off without an extra telegram.
+	ck_assert_int_eq(lightify_batch_new(ctx, &batch), 0);
+	for (i = 0; i < 3; i++) {
+		want[i].fields = LIGHTIFY_STATE_CCT;
+		want[i].cct = (i < 2) ? 3000 : 4000;
+	}
+	want[1].fields |= LIGHTIFY_STATE_ONOFF | LIGHTIFY_STATE_BRIGHTNESS;
+	want[1].is_on = 0;
+	want[1].brightness = 0;
+	ck_assert_int_eq(lightify_reconcile_plan(ctx, want, 3, 0, batch), 3);
+	ck_assert_int_eq(lightify_batch_get_count(batch), 3);
+
+	want[1].fields = LIGHTIFY_STATE_CCT | 0x100;
+	ck_assert_int_eq(lightify_reconcile_plan(ctx, want, 3, 0, batch), -EINVAL);
+
+	lightify_batch_free(batch);
+	lightify_free(ctx);
+	free(mfs->buf_write);
+	free(mfs->buf_read);
+	free(mfs);
+
+}END_TEST
+
+Suite *liblightify_tst_reconcile(void) {
+	Suite *s;
+	TCase *tc;
+	s = suite_create("lightify_tst_reconcile");
+
+	/* Core test case */
+	tc = tcase_create("lightify_tst_reconcile");
+
+	tcase_add_test(tc, lightify_tst_reconcile);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
+
+START_TEST(lightify_tst_vgroup) {
+
+	struct lightify_ctx *ctx;
+	struct lightify_vgroup *vg;
+	struct lightify_node *node;
+	struct fake_socket *mfs = calloc(1, sizeof(struct fake_socket));
+	unsigned char answers[2 * sizeof(turnonlight_answer_node)];
+	unsigned char *msg;
+
+	helper_three_nodes(mfs, &ctx);
+
+	ck_assert_int_eq(lightify_vgroup_new(ctx, NULL, &vg), -EINVAL);
+	ck_assert_int_eq(lightify_vgroup_new(ctx, "a zone with a long name", &vg), 0);
+	ck_assert_str_eq(lightify_vgroup_get_name(vg), "a zone with a long name");
+	ck_assert_int_eq(lightify_vgroup_add_node(vg, 0xdeadbeef12345601ULL), 0);
+	ck_assert_int_eq(lightify_vgroup_add_node(vg, 0xdeadbeef12345600ULL), 0);
+	ck_assert_int_eq(lightify_vgroup_add_node(vg, 0xdeadbeef12345600ULL), 0);
+	ck_assert_int_eq(lightify_vgroup_add_node(vg, 42), 0);
+	ck_assert_int_eq(lightify_vgroup_get_member_count(vg), 3);
+	ck_assert_int_eq(lightify_vgroup_remove_node(vg, 43), -ENOENT);
+	ck_assert_int_eq(lightify_vgroup_remove_node(vg, 42), 0);
+
+	node = lightify_vgroup_get_next_node(vg, NULL);
+	ck_assert(lightify_node_get_nodeadr(node) == 0xdeadbeef12345600ULL);
+	node = lightify_vgroup_get_next_node(vg, node);
+	ck_assert(lightify_node_get_nodeadr(node) == 0xdeadbeef12345601ULL);
+	ck_assert_ptr_eq(lightify_vgroup_get_next_node(vg, node), NULL);
+
+	// exactly group 1: one group telegram
+	memcpy(answers, turnonlight_answer_node, sizeof(turnonlight_answer_node));
+	answers[4] = 3;
+	memset(&answers[11], 0, 8);
+	answers[11] = 1;
+	helper_mfs_setup_answer(mfs, answers, sizeof(turnonlight_answer_node));
+	ck_assert_int_eq(lightify_vgroup_request_onoff(ctx, vg, 1), 0);
+	ck_assert_int_eq(mfs->size_write, sizeof(turnonlight_query_node));
+	msg = (unsigned char *) mfs->buf_write;
+	ck_assert_int_eq(msg[2], 2);
+	ck_assert_int_eq(msg[8], 1);
+	ck_assert_int_eq(lightify_node_is_on(node), 1);
+
+	// node 0 and node 2 share no group: two node telegrams
+	ck_assert_int_eq(lightify_vgroup_remove_node(vg, 0xdeadbeef12345601ULL), 0);
+	ck_assert_int_eq(lightify_vgroup_add_node(vg, 0xdeadbeef12345602ULL), 0);
+	memcpy(answers, turnonlight_answer_node, sizeof(turnonlight_answer_node));
+	answers[4] = 4;
+	answers[11] = 0x00;
+	memcpy(answers + sizeof(turnonlight_answer_node), turnonlight_answer_node,
+			sizeof(turnonlight_answer_node));
+	answers[sizeof(turnonlight_answer_node) + 4] = 5;
+	answers[sizeof(turnonlight_answer_node) + 11] = 0x02;
+	helper_mfs_setup_answer(mfs, answers, sizeof(answers));
+	ck_assert_int_eq(lightify_vgroup_request_onoff(ctx, vg, 1), 0);
+	ck_assert_int_eq(mfs->size_write, 2 * sizeof(turnonlight_query_node));
+	msg = (unsigned char *) mfs->buf_write;
+	ck_assert_int_eq(msg[2], 0);
+	ck_assert_int_eq(msg[sizeof(turnonlight_query_node) + 8], 0x02);
+
+	ck_assert_int_eq(lightify_vgroup_free(vg), 0);
+	lightify_free(ctx);
+	free(mfs->buf_write);
+	free(mfs->buf_read);
+	free(mfs);
+
+}END_TEST
+
+Suite *liblightify_tst_vgroup(void) {
+	Suite *s;
+	TCase *tc;
+	s = suite_create("lightify_tst_vgroup");
+
+	/* Core test case */
+	tc = tcase_create("lightify_tst_vgroup");
+
+	tcase_add_test(tc, lightify_tst_vgroup);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
+
+START_TEST(lightify_tst_nodes_export) {
+
+	struct lightify_ctx *ctx;
+	struct fake_socket *mfs = calloc(1, sizeof(struct fake_socket));
+	struct lightify_node_state state[2];
+
+	ck_assert_int_eq(lightify_new(&ctx, NULL), 0);
+	lightify_set_socket_fn(ctx, my_write_to_socket, my_read_from_socket);
+	lightify_set_userdata(ctx, mfs);
+
+	// nothing scanned yet
+	ck_assert_int_eq(lightify_nodes_export(ctx, NULL, 0), 0);
+	ck_assert_int_eq(lightify_nodes_export(NULL, state, 2), -EINVAL);
+
+	helper_mfs_setup_answer(mfs, scanfornodes_answer, sizeof(scanfornodes_answer));
+	ck_assert_int_eq(lightify_node_request_scan(ctx), 1);
+
+	ck_assert_int_eq(lightify_nodes_export(ctx, NULL, 0), 1);
+	ck_assert_int_eq(lightify_nodes_export(ctx, NULL, 2), -EINVAL);
+	ck_assert_int_eq(lightify_nodes_export(ctx, state, 2), 1);
+	ck_assert_int_eq(strcmp("Licht 01", state[0].name), 0);
+	ck_assert(state[0].node_address == 0xdeadbeef12345678);
+	ck_assert_uint_eq(state[0].group_address, 0xabcd);
+	ck_assert_int_eq(state[0].cct, 2702);
+	ck_assert_int_eq(state[0].white, 0xf3);
+	ck_assert(state[0].fwversion == 0x01020307);
+
+	// only the selected fields are written
+	memset(state, 0, sizeof(state));
+	ck_assert_int_eq(lightify_nodes_export_masked(ctx, state, 1, LIGHTIFY_STATE_CCT), 1);
+	ck_assert_int_eq(state[0].cct, 2702);
+	ck_assert_int_eq(state[0].red, 0);
+	ck_assert_int_eq(state[0].name[0], 0);
+
+	lightify_free(ctx);
+	free(mfs->buf_write);
+	free(mfs->buf_read);
+	free(mfs);
+
+}END_TEST
+
+Suite *liblightify_tst_nodes_export(void) {
+	Suite *s;
+	TCase *tc;
+	s = suite_create("lightify_tst_nodes_export");
+
+	/* Core test case */
+	tc = tcase_create("lightify_tst_nodes_export");
+
+	tcase_add_test(tc, lightify_tst_nodes_export);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
+
+START_TEST(lightify_tst_nodes_diff) {
+
+	struct lightify_node_state snap[2][70];
+	struct lightify_node_delta delta[2];
+	uint64_t bitmap[2];
+
+	memset(snap, 0, sizeof(snap));
+	snap[0][0].node_address = 0xdeadbeef12345678;
+	snap[0][0].cct = 2702;
+	strcpy(snap[0][0].name, "Licht 01");
+	memcpy(snap[1], snap[0], sizeof(snap[0]));
+
+	ck_assert_int_eq(lightify_nodes_diff(snap[0], snap[1], 70, bitmap, delta, 2), 0);
+	ck_assert(bitmap[0] == 0 && bitmap[1] == 0);
+
+	// garbage after the end of the name is no change
+	snap[1][0].name[10] = 'x';
+	ck_assert_int_eq(lightify_nodes_diff(snap[0], snap[1], 70, NULL, NULL, 0), 0);
+
+	snap[1][0].cct = 4000;
+	snap[1][0].is_on = 1;
+	snap[1][65].name[0] = 'x';
+	ck_assert_int_eq(lightify_nodes_diff(snap[0], snap[1], 70, bitmap, delta, 1), 2);
+	ck_assert(bitmap[0] == 1 && bitmap[1] == 2);
+	ck_assert_uint_eq(delta[0].index, 0);
+	ck_assert_uint_eq(delta[0].fields, LIGHTIFY_STATE_CCT | LIGHTIFY_STATE_ONOFF);
+	ck_assert_int_eq(lightify_nodes_diff(snap[0], snap[1], 70, NULL, delta, 2), 2);
+	ck_assert_uint_eq(delta[1].index, 65);
+	ck_assert_uint_eq(delta[1].fields, LIGHTIFY_STATE_NAME);
+
+	ck_assert_int_eq(lightify_nodes_diff(NULL, snap[1], 70, NULL, NULL, 0), -EINVAL);
+	ck_assert_int_eq(lightify_nodes_diff(snap[0], snap[1], 70, NULL, NULL, 2), -EINVAL);
+	ck_assert_int_eq(lightify_nodes_diff(NULL, NULL, 0, NULL, NULL, 0), 0);
+
+}END_TEST
+
+Suite *liblightify_tst_nodes_diff(void) {
+	Suite *s;
+	TCase *tc;
+	s = suite_create("lightify_tst_nodes_diff");
+
+	/* Core test case */
+	tc = tcase_create("lightify_tst_nodes_diff");
+
+	tcase_add_test(tc, lightify_tst_nodes_diff);
+	suite_add_tcase(s, tc);
+
+	return s;
+}
 
 int main(void) {
 	int number_failed;
@@ -799,6 +2058,21 @@ int main(void) {
 	srunner_add_suite(sr, liblightify_functional_nodes());
 	srunner_add_suite(sr, liblightify_functional_manipulate_node());
 	srunner_add_suite(sr, liblightify_tst_groups_basic());
+	srunner_add_suite(sr, liblightify_tst_capture());
+	srunner_add_suite(sr, liblightify_tst_conn());
+	srunner_add_suite(sr, liblightify_tst_wait());
+	srunner_add_suite(sr, liblightify_tst_framing());
+	srunner_add_suite(sr, liblightify_tst_request_telegram());
+	srunner_add_suite(sr, liblightify_tst_batch());
+	srunner_add_suite(sr, liblightify_tst_loops());
+	srunner_add_suite(sr, liblightify_tst_color());
+	srunner_add_suite(sr, liblightify_tst_snapshots());
+	srunner_add_suite(sr, liblightify_tst_shm());
+	srunner_add_suite(sr, liblightify_tst_cache());
+	srunner_add_suite(sr, liblightify_tst_reconcile());
+	srunner_add_suite(sr, liblightify_tst_vgroup());
+	srunner_add_suite(sr, liblightify_tst_nodes_export());
+	srunner_add_suite(sr, liblightify_tst_nodes_diff());
 
 	srunner_set_tap(sr, "-");
 	srunner_set_fork_status(sr, CK_NOFORK);
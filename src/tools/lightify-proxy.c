@@ -0,0 +1,714 @@
+/*
+ liblightify -- library to control OSRAM's LIGHTIFY
+
+ Copyright (c) 2015, Tobias Frost <tobi@coldtobi.de>
+ All rights reserved.
+
+ Redistribution and use in source and binary forms, with or without
+ modification, are permitted provided that the following conditions are met:
+
+ * Redistributions of source code must retain the above copyright
+ notice, this list of conditions and the following disclaimer.
+
+ * Redistributions in binary form must reproduce the above copyright
+ notice, this list of conditions and the following disclaimer in the
+ documentation and/or other materials provided with the distribution.
+
+ * Neither the name of the author nor the
+ names of its contributors may be used to endorse or promote products
+ derived from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* lightify-proxy: let many clients share one gateway connection.
+ *
+ * Clients connect to the proxy as if it was the gateway. Their telegrams
+ * get a proxy-wide unique token and are pipelined onto the single upstream
+ * connection; the answers are routed back by that token, with the client's
+ * own token restored.
+ *
+ * Answers to the scans (0x13 nodes, 0x1e groups) are kept for a while and
+ * served from memory. Any other command might change the state, so it
+ * invalidates them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <netdb.h>
+#include <string.h>
+
+#include <unistd.h>
+
+#include <fcntl.h>
+
+#include <getopt.h>
+#include <time.h>
+#include <stdint.h>
+
+#include <errno.h>
+
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+
+/* protocol header: length (2 bytes, without the length itself), flags,
+ * command, token (4 bytes) */
+#define HDR_SIZE (8)
+#define HDR_CMD (3)
+#define HDR_TOKEN (4)
+#define FRAME_MAX (0xffff + 2)
+
+#define MAX_CLIENTS (64)
+#define MAX_INFLIGHT (64)
+#define MAX_CACHE (8)
+#define CACHE_KEY_MAX (32)
+/* limit of unsent answers per client before it is dropped */
+#define CLIENT_OUT_MAX (256 * 1024)
+/* give up on an answer after that many seconds */
+#define ANSWER_TIMEOUT (10)
+/* give up on connecting to the gateway after that many seconds */
+#define CONNECT_TIMEOUT (5)
+/* wait between connection attempts, doubled up to the maximum */
+#define RETRY_MIN (1)
+#define RETRY_MAX (30)
+
+/* Flag set by ‘--verbose’. */
+static int verbose_flag;
+
+static struct option long_options[] = {
+/* These options set a flag. */
+{ "verbose", no_argument, &verbose_flag, 1 },
+{ "brief", no_argument,   &verbose_flag, 0 },
+/* These options don’t set a flag.
+ We distinguish them by their indices. */
+{ "host", required_argument, 0, 'h' },
+{ "port", required_argument, 0, 'p' },
+{ "listen", required_argument, 0, 'l' },
+{ "bind", required_argument, 0, 'b' },
+{ "cache", required_argument, 0, 'c' },
+{ "window", required_argument, 0, 'w' },
+{ 0, 0, 0, 0 }
+};
+
+char *host_data = NULL;
+char *port_data = "4000";
+char *listen_port = "4000";
+char *bind_addr = "127.0.0.1";
+int cache_ttl = 5;
+unsigned int window = 8;
+
+struct buffer {
+	unsigned char *data;
+	size_t len;
+	size_t cap;
+};
+
+struct client {
+	int fd;
+	/* incremented when the slot is reused: late answers for the
+	 * previous client must not go to the new one */
+	unsigned int gen;
+	struct buffer in;
+	struct buffer out;
+};
+
+/* telegram waiting for a free slot in the window */
+struct request {
+	struct request *next;
+	int client;
+	unsigned int gen;
+	time_t queued;
+	size_t len;
+	unsigned char msg[];
+};
+
+/* telegram sent upstream, waiting for its answer */
+struct inflight {
+	int used;
+	uint32_t token;
+	int client;
+	unsigned int gen;
+	uint32_t client_token;
+	time_t sent;
+	/* what to cache the answer under, keylen 0 if not cacheable */
+	unsigned char key[CACHE_KEY_MAX];
+	size_t keylen;
+	/* cache_gen when sent; if it changed, the answer may be outdated */
+	unsigned int cache_gen;
+};
+
+struct cache_entry {
+	unsigned char key[CACHE_KEY_MAX];
+	size_t keylen;
+	unsigned char *answer;
+	size_t len;
+	time_t stored;
+};
+
+static struct client clients[MAX_CLIENTS];
+static struct inflight inflight[MAX_INFLIGHT];
+static unsigned int inflight_count;
+static struct request *queue_head, *queue_tail;
+static struct cache_entry cache[MAX_CACHE];
+/* bumped on every invalidation */
+static unsigned int cache_gen;
+
+static int upstream = -1;
+static struct buffer up_in, up_out;
+/* the gateway's addresses, resolved once at start */
+static struct addrinfo *up_addrs;
+/* the address to try next, NULL to start over */
+static struct addrinfo *up_next;
+/* upstream is a connect in progress, started at up_started */
+static int up_connecting;
+static time_t up_started;
+/* no connection attempt before up_retry */
+static time_t up_retry;
+static unsigned int up_backoff;
+static uint32_t next_token;
+
+static void usage(char *argv[]) {
+	printf("Usage: %s [OPTIONS] \n", argv[0]);
+	printf("     --host,-h <host>    Hostname or IP of the gateway\n");
+	printf("    [--port,-p <port>]   Port of the gateway, default 4000\n");
+	printf("    [--listen,-l <port>] Port to accept clients on, default 4000\n");
+	printf("    [--bind,-b <addr>]   Address to accept clients on, default 127.0.0.1\n");
+	printf("    [--cache,-c <secs>]  Serve node and group scans from memory for secs, default 5, 0 to disable\n");
+	printf("    [--window,-w <n>]    Telegrams in flight to the gateway, default 8\n");
+	printf("    [--verbose]          Verbose mode\n");
+}
+
+static uint32_t get_token(const unsigned char *msg) {
+	return msg[HDR_TOKEN] | (msg[HDR_TOKEN + 1] << 8U) | (msg[HDR_TOKEN + 2] << 16U) |
+			((uint32_t) msg[HDR_TOKEN + 3] << 24U);
+}
+
+static void set_token(unsigned char *msg, uint32_t token) {
+	msg[HDR_TOKEN] = token;
+	msg[HDR_TOKEN + 1] = token >> 8;
+	msg[HDR_TOKEN + 2] = token >> 16;
+	msg[HDR_TOKEN + 3] = token >> 24;
+}
+
+/* size of the frame at the start of buf, 0 if incomplete, -1 if the
+ * length field cannot even cover the header */
+static ssize_t frame_size(const struct buffer *buf) {
+	size_t size;
+	if (buf->len < HDR_SIZE) return 0;
+	size = (buf->data[0] | (buf->data[1] << 8)) + 2;
+	if (size < HDR_SIZE) return -1;
+	return buf->len >= size ? (ssize_t) size : 0;
+}
+
+static int buffer_append(struct buffer *buf, const unsigned char *data, size_t len) {
+	if (buf->len + len > buf->cap) {
+		size_t cap = buf->cap ? buf->cap : 1024;
+		unsigned char *p;
+		while (cap < buf->len + len) cap *= 2;
+		p = realloc(buf->data, cap);
+		if (!p) return -ENOMEM;
+		buf->data = p;
+		buf->cap = cap;
+	}
+	memcpy(buf->data + buf->len, data, len);
+	buf->len += len;
+	return 0;
+}
+
+static void buffer_consume(struct buffer *buf, size_t len) {
+	memmove(buf->data, buf->data + len, buf->len - len);
+	buf->len -= len;
+}
+
+/* seconds on a clock which is not set back or forth with the wall time */
+static time_t monotonic_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
+}
+
+static int set_nonblocking(int fd) {
+	int flags = fcntl(fd, F_GETFL);
+	if (flags < 0) return -1;
+	return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+/* Only the scans are cached. The key is the telegram without length and
+ * token, as those differ between otherwise identical requests. */
+static size_t cache_key(const unsigned char *msg, size_t len, unsigned char *key) {
+	if (!cache_ttl) return 0;
+	if (msg[HDR_CMD] != 0x13 && msg[HDR_CMD] != 0x1e) return 0;
+	if (len - HDR_SIZE + 2 > CACHE_KEY_MAX) return 0;
+	memcpy(key, &msg[2], 2);
+	memcpy(key + 2, msg + HDR_SIZE, len - HDR_SIZE);
+	return len - HDR_SIZE + 2;
+}
+
+static struct cache_entry *cache_find(const unsigned char *key, size_t keylen) {
+	int i;
+	for (i = 0; i < MAX_CACHE; i++) {
+		if (cache[i].answer && cache[i].keylen == keylen &&
+				0 == memcmp(cache[i].key, key, keylen)) return &cache[i];
+	}
+	return NULL;
+}
+
+static void cache_invalidate(void) {
+	int i;
+	cache_gen++;
+	for (i = 0; i < MAX_CACHE; i++) {
+		free(cache[i].answer);
+		cache[i].answer = NULL;
+	}
+}
+
+static void cache_store(const unsigned char *key, size_t keylen,
+		const unsigned char *answer, size_t len) {
+	struct cache_entry *e = cache_find(key, keylen);
+	int i;
+
+	if (!e) {
+		/* a free one or the oldest */
+		e = &cache[0];
+		for (i = 0; i < MAX_CACHE; i++) {
+			if (!cache[i].answer) { e = &cache[i]; break; }
+			if (cache[i].stored < e->stored) e = &cache[i];
+		}
+	}
+	free(e->answer);
+	e->answer = malloc(len);
+	if (!e->answer) return;
+	memcpy(e->answer, answer, len);
+	memcpy(e->key, key, keylen);
+	e->keylen = keylen;
+	e->len = len;
+	e->stored = monotonic_now();
+}
+
+static void client_drop(int i) {
+	struct client *cl = &clients[i];
+	if (verbose_flag) printf("client %d: disconnected\n", i);
+	close(cl->fd);
+	cl->fd = -1;
+	cl->gen++;
+	cl->in.len = 0;
+	cl->out.len = 0;
+}
+
+static void client_send(int i, unsigned int gen, const unsigned char *msg, size_t len) {
+	struct client *cl = &clients[i];
+	if (cl->fd < 0 || cl->gen != gen) return;
+	if (cl->out.len + len > CLIENT_OUT_MAX || buffer_append(&cl->out, msg, len) < 0) {
+		fprintf(stderr, "client %d: not reading its answers, dropped\n", i);
+		client_drop(i);
+	}
+}
+
+static int upstream_resolve(void) {
+	struct addrinfo hints;
+	int err;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	err = getaddrinfo(host_data, port_data, &hints, &up_addrs);
+	if (err) {
+		fprintf(stderr, "ERROR resolving %s: %s\n", host_data, gai_strerror(err));
+		return -1;
+	}
+	return 0;
+}
+
+/* All addresses failed: wait a bit longer each time before the next round */
+static void upstream_retry_later(void) {
+	up_next = NULL;
+	up_backoff = up_backoff ? up_backoff * 2 : RETRY_MIN;
+	if (up_backoff > RETRY_MAX) up_backoff = RETRY_MAX;
+	up_retry = monotonic_now() + up_backoff;
+	fprintf(stderr, "ERROR connecting to the gateway, retrying in %us\n", up_backoff);
+}
+
+/* Start connecting to the next address. The connect completes in the poll
+ * loop, see upstream_connect_done(). */
+static void upstream_connect(void) {
+	struct addrinfo *ai;
+	int fd;
+
+	if (monotonic_now() < up_retry) return;
+
+	for (ai = up_next ? up_next : up_addrs; ai; ai = ai->ai_next) {
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (fd < 0) continue;
+		if (set_nonblocking(fd) == 0 &&
+				(connect(fd, ai->ai_addr, ai->ai_addrlen) == 0 || errno == EINPROGRESS)) {
+			up_next = ai->ai_next;
+			upstream = fd;
+			up_connecting = 1;
+			up_started = monotonic_now();
+			return;
+		}
+		close(fd);
+	}
+	upstream_retry_later();
+}
+
+/* The connect in progress finished with err (0 on success) */
+static void upstream_connect_done(int err) {
+	up_connecting = 0;
+	if (!err) {
+		if (verbose_flag) printf("connected to %s:%s\n", host_data, port_data);
+		up_next = NULL;
+		up_backoff = 0;
+		return;
+	}
+	if (verbose_flag) printf("connecting to the gateway: %s\n", strerror(err));
+	close(upstream);
+	upstream = -1;
+	/* the next address is tried right away */
+	if (!up_next) upstream_retry_later();
+}
+
+/* The gateway connection broke: the telegrams in flight are lost. Their
+ * clients will run into their timeouts, like with a direct connection. */
+static void upstream_drop(void) {
+	fprintf(stderr, "connection to the gateway lost\n");
+	close(upstream);
+	upstream = -1;
+	up_connecting = 0;
+	up_in.len = 0;
+	up_out.len = 0;
+	memset(inflight, 0, sizeof(inflight));
+	inflight_count = 0;
+	cache_invalidate();
+}
+
+/* Move queued telegrams upstream as long as the window allows */
+static void upstream_fill(void) {
+	struct request *req;
+	struct inflight *f;
+	int i;
+
+	while ((req = queue_head) && inflight_count < window) {
+		/* client went away meanwhile */
+		if (clients[req->client].fd < 0 || clients[req->client].gen != req->gen) {
+			queue_head = req->next;
+			if (!queue_head) queue_tail = NULL;
+			free(req);
+			continue;
+		}
+
+		if (upstream < 0) upstream_connect();
+		if (upstream < 0 || up_connecting) return;
+
+		queue_head = req->next;
+		if (!queue_head) queue_tail = NULL;
+
+		for (i = 0; inflight[i].used; i++);
+		f = &inflight[i];
+		f->used = 1;
+		f->client = req->client;
+		f->gen = req->gen;
+		f->client_token = get_token(req->msg);
+		f->token = ++next_token;
+		f->sent = monotonic_now();
+		f->keylen = cache_key(req->msg, req->len, f->key);
+		inflight_count++;
+
+		/* anything but a scan may change what the scans report */
+		if (req->msg[HDR_CMD] != 0x13 && req->msg[HDR_CMD] != 0x1e &&
+				req->msg[HDR_CMD] != 0x68) {
+			cache_invalidate();
+		}
+		f->cache_gen = cache_gen;
+
+		set_token(req->msg, f->token);
+		if (buffer_append(&up_out, req->msg, req->len) < 0) {
+			f->used = 0;
+			inflight_count--;
+		}
+		free(req);
+	}
+}
+
+/* A complete telegram from client i */
+static void client_telegram(int i, unsigned char *msg, size_t len) {
+	unsigned char key[CACHE_KEY_MAX];
+	struct cache_entry *e;
+	struct request *req;
+	size_t keylen;
+
+	if (verbose_flag) printf("client %d: cmd 0x%02x, %zu bytes\n", i, msg[HDR_CMD], len);
+
+	keylen = cache_key(msg, len, key);
+	if (keylen && (e = cache_find(key, keylen)) && monotonic_now() - e->stored < cache_ttl) {
+		unsigned char answer[FRAME_MAX];
+		memcpy(answer, e->answer, e->len);
+		set_token(answer, get_token(msg));
+		client_send(i, clients[i].gen, answer, e->len);
+		if (verbose_flag) printf("client %d: answered from cache\n", i);
+		return;
+	}
+
+	req = malloc(sizeof(*req) + len);
+	if (!req) return;
+	req->next = NULL;
+	req->client = i;
+	req->gen = clients[i].gen;
+	req->queued = monotonic_now();
+	req->len = len;
+	memcpy(req->msg, msg, len);
+	if (queue_tail) queue_tail->next = req;
+	else queue_head = req;
+	queue_tail = req;
+}
+
+/* A complete answer from the gateway */
+static void upstream_telegram(unsigned char *msg, size_t len) {
+	uint32_t token = get_token(msg);
+	struct inflight *f;
+	int i;
+
+	for (i = 0; i < MAX_INFLIGHT; i++) {
+		if (inflight[i].used && inflight[i].token == token) break;
+	}
+	if (i == MAX_INFLIGHT) {
+		if (verbose_flag) printf("answer with unknown token %u dropped\n", token);
+		return;
+	}
+
+	f = &inflight[i];
+	/* a scan overtaken by a change must not be cached */
+	if (f->keylen && f->cache_gen == cache_gen) cache_store(f->key, f->keylen, msg, len);
+	set_token(msg, f->client_token);
+	client_send(f->client, f->gen, msg, len);
+	f->used = 0;
+	inflight_count--;
+}
+
+/* Read what is available; returns -1 on EOF or error */
+static int read_into(int fd, struct buffer *buf) {
+	unsigned char tmp[4096];
+	ssize_t r = read(fd, tmp, sizeof(tmp));
+	if (r < 0) return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+	if (r == 0) return -1;
+	return buffer_append(buf, tmp, r) < 0 ? -1 : 0;
+}
+
+/* Write what can be written; returns -1 on error */
+static int write_from(int fd, struct buffer *buf) {
+	ssize_t w;
+	if (!buf->len) return 0;
+	w = write(fd, buf->data, buf->len);
+	if (w < 0) return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+	buffer_consume(buf, w);
+	return 0;
+}
+
+static void expire_inflight(void) {
+	time_t now = monotonic_now();
+	struct request *req;
+	int i;
+	for (i = 0; i < MAX_INFLIGHT; i++) {
+		if (inflight[i].used && now - inflight[i].sent > ANSWER_TIMEOUT) {
+			if (verbose_flag) printf("no answer for token %u\n", inflight[i].token);
+			inflight[i].used = 0;
+			inflight_count--;
+		}
+	}
+	/* while the gateway is unreachable, the client gave up on these */
+	while ((req = queue_head) && now - req->queued > ANSWER_TIMEOUT) {
+		if (verbose_flag) printf("client %d: telegram not sent in time\n", req->client);
+		queue_head = req->next;
+		if (!queue_head) queue_tail = NULL;
+		free(req);
+	}
+	if (up_connecting && now - up_started > CONNECT_TIMEOUT) upstream_connect_done(ETIMEDOUT);
+}
+
+static int listen_socket(void) {
+	struct addrinfo hints, *res;
+	int fd, err, on = 1;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+
+	err = getaddrinfo(bind_addr, listen_port, &hints, &res);
+	if (err) {
+		fprintf(stderr, "ERROR resolving %s: %s\n", bind_addr, gai_strerror(err));
+		return -1;
+	}
+	fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+	if (fd >= 0) {
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+		if (bind(fd, res->ai_addr, res->ai_addrlen) < 0 || listen(fd, MAX_CLIENTS) < 0) {
+			close(fd);
+			fd = -1;
+		}
+	}
+	freeaddrinfo(res);
+	if (fd < 0) {
+		perror("ERROR listening");
+		return -1;
+	}
+	set_nonblocking(fd);
+	return fd;
+}
+
+static int proxy_run(void) {
+	struct pollfd pfd[MAX_CLIENTS + 2];
+	int lfd, i, n;
+	ssize_t size;
+
+	lfd = listen_socket();
+	if (lfd < 0) return -1;
+	if (upstream_resolve() < 0) return -1;
+	upstream_connect();
+
+	signal(SIGPIPE, SIG_IGN);
+	for (i = 0; i < MAX_CLIENTS; i++) clients[i].fd = -1;
+	if (window > MAX_INFLIGHT) window = MAX_INFLIGHT;
+
+	while (1) {
+		upstream_fill();
+
+		pfd[0].fd = lfd;
+		pfd[0].events = POLLIN;
+		pfd[1].fd = upstream;
+		if (up_connecting) pfd[1].events = POLLOUT;
+		else pfd[1].events = POLLIN | (up_out.len ? POLLOUT : 0);
+		for (i = 0; i < MAX_CLIENTS; i++) {
+			pfd[i + 2].fd = clients[i].fd;
+			pfd[i + 2].events = POLLIN | (clients[i].out.len ? POLLOUT : 0);
+			pfd[i + 2].revents = 0;
+		}
+
+		n = poll(pfd, MAX_CLIENTS + 2, 1000);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			perror("poll");
+			return -1;
+		}
+		expire_inflight();
+
+		if (pfd[0].revents & POLLIN) {
+			int fd = accept(lfd, NULL, NULL);
+			if (fd >= 0) {
+				for (i = 0; i < MAX_CLIENTS && clients[i].fd >= 0; i++);
+				if (i == MAX_CLIENTS) {
+					fprintf(stderr, "too many clients\n");
+					close(fd);
+				} else {
+					set_nonblocking(fd);
+					clients[i].fd = fd;
+					if (verbose_flag) printf("client %d: connected\n", i);
+				}
+			}
+		}
+
+		if (up_connecting && pfd[1].fd == upstream && pfd[1].revents) {
+			int err = 0;
+			socklen_t len = sizeof(err);
+			if (getsockopt(upstream, SOL_SOCKET, SO_ERROR, &err, &len) < 0) err = errno;
+			upstream_connect_done(err);
+		} else if (upstream >= 0 && pfd[1].fd == upstream && pfd[1].revents) {
+			if ((pfd[1].revents & POLLOUT) && write_from(upstream, &up_out) < 0) {
+				upstream_drop();
+			} else if ((pfd[1].revents & (POLLIN | POLLHUP | POLLERR)) &&
+					read_into(upstream, &up_in) < 0) {
+				upstream_drop();
+			} else {
+				while ((size = frame_size(&up_in)) > 0) {
+					upstream_telegram(up_in.data, size);
+					buffer_consume(&up_in, size);
+				}
+				if (size < 0) {
+					fprintf(stderr, "malformed answer from the gateway\n");
+					upstream_drop();
+				}
+			}
+		}
+
+		for (i = 0; i < MAX_CLIENTS; i++) {
+			struct client *cl = &clients[i];
+			short ev = pfd[i + 2].revents;
+
+			if (cl->fd < 0 || !ev) continue;
+			if ((ev & POLLOUT) && write_from(cl->fd, &cl->out) < 0) {
+				client_drop(i);
+				continue;
+			}
+			if (!(ev & (POLLIN | POLLHUP | POLLERR))) continue;
+			if (read_into(cl->fd, &cl->in) < 0) {
+				client_drop(i);
+				continue;
+			}
+			size = 0;
+			while (cl->fd >= 0 && (size = frame_size(&cl->in)) > 0) {
+				client_telegram(i, cl->in.data, size);
+				buffer_consume(&cl->in, size);
+			}
+			if (size < 0) {
+				fprintf(stderr, "client %d: malformed telegram\n", i);
+				client_drop(i);
+			}
+		}
+	}
+}
+
+int main(int argc, char *argv[]) {
+	int option_index = 0;
+	int c;
+
+	while (1) {
+		c = getopt_long(argc, argv, "h:p:l:b:c:w:", long_options, &option_index);
+		if (c == -1) break;
+
+		switch (c) {
+		case 'h':
+			host_data = optarg;
+			break;
+		case 'p':
+			port_data = optarg;
+			break;
+		case 'l':
+			listen_port = optarg;
+			break;
+		case 'b':
+			bind_addr = optarg;
+			break;
+		case 'c':
+			cache_ttl = strtol(optarg, NULL, 10);
+			break;
+		case 'w':
+			window = strtol(optarg, NULL, 10);
+			if (!window) { usage(argv); exit(1); }
+			break;
+		case 0:
+			break;
+		default:
+			usage(argv);
+			exit(1);
+		}
+	}
+
+	if (!host_data) {
+		usage(argv);
+		exit(1);
+	}
+
+	return proxy_run() < 0 ? 1 : 0;
+}
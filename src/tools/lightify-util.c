@@ -42,17 +42,52 @@
 
 #include <getopt.h>
 #include <time.h>
+#include <math.h>
+#include <stdint.h>
 
 #include <errno.h>
 
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
-/* Flag set by ‘--verbose’. */
-static int verbose_flag;
+
+/* The options of one command line. The daemon executes many of them,
+ * so run_options() resets them before each. */
+struct command_options {
+	int verbose; /* set by ‘--verbose’ */
+
+	int cct;
+	int cct_data;
+
+	int r;
+	int r_r;
+	int r_g;
+	int r_b;
+	int r_w;
+
+	int l;
+	int l_data;
+
+	char *name_data;
+	char *group_data;
+
+	int fadetime;
+	unsigned int batch_window;
+};
+
+static struct command_options cmd;
+
+static void command_options_reset(void) {
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.batch_window = 8;
+}
 
 static struct option long_options[] = {
 /* These options set a flag. */
-{ "verbose", no_argument, &verbose_flag, 1 },
-{ "brief", no_argument,   &verbose_flag, 0 },
+{ "verbose", no_argument, &cmd.verbose, 1 },
+{ "brief", no_argument,   &cmd.verbose, 0 },
 /* These options don’t set a flag.
  We distinguish them by their indices. */
 { "cct", required_argument, 0, 'c' },
@@ -69,41 +104,33 @@ static struct option long_options[] = {
 { "list-groups", no_argument, 0, 2},
 { "group", required_argument, 0, 'g' },
 { "update", no_argument, 0, 'u' },
-{ "colorloop", no_argument, 0, 'z' },
-{ "cctloop", no_argument, 0, 'y' },
+{ "colorloop", optional_argument, 0, 'z' },
+{ "cctloop", optional_argument, 0, 'y' },
+{ "daemon", required_argument, 0, 3 },
+{ "rescan", no_argument, 0, 4 },
+{ "batch", required_argument, 0, 5 },
+{ "window", required_argument, 0, 6 },
+{ "shm", required_argument, 0, 7 },
+{ "attach", required_argument, 0, 8 },
 { 0, 0, 0, 0 }
 };
 /* getopt_long stores the option index here. */
 
-// commands data
-int command_cct = 0;
-int command_cct_data = 0;
-
-int command_r = 0;
-int command_r_r = 0;
-int command_r_g = 0;
-int command_r_b = 0;
-int command_r_w = 0;
-
-int command_l = 0;
-int command_l_data = 0;
-
-//int name = 0;
-
-char *name_data = NULL;
-
-char *group_data = NULL;
-
 char *host_data = NULL;
 
 int port = 4000;
 
-int fadetime;
-
 int gonnected = 0;
 
 int sockfd;
 
+char *daemon_path = NULL;
+
+char *shm_name = NULL;
+
+/* set while executing a command received by the daemon */
+int in_daemon = 0;
+
 void usage(char *argv[]) {
 	printf("Usage: %s [OPTIONS] \n", argv[0]);
 	printf("     --host,-h <host>    Hostname or IP\n");
@@ -121,8 +148,24 @@ void usage(char *argv[]) {
 	printf("    [--cct,-c <value>]   CCT to be set.\n");
 	printf("    [--rgbw,-r <value>]  Set color. Give color as r,g,b,w. Color values from 0 to 255\n");
 	printf("    [--update,-u]        Refresh a node's information (requires name set before)\n");
+	printf("    [--colorloop[=curve]] Start a colour loop: hue (default), breathe or sunrise\n");
+	printf("    [--cctloop[=curve]]  Start a CCT loop: sunrise (default), breathe or hue\n");
+	printf("                         Loops go to the node, the group's members or all nodes;\n");
+	printf("                         --time sets the step delay, --level and --cct the maximum\n");
+	printf("                         brightness and the CCT for breathe before.\n");
+	printf("    [--rescan]           Scan nodes and groups again\n");
+	printf("    [--batch <file>]     Execute the commands in file (- for stdin), pipelined\n");
+	printf("    [--window <value>]   Commands in flight in batch mode, default 8\n");
+	printf("    [--daemon <path>]    Keep the connection open and serve commands on Unix socket path\n");
+	printf("    [--shm <name>]       With --daemon: publish the node and group state into shared memory\n");
+	printf("    [--attach <name>]    Dump the state published by a daemon, without gateway access\n");
+	printf("\n %s --client <path> [OPTIONS]\n", argv[0]);
+	printf("                         Run the commands (OPTIONS) in the daemon listening on path\n");
 	printf("\n Host must be given before any command. Commands on and off can broadcast to all lamps if name is not given before.\n");
 	printf("\n All other commands needs either a name or group set before.\n");
+	printf("\n Batch files have one command per line: <target> <command> [time <value>]\n");
+	printf("   target:  all | node <name> | group <name>  (quote names with spaces)\n");
+	printf("   command: on | off | level <value> | cct <value> | rgbw <r,g,b,w>\n");
 }
 
 struct lightify_node* find_node_per_name(struct lightify_ctx *ctx, const char *name) {
@@ -150,94 +193,94 @@ struct lightify_group* find_grp_per_name(struct lightify_ctx *ctx, const char *n
 }
 
 void command_set_0_1(struct lightify_ctx *ctx, int command_on) {
-	struct lightify_node *node = find_node_per_name(ctx,name_data);;
-	struct lightify_group *grp = find_grp_per_name(ctx,group_data);
+	struct lightify_node *node = find_node_per_name(ctx,cmd.name_data);;
+	struct lightify_group *grp = find_grp_per_name(ctx,cmd.group_data);
 	char *type, *name;
 
 	command_on = command_on > 0 ? 1 : 0;
-	if (!name_data && !group_data) {
+	if (!cmd.name_data && !cmd.group_data) {
 		type = "Broadcast"; name = "";
 		lightify_node_request_onoff(ctx, NULL, command_on);
 	} else if (node) {
-		type = "Node"; name = name_data;
+		type = "Node"; name = cmd.name_data;
 		lightify_node_request_onoff(ctx, node, command_on);
 	} else if (grp) {
-		type = "Group"; name = group_data;
+		type = "Group"; name = cmd.group_data;
 		lightify_group_request_onoff(ctx,grp,command_on);
 	} else {
 		return;
 	}
 
-	if (verbose_flag) {
+	if (cmd.verbose) {
 		printf("%s %s switch %s\n", type, name , command_on ? "on" : "off");
 	}
 }
 
 void command_set_cct(struct lightify_ctx *ctx) {
-	struct lightify_node *node = find_node_per_name(ctx,name_data);;
-	struct lightify_group *grp = find_grp_per_name(ctx,group_data);
+	struct lightify_node *node = find_node_per_name(ctx,cmd.name_data);;
+	struct lightify_group *grp = find_grp_per_name(ctx,cmd.group_data);
 	char *type, *name;
 
 	if(node) {
-		type = "Node"; name = name_data;
-		lightify_node_request_cct(ctx, node, command_cct_data, fadetime);
+		type = "Node"; name = cmd.name_data;
+		lightify_node_request_cct(ctx, node, cmd.cct_data, cmd.fadetime);
 	} else if (grp) {
-		type = "Group"; name = group_data;
-		lightify_group_request_cct(ctx, grp, command_cct_data, fadetime);
+		type = "Group"; name = cmd.group_data;
+		lightify_group_request_cct(ctx, grp, cmd.cct_data, cmd.fadetime);
 	} else {
 		return;
 	}
 
-	if (verbose_flag) {
-		printf("%s %s cct %dK in time %d\n", type, name, command_cct_data, fadetime );
+	if (cmd.verbose) {
+		printf("%s %s cct %dK in time %d\n", type, name, cmd.cct_data, cmd.fadetime );
 	}
 }
 
 void command_set_rgbw(struct lightify_ctx *ctx) {
-	struct lightify_node *node = find_node_per_name(ctx,name_data);
-	struct lightify_group *grp = find_grp_per_name(ctx,group_data);
+	struct lightify_node *node = find_node_per_name(ctx,cmd.name_data);
+	struct lightify_group *grp = find_grp_per_name(ctx,cmd.group_data);
 	char *type, *name;
 
 	if(node) {
-		type ="Node"; name = name_data;
-		lightify_node_request_rgbw(ctx, node, command_r_r, command_r_g,
-				command_r_b, command_r_w, fadetime);
+		type ="Node"; name = cmd.name_data;
+		lightify_node_request_rgbw(ctx, node, cmd.r_r, cmd.r_g,
+				cmd.r_b, cmd.r_w, cmd.fadetime);
 	} else if (grp) {
-		type ="Group"; name = group_data;
-		lightify_group_request_rgbw(ctx, grp, command_r_r, command_r_g,
-				command_r_b, command_r_w, fadetime);
+		type ="Group"; name = cmd.group_data;
+		lightify_group_request_rgbw(ctx, grp, cmd.r_r, cmd.r_g,
+				cmd.r_b, cmd.r_w, cmd.fadetime);
 	} else {
 		return;
 	}
 
-	if (verbose_flag) {
-		printf("%s %s rgbw %d,%d,%d,%d in time %d\n", type, name, command_r_r,
-				command_r_g, command_r_b, command_r_w, fadetime);
+	if (cmd.verbose) {
+		printf("%s %s rgbw %d,%d,%d,%d in time %d\n", type, name, cmd.r_r,
+				cmd.r_g, cmd.r_b, cmd.r_w, cmd.fadetime);
 	}
 }
 
 void command_set_lvl(struct lightify_ctx *ctx) {
-	struct lightify_node *node = find_node_per_name(ctx,name_data);
-	struct lightify_group *grp = find_grp_per_name(ctx,group_data);
+	struct lightify_node *node = find_node_per_name(ctx,cmd.name_data);
+	struct lightify_group *grp = find_grp_per_name(ctx,cmd.group_data);
 	char *type, *name;
 
 	if(node) {
-		type ="Node"; name = name_data;
-		lightify_node_request_brightness(ctx, node, command_l_data, fadetime);
+		type ="Node"; name = cmd.name_data;
+		lightify_node_request_brightness(ctx, node, cmd.l_data, cmd.fadetime);
 	} else if (grp) {
-		type ="Group"; name = group_data;
-		lightify_group_request_brightness(ctx, grp, command_l_data, fadetime);
+		type ="Group"; name = cmd.group_data;
+		lightify_group_request_brightness(ctx, grp, cmd.l_data, cmd.fadetime);
 	} else {
 		return;
 	}
 
-	if (verbose_flag) {
-		printf("%s %s brightness %d in time %d\n", type, name, command_l_data, fadetime);
+	if (cmd.verbose) {
+		printf("%s %s brightness %d in time %d\n", type, name, cmd.l_data, cmd.fadetime);
 	}
 }
 
 void command_update_node(struct lightify_ctx *ctx) {
-	struct lightify_node *node = find_node_per_name(ctx,name_data);
+	struct lightify_node *node = find_node_per_name(ctx,cmd.name_data);
 	if (!node) {
 		return;
 	}
@@ -245,72 +288,321 @@ void command_update_node(struct lightify_ctx *ctx) {
 	printf("update_node ret=%d\n", ret);
 }
 
-void command_do_colorloop(struct lightify_ctx *ctx) {
-	struct lightify_node *node = find_node_per_name(ctx,name_data);
-	if (!node) {
-		return;
+/* Loop generators: The lamps run the loop programs on their own, so an
+ * animation costs one telegram per lamp instead of a stream of frames.
+ * The 15 steps of the program are sampled from a parametric curve. */
+
+enum loop_curve {
+	CURVE_HUE,	/**< linear sweep, e.g. through all hues */
+	CURVE_BREATHE,	/**< sine: up and down again */
+	CURVE_SUNRISE,	/**< smooth ramp up */
+};
+
+#define LOOP_STEPS (15)
+#define LOOP_DEFAULT_DELAY (5)
+
+static int parse_curve(const char *name, enum loop_curve def, enum loop_curve *curve) {
+	if (!name) *curve = def;
+	else if (0 == strcmp(name, "hue")) *curve = CURVE_HUE;
+	else if (0 == strcmp(name, "breathe")) *curve = CURVE_BREATHE;
+	else if (0 == strcmp(name, "sunrise")) *curve = CURVE_SUNRISE;
+	else return -1;
+	return 0;
+}
+
+/* Value of the curve at t (0..1), also within 0..1 */
+static double curve_eval(enum loop_curve curve, double t) {
+	switch (curve) {
+	case CURVE_BREATHE:
+		return 0.5 - 0.5 * cos(2 * M_PI * t);
+	case CURVE_SUNRISE:
+		return t * t * (3 - 2 * t);
+	case CURVE_HUE:
+	default:
+		return t;
 	}
+}
 
-	/* assemble some colorspec for testing.*/
-	struct lightify_color_loop_spec colorspec[] = {
-	 {  0x3c , 0x00 , 0xff , 0xff },
-     {  0x05 , 15 , 0xff , 0xff },
-     {  0x05 , 15 , 0xff , 0xff },
-	 {  0x05 , 30 , 0xff , 0xff },
-	 {  0x05 , 45 , 0xff , 0xff },
-	 {  0x05 , 60 , 0xff , 0xff },
-	 {  0x05 , 75 , 0xff , 0xff },
-	 {	0x05 , 90 , 0xff , 0xff },
-	 {  0x05 , 125 , 0xff , 0xff },
-	 {	0x05 , 150 , 0xff , 0xff },
-	 {	0x05 , 175 , 0xff , 0xff },
-	 {	0x05 , 200 , 0xff , 0xff },
-	 {	0x05 , 225 , 0xff , 0xff },
-	 {	0x05 , 250 , 0xff , 0xff },
-	 {	0x05 , 255 , 0xff , 0xff }
-	};
-
-	unsigned char statics[8] = {0x01, 0xff, 0x00, 0xff, 0x80, 0x3c, 0x00, 0x00};
-
-	lightify_node_request_color_loop(ctx,  node, colorspec,
-				sizeof(colorspec)/sizeof(struct lightify_color_loop_spec), NULL);
-	return;
-}
-
-void command_do_cctloop(struct lightify_ctx *ctx) {
-	struct lightify_node *node = find_node_per_name(ctx,name_data);
-	if (!node) {
-		return;
+static uint8_t loop_delay(void) {
+	if (cmd.fadetime > 0 && cmd.fadetime < 256) return cmd.fadetime;
+	return LOOP_DEFAULT_DELAY;
+}
+
+static uint8_t loop_brightness(enum loop_curve curve, double v) {
+	int max = cmd.l ? cmd.l_data * 255 / 100 : 255;
+	switch (curve) {
+	case CURVE_BREATHE:
+		/* don't go completely dark */
+		return max / 10 + v * (max - max / 10);
+	case CURVE_SUNRISE:
+		return v * max;
+	case CURVE_HUE:
+	default:
+		return max;
+	}
+}
+
+void gen_color_loop(enum loop_curve curve, struct lightify_color_loop_spec *spec) {
+	int i;
+	for (i = 0; i < LOOP_STEPS; i++) {
+		double v = curve_eval(curve, (double) i / (LOOP_STEPS - 1));
+		spec[i].delay = i ? loop_delay() : 0x3c;
+		spec[i].saturation = 0xff;
+		spec[i].brightness = loop_brightness(curve, v);
+		switch (curve) {
+		case CURVE_HUE:
+			spec[i].hue = v * 255;
+			break;
+		case CURVE_SUNRISE:
+			/* from red to a warm yellow */
+			spec[i].hue = v * 40;
+			break;
+		case CURVE_BREATHE:
+		default:
+			/* breathe in white */
+			spec[i].hue = 0;
+			spec[i].saturation = 0;
+			break;
+		}
+	}
+}
+
+void gen_cct_loop(enum loop_curve curve, struct lightify_cct_loop_spec *spec) {
+	int i;
+	int cct = cmd.cct ? cmd.cct_data : 2700;
+	for (i = 0; i < LOOP_STEPS; i++) {
+		double v = curve_eval(curve, (double) i / (LOOP_STEPS - 1));
+		spec[i].delay = i ? loop_delay() : 0x3c;
+		spec[i].brightness = loop_brightness(curve, v);
+		switch (curve) {
+		case CURVE_HUE:
+		case CURVE_SUNRISE:
+			spec[i].cct = 2000 + v * (6500 - 2000);
+			break;
+		case CURVE_BREATHE:
+		default:
+			spec[i].cct = cct;
+			break;
+		}
+	}
+}
+
+/* One telegram per target: group and broadcast addressing make the
+ * members start the loop at the same time. */
+static void push_loop(struct lightify_ctx *ctx, const struct lightify_color_loop_spec *colorspec,
+		const struct lightify_cct_loop_spec *cctspec) {
+	struct lightify_node *node = NULL;
+	struct lightify_group *grp = NULL;
+	int err;
+
+	if (cmd.name_data && !(node = find_node_per_name(ctx, cmd.name_data))) return;
+	if (cmd.group_data && !(grp = find_grp_per_name(ctx, cmd.group_data))) return;
+
+	if (grp) {
+		err = colorspec ?
+			lightify_group_request_color_loop(ctx, grp, colorspec, LOOP_STEPS, NULL) :
+			lightify_group_request_cct_loop(ctx, grp, cctspec, LOOP_STEPS, NULL);
+	} else {
+		/* node == NULL broadcasts */
+		err = colorspec ?
+			lightify_node_request_color_loop(ctx, node, colorspec, LOOP_STEPS, NULL) :
+			lightify_node_request_cct_loop(ctx, node, cctspec, LOOP_STEPS, NULL);
+	}
+
+	if (err < 0) {
+		fprintf(stderr, "ERROR: %s loop failed: %s\n", colorspec ? "color" : "cct",
+				strerror(-err));
+	} else if (cmd.verbose) {
+		printf("%s loop sent to %s\n", colorspec ? "color" : "cct",
+				grp ? "group" : node ? "node" : "all nodes");
+	}
+}
+
+int command_do_colorloop(struct lightify_ctx *ctx, const char *curvename) {
+	struct lightify_color_loop_spec colorspec[LOOP_STEPS];
+	enum loop_curve curve;
+
+	if (parse_curve(curvename, CURVE_HUE, &curve) < 0) return -1;
+	gen_color_loop(curve, colorspec);
+	push_loop(ctx, colorspec, NULL);
+	return 0;
+}
+
+int command_do_cctloop(struct lightify_ctx *ctx, const char *curvename) {
+	struct lightify_cct_loop_spec cctspec[LOOP_STEPS];
+	enum loop_curve curve;
+
+	if (parse_curve(curvename, CURVE_SUNRISE, &curve) < 0) return -1;
+	gen_cct_loop(curve, cctspec);
+	push_loop(ctx, NULL, cctspec);
+	return 0;
+}
+
+/* Batch mode: read commands from a file and send them pipelined. */
+
+#define BATCH_MAX_FIELDS (8)
+
+struct batch_line {
+	unsigned int lineno;
+	char *text;
+};
+
+/* Split line into whitespace separated fields; "..." groups a field. */
+static int batch_split(char *line, char *fields[]) {
+	int n = 0;
+	char *p = line;
+
+	while (*p) {
+		while (*p == ' ' || *p == '\t') p++;
+		if (!*p || *p == '#') break;
+		if (n == BATCH_MAX_FIELDS) return -1;
+		if (*p == '"') {
+			fields[n++] = ++p;
+			while (*p && *p != '"') p++;
+			if (!*p) return -1;
+		} else {
+			fields[n++] = p;
+			while (*p && *p != ' ' && *p != '\t') p++;
+		}
+		if (*p) *p++ = '\0';
 	}
+	return n;
+}
 
-	/* assemble some colorspec for testing.*/
-	struct lightify_cct_loop_spec cctspec[] = {
-		{  0x3c , 2000 , 0xff },
-		{  0x05 , 2500 , 0xff },
-		{  0x05 , 2700 , 0xff },
-		{  0x05 , 3000 , 0xff },
-		{  0x05 , 3500 , 0xff },
-		{  0x05 , 4000 , 0xff },
-		{  0x05 , 5000 , 0xff },
-		{  0x05 , 6000 , 0xff },
-		{  0x05 , 5000 , 0xff },
-		{  0x05 , 4000 , 0xff },
-		{  0x05 , 3500 , 0xff },
-		{  0x05 , 3000 , 0xff },
-		{  0x05 , 2700 , 0xff },
-		{  0x05 , 2500 , 0xff },
-		{  0x05 , 2000 , 0xff }
-	};
+/* Parse one command and add it to the batch. Returns the index in the
+ * batch, -ENODATA for empty lines and comments, other negative values if
+ * the line is not valid. */
+static int batch_parse(struct lightify_ctx *ctx, struct lightify_batch *batch, char *line) {
+	char *f[BATCH_MAX_FIELDS];
+	struct lightify_node *node = NULL;
+	struct lightify_group *grp = NULL;
+	int n, i = 0, time = cmd.fadetime;
+	int r, g, b, w;
+
+	n = batch_split(line, f);
+	if (n < 0) return -EINVAL;
+	if (n == 0) return -ENODATA;
+
+	if (n >= 1 && 0 == strcmp(f[0], "all")) {
+		i = 1;
+	} else if (n >= 2 && 0 == strcmp(f[0], "node")) {
+		if (!(node = find_node_per_name(ctx, f[1]))) return -ENOENT;
+		i = 2;
+	} else if (n >= 2 && 0 == strcmp(f[0], "group")) {
+		if (!(grp = find_grp_per_name(ctx, f[1]))) return -ENOENT;
+		i = 2;
+	} else {
+		return -EINVAL;
+	}
+
+	if (i >= n) return -EINVAL;
+
+	/* optional trailing fading time */
+	if (n - i >= 3 && 0 == strcmp(f[n - 2], "time")) {
+		time = strtol(f[n - 1], NULL, 10);
+		n -= 2;
+	}
+
+	if (0 == strcmp(f[i], "on") && n == i + 1) {
+		return lightify_batch_add_onoff(batch, node, grp, 1);
+	} else if (0 == strcmp(f[i], "off") && n == i + 1) {
+		return lightify_batch_add_onoff(batch, node, grp, 0);
+	}
 
-	unsigned char statics[8] =
-			{ 0x01, 0xff, 0x00, 0xff, 0x80, 0x3c, 0x00, 0x00 };
-	lightify_node_request_cct_loop(ctx, node, cctspec,
-			sizeof(cctspec) / sizeof(struct lightify_cct_loop_spec), NULL);
+	/* all others need an argument and don't support broadcast */
+	if (n != i + 2 || (!node && !grp)) return -EINVAL;
 
-	return;
+	if (0 == strcmp(f[i], "level")) {
+		return lightify_batch_add_brightness(batch, node, grp, strtol(f[i + 1], NULL, 10), time);
+	} else if (0 == strcmp(f[i], "cct")) {
+		return lightify_batch_add_cct(batch, node, grp, strtol(f[i + 1], NULL, 10), time);
+	} else if (0 == strcmp(f[i], "rgbw")) {
+		if (4 != sscanf(f[i + 1], "%d,%d,%d,%d", &r, &g, &b, &w)) return -EINVAL;
+		return lightify_batch_add_rgbw(batch, node, grp, r, g, b, w, time);
+	}
+	return -EINVAL;
 }
 
+int command_batch(struct lightify_ctx *ctx, const char *path) {
+	struct lightify_batch *batch;
+	struct batch_line *lines = NULL;
+	unsigned int nlines = 0, lineno = 0;
+	struct timespec start, end;
+	char *line = NULL;
+	size_t linesize = 0;
+	int failed = 0, invalid = 0, err, i, count;
+	FILE *f;
+
+	if (0 == strcmp(path, "-")) {
+		f = stdin;
+	} else {
+		f = fopen(path, "r");
+		if (!f) {
+			fprintf(stderr, "ERROR: cannot open %s: %s\n", path, strerror(errno));
+			return -1;
+		}
+	}
+
+	err = lightify_batch_new(ctx, &batch);
+	if (err >= 0) err = lightify_batch_set_window(batch, cmd.batch_window);
+	if (err < 0) {
+		fprintf(stderr, "ERROR: cannot create batch: %s\n", strerror(-err));
+		if (f != stdin) fclose(f);
+		return -1;
+	}
+
+	while (getline(&line, &linesize, f) > 0) {
+		char *text;
+		lineno++;
+		line[strcspn(line, "\r\n")] = '\0';
+		text = strdup(line);
 
+		err = batch_parse(ctx, batch, line);
+		if (err == -ENODATA) {
+			free(text);
+			continue;
+		}
+		if (err < 0) {
+			printf("%u: %s: %s\n", lineno, text, err == -ENOENT ? "unknown target" : "invalid command");
+			invalid++;
+			free(text);
+			continue;
+		}
+
+		lines = realloc(lines, (nlines + 1) * sizeof(struct batch_line));
+		if (!lines) {
+			fprintf(stderr, "ERROR: out of memory\n");
+			exit(1);
+		}
+		lines[nlines].lineno = lineno;
+		lines[nlines].text = text;
+		nlines++;
+	}
+	free(line);
+	if (f != stdin) fclose(f);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	lightify_batch_run(batch);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	count = lightify_batch_get_count(batch);
+	for (i = 0; i < count; i++) {
+		err = lightify_batch_get_result(batch, i);
+		if (err < 0) failed++;
+		if (cmd.verbose || err < 0) {
+			printf("%u: %s: %s (%.3f ms)\n", lines[i].lineno, lines[i].text,
+					err < 0 ? strerror(-err) : "ok",
+					lightify_batch_get_latency(batch, i) / 1000.0);
+		}
+		free(lines[i].text);
+	}
+	free(lines);
+	lightify_batch_free(batch);
+
+	printf("%d commands sent, %d failed, %d invalid, %.3f ms\n", count, failed, invalid,
+			(end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1000000.0);
+	return (failed || invalid) ? -1 : 0;
+}
 
 void setup_connection(struct lightify_ctx *ctx) {
 	/* Create a socket point */
@@ -441,6 +733,69 @@ void dump_nodes_state(struct lightify_ctx *ctx) {
 	printf("|------------------|------------------|---------|--------|---------|-----|-----|------|-----|-----|-----|-----|---|------|\n");
 }
 
+/* Dump the state another process published into shared memory */
+int dump_shm(const char *name) {
+	struct lightify_shm *shm;
+	struct lightify_node_state *nodes = NULL, *tn;
+	struct lightify_group_state *groups = NULL, *tg;
+	int n, g, i, err, ncap = 0, gcap = 0;
+
+	err = lightify_attach_shm(name, &shm);
+	if (err < 0) {
+		fprintf(stderr, "ERROR: cannot attach to %s: %s\n", name, strerror(-err));
+		return -1;
+	}
+
+	/* the owner might publish more meanwhile: grow until everything fits */
+	while ((n = lightify_shm_get_nodes(shm, nodes, ncap)) > ncap) {
+		if (!(tn = realloc(nodes, n * sizeof(*nodes)))) { n = -ENOMEM; break; }
+		nodes = tn;
+		ncap = n;
+	}
+	while ((g = lightify_shm_get_groups(shm, groups, gcap)) > gcap) {
+		if (!(tg = realloc(groups, g * sizeof(*groups)))) { g = -ENOMEM; break; }
+		groups = tg;
+		gcap = g;
+	}
+
+	if (n < 0 || g < 0) {
+		fprintf(stderr, "ERROR: cannot read %s\n", name);
+		n = -1;
+	} else {
+		printf("generation %llu\n", (unsigned long long) lightify_shm_get_generation(shm));
+		printf("|------------------|------------------|---------|--------|---------|-----|-----|------|-----|-----|-----|-----|---|------|\n");
+		printf("| Name             | MAC              | type    | group  | online  | 0/1 | dim | CCT  | Red | Grn | Blu | Wht | s | ZAdr |\n");
+		printf("|------------------|------------------|---------|--------|---------|-----|-----|------|-----|-----|-----|-----|---|------|\n");
+		for (i = 0; i < n; i++) {
+			struct lightify_node_state *st = &nodes[i];
+			printf("| %-16s |", st->name);
+			printf(" %016llx |", (unsigned long long) st->node_address);
+			printf(" %-7s |", decode_lamptype(st->node_type));
+			printf(" 0x%04x |", st->group_address);
+			printf(" %-7s |", decode_online_state(st->online_state));
+			printf(" %-3s |", decode_onoff_sate(st->is_on));
+			printf(" %-3d |", st->brightness);
+			printf(" %-4d |", st->cct);
+			printf(" %-3d |", st->red);
+			printf(" %-3d |", st->green);
+			printf(" %-3d |", st->blue);
+			printf(" %-3d |", st->white);
+			printf(" %c |", st->is_stale ? '*' :' ');
+			printf(" %-4x |\n", st->zone_address);
+		}
+		printf("|------------------|------------------|---------|--------|---------|-----|-----|------|-----|-----|-----|-----|---|------|\n");
+		for (i = 0; i < g; i++) {
+			printf("group %-16s id %-2d members %d\n", groups[i].name, groups[i].id,
+					groups[i].member_count);
+		}
+	}
+
+	free(nodes);
+	free(groups);
+	lightify_detach_shm(shm);
+	return n < 0 ? -1 : 0;
+}
+
 void dump_groups(struct lightify_ctx *ctx) {
 
 	struct lightify_group *group = NULL;
@@ -462,23 +817,20 @@ void dump_groups(struct lightify_ctx *ctx) {
 
 
 
-int main(int argc, char *argv[]) {
+/* Execute the command line options in order.
+ * Returns 0 on success, -1 if the options are not usable or commands of
+ * a batch failed. */
+int run_options(struct lightify_ctx *ctx, int argc, char *argv[]) {
 	int option_index = 0;
-
+	int batch_failed = 0;
 	int c, err;
-	int n;
-
-	struct lightify_ctx *ctx;
-
-	err = lightify_new(&ctx, NULL );
-	if (err < 0) {
-		fprintf(stderr, "Cannot allocate library context\n");
-		exit(1);
-	}
 
+	/* reinitialise getopt and the options, the daemon calls us once per command */
+	optind = 0;
+	command_options_reset();
 
 	while (1) {
-		c = getopt_long(argc, argv, "dc:r:l:n:h:p:01t:w:g:u:z:y", long_options,
+		c = getopt_long(argc, argv, "dc:r:l:n:h:p:01t:w:g:u:z::y::", long_options,
 				&option_index);
 		if (c == -1)
 			break;
@@ -486,54 +838,54 @@ int main(int argc, char *argv[]) {
 		switch (c) {
 
 		case '0':
-			if (!host_data) { usage(argv); exit(1); }
+			if (!host_data) { usage(argv); return -1; }
 			if (!gonnected) setup_connection(ctx);
 			command_set_0_1(ctx,0);
 			break;
 
 		case '1':
-			if (!host_data) { usage(argv); exit(1); }
+			if (!host_data) { usage(argv); return -1; }
 			if (!gonnected) setup_connection(ctx);
 			command_set_0_1(ctx,1);
 			break;
 
 		case 'c':
-			if (!host_data || (!name_data && !group_data) ) {
+			if (!host_data || (!cmd.name_data && !cmd.group_data) ) {
 				usage(argv);
-				exit(1);
+				return -1;
 			}
 			if (!gonnected) setup_connection(ctx);
-			command_cct = 1;
-			command_cct_data = strtol(optarg, NULL, 10);
+			cmd.cct = 1;
+			cmd.cct_data = strtol(optarg, NULL, 10);
 			command_set_cct(ctx);
 			break;
 
 		case 'r':
-			if (!host_data || (!name_data && !group_data)) {
+			if (!host_data || (!cmd.name_data && !cmd.group_data)) {
 				usage(argv);
-				exit(1);
+				return -1;
 			}
 			if (!gonnected) setup_connection(ctx);
-			command_r = 1;
-			sscanf(optarg, "%d,%d,%d,%d", &command_r_r, &command_r_g,
-					&command_r_b, &command_r_w);
+			cmd.r = 1;
+			sscanf(optarg, "%d,%d,%d,%d", &cmd.r_r, &cmd.r_g,
+					&cmd.r_b, &cmd.r_w);
 			command_set_rgbw(ctx);
 			break;
 
 		case 'l':
-			if (!host_data || (!name_data && !group_data)) {
+			if (!host_data || (!cmd.name_data && !cmd.group_data)) {
 				usage(argv);
-				exit(1);
+				return -1;
 			}
 			if (!gonnected) setup_connection(ctx);
-			command_l = 1;
-			command_l_data = strtol(optarg, NULL, 10);
+			cmd.l = 1;
+			cmd.l_data = strtol(optarg, NULL, 10);
 			command_set_lvl(ctx);
 			break;
 
 		case 'n':
-			name_data = optarg;
-			group_data = NULL;
+			cmd.name_data = optarg;
+			cmd.group_data = NULL;
 			break;
 
 		case 'h':
@@ -545,13 +897,13 @@ int main(int argc, char *argv[]) {
 			break;
 
 		case 't':
-			fadetime = strtol(optarg, NULL, 10);
+			cmd.fadetime = strtol(optarg, NULL, 10);
 			break;
 
 		case 'd': {
 			if (!host_data) {
 				usage(argv);
-				exit(1);
+				return -1;
 			}
 			if (!gonnected) setup_connection(ctx);
 			dump_nodes_state(ctx);
@@ -578,29 +930,68 @@ int main(int argc, char *argv[]) {
 
 		case 'g': {
 			if (!gonnected) setup_connection(ctx);
-			group_data = optarg;
-			name_data = NULL;
+			cmd.group_data = optarg;
+			cmd.name_data = NULL;
 			break;
 		}
 
 		case 'u': {
-			if (!gonnected || !name_data) { usage(argv); exit(1); }
+			if (!gonnected || !cmd.name_data) { usage(argv); return -1; }
 			command_update_node(ctx);
 			break;
 		}
 
 		case 'z': {
-			if (!gonnected || !name_data) { usage(argv); exit(1); }
-			command_do_colorloop(ctx);
+			if (!host_data) { usage(argv); return -1; }
+			if (!gonnected) setup_connection(ctx);
+			if (command_do_colorloop(ctx, optarg) < 0) { usage(argv); return -1; }
 			break;
 		}
 
 		case 'y': {
-			if (!gonnected || !name_data) { usage(argv); exit(1); }
-			command_do_cctloop(ctx);
+			if (!host_data) { usage(argv); return -1; }
+			if (!gonnected) setup_connection(ctx);
+			if (command_do_cctloop(ctx, optarg) < 0) { usage(argv); return -1; }
+			break;
+		}
+
+		case 3:
+			if (in_daemon || !host_data) { usage(argv); return -1; }
+			daemon_path = optarg;
+			break;
+
+		case 4: {
+			if (!gonnected) { usage(argv); return -1; }
+			err = lightify_node_request_scan(ctx);
+			if (err >= 0) err = lightify_group_request_scan(ctx);
+			if (cmd.verbose || err < 0) printf("rescan ret=%d\n", err);
+			break;
+		}
+
+		case 5: {
+			if (!host_data || (in_daemon && 0 == strcmp(optarg, "-"))) {
+				usage(argv);
+				return -1;
+			}
+			if (!gonnected) setup_connection(ctx);
+			if (command_batch(ctx, optarg) < 0) batch_failed = 1;
 			break;
 		}
 
+		case 6:
+			cmd.batch_window = strtol(optarg, NULL, 10);
+			if (!cmd.batch_window) { usage(argv); return -1; }
+			break;
+
+		case 7:
+			if (in_daemon) { usage(argv); return -1; }
+			shm_name = optarg;
+			break;
+
+		case 8:
+			if (dump_shm(optarg) < 0) return -1;
+			break;
+
 		case 0:
 			break;
 		case 1:
@@ -609,9 +1000,302 @@ int main(int argc, char *argv[]) {
 		default:
 			//printf("unknown option %c %d", c, c);
 			usage(argv);
-			exit(1);
+			return -1;
+		}
+	}
+
+	return batch_failed ? -1 : 0;
+}
+
+/* Daemon mode: keep the gateway connection and the node cache and serve
+ * commands from a Unix socket.
+ *
+ * Protocol: the client sends its command line options, each terminated by
+ * '\0', and shuts down its sending side. The daemon executes them like the
+ * command line, sends back whatever they print, followed by '\0' and the
+ * exit status as decimal number, and closes the connection.
+ */
+
+#define DAEMON_MAX_CLIENTS (16)
+#define DAEMON_MAX_REQUEST (4096)
+#define DAEMON_MAX_ARGS (64)
+
+struct daemon_client {
+	int fd;
+	size_t len;
+	char buf[DAEMON_MAX_REQUEST];
+};
+
+static int set_nonblocking(int fd, int on) {
+	int flags = fcntl(fd, F_GETFL);
+	if (flags < 0) return -1;
+	flags = on ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+	return fcntl(fd, F_SETFL, flags);
+}
+
+static int daemon_connect(struct lightify_ctx *ctx) {
+	int err;
+
+	err = lightify_conn_set_host(ctx, host_data, port);
+	if (err >= 0) err = lightify_conn_open(ctx);
+	if (err < 0) {
+		fprintf(stderr, "ERROR connecting: %s\n", strerror(-err));
+		return err;
+	}
+	gonnected = 1;
+
+	err = lightify_node_request_scan(ctx);
+	if (err < 0) {
+		fprintf(stderr, "Error during node scan: %s\n", strerror(-err));
+	}
+	err = lightify_group_request_scan(ctx);
+	if (err < 0) {
+		fprintf(stderr, "Error during group scan: %s\n", strerror(-err));
+	}
+	return 0;
+}
+
+/* Run the request of the client with stdout and stderr redirected to it. */
+static void daemon_execute(struct lightify_ctx *ctx, struct daemon_client *cl) {
+	char *args[DAEMON_MAX_ARGS + 1];
+	char status[16];
+	int argc = 0, ret, saved_out, saved_err;
+	size_t i;
+
+	args[argc++] = "lightify-util";
+	for (i = 0; i < cl->len && argc < DAEMON_MAX_ARGS; i += strlen(&cl->buf[i]) + 1) {
+		args[argc++] = &cl->buf[i];
+	}
+	args[argc] = NULL;
+
+	set_nonblocking(cl->fd, 0);
+	fflush(stdout);
+	fflush(stderr);
+	saved_out = dup(STDOUT_FILENO);
+	saved_err = dup(STDERR_FILENO);
+	dup2(cl->fd, STDOUT_FILENO);
+	dup2(cl->fd, STDERR_FILENO);
+
+	in_daemon = 1;
+	ret = run_options(ctx, argc, args);
+	in_daemon = 0;
+
+	fflush(stdout);
+	fflush(stderr);
+	dup2(saved_out, STDOUT_FILENO);
+	dup2(saved_err, STDERR_FILENO);
+	close(saved_out);
+	close(saved_err);
+
+	ret = snprintf(status, sizeof(status), "%c%d", '\0', ret < 0 ? 1 : 0);
+	if (write(cl->fd, status, ret) < 0) {
+		/* client is gone, nothing to do about it. */
+	}
+}
+
+/* Share the cache with other processes, if requested. */
+static void daemon_publish(struct lightify_ctx *ctx) {
+	int err;
+
+	if (!shm_name) return;
+	err = lightify_shm_publish(ctx, shm_name);
+	if (err < 0) fprintf(stderr, "ERROR publishing to %s: %s\n", shm_name, strerror(-err));
+}
+
+static void daemon_drop(struct daemon_client *cl) {
+	close(cl->fd);
+	cl->fd = -1;
+	cl->len = 0;
+}
+
+int daemon_run(struct lightify_ctx *ctx, const char *path) {
+	struct daemon_client clients[DAEMON_MAX_CLIENTS];
+	struct pollfd pfd[DAEMON_MAX_CLIENTS + 1];
+	struct sockaddr_un addr;
+	int lfd, i, n;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "ERROR: socket path too long\n");
+		return -1;
+	}
+
+	if (!gonnected) {
+		if (daemon_connect(ctx) < 0) return -1;
+	} else {
+		fprintf(stderr, "Note: daemon uses the connection set up by the previous options\n");
+	}
+	daemon_publish(ctx);
+
+	signal(SIGPIPE, SIG_IGN);
+
+	lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (lfd < 0) {
+		perror("ERROR opening socket");
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	unlink(path);
+
+	if (bind(lfd, (struct sockaddr*) &addr, sizeof(addr)) < 0 || listen(lfd, DAEMON_MAX_CLIENTS) < 0) {
+		perror("ERROR binding socket");
+		close(lfd);
+		return -1;
+	}
+	set_nonblocking(lfd, 1);
+
+	for (i = 0; i < DAEMON_MAX_CLIENTS; i++) clients[i].fd = -1;
+
+	while (1) {
+		pfd[0].fd = lfd;
+		pfd[0].events = POLLIN;
+		for (i = 0; i < DAEMON_MAX_CLIENTS; i++) {
+			pfd[i + 1].fd = clients[i].fd;
+			pfd[i + 1].events = POLLIN;
+			pfd[i + 1].revents = 0;
+		}
+
+		n = poll(pfd, DAEMON_MAX_CLIENTS + 1, -1);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			perror("poll");
+			break;
+		}
+
+		if (pfd[0].revents & POLLIN) {
+			int fd = accept(lfd, NULL, NULL);
+			if (fd >= 0) {
+				for (i = 0; i < DAEMON_MAX_CLIENTS && clients[i].fd >= 0; i++);
+				if (i == DAEMON_MAX_CLIENTS) {
+					close(fd);
+				} else {
+					set_nonblocking(fd, 1);
+					clients[i].fd = fd;
+					clients[i].len = 0;
+				}
+			}
+		}
+
+		for (i = 0; i < DAEMON_MAX_CLIENTS; i++) {
+			struct daemon_client *cl = &clients[i];
+			ssize_t r;
+
+			if (cl->fd < 0 || !pfd[i + 1].revents) continue;
+
+			r = read(cl->fd, cl->buf + cl->len, sizeof(cl->buf) - cl->len);
+			if (r < 0) {
+				if (errno == EAGAIN || errno == EINTR) continue;
+				daemon_drop(cl);
+				continue;
+			}
+			if (r > 0) {
+				cl->len += r;
+				/* request too large */
+				if (cl->len == sizeof(cl->buf)) daemon_drop(cl);
+				continue;
+			}
+
+			/* EOF -- request complete. Make sure the last argument is terminated. */
+			cl->buf[cl->len] = '\0';
+			daemon_execute(ctx, cl);
+			daemon_drop(cl);
+			daemon_publish(ctx);
+		}
+	}
+
+	close(lfd);
+	unlink(path);
+	return -1;
+}
+
+/* Client mode: hand the options to a daemon and print its output. */
+int client_run(const char *path, int argc, char *argv[]) {
+	struct sockaddr_un addr;
+	char buf[1024];
+	char *status = NULL;
+	char statusbuf[16];
+	size_t statuslen = 0;
+	ssize_t r;
+	int fd, i;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "ERROR: socket path too long\n");
+		return 1;
+	}
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		perror("ERROR opening socket");
+		return 1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	if (connect(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+		perror("ERROR connecting to daemon");
+		close(fd);
+		return 1;
+	}
+
+	for (i = 0; i < argc; i++) {
+		size_t len = strlen(argv[i]) + 1;
+		if (write(fd, argv[i], len) != (ssize_t) len) {
+			perror("ERROR sending command");
+			close(fd);
+			return 1;
 		}
 	}
+	shutdown(fd, SHUT_WR);
+
+	while ((r = read(fd, buf, sizeof(buf))) > 0) {
+		char *p = buf;
+		if (!status) {
+			status = memchr(buf, '\0', r);
+			if (!status) {
+				fwrite(buf, 1, r, stdout);
+				continue;
+			}
+			fwrite(buf, 1, status - buf, stdout);
+			p = status + 1;
+			r -= p - buf;
+		}
+		while (r-- > 0 && statuslen < sizeof(statusbuf) - 1) {
+			statusbuf[statuslen++] = *p++;
+		}
+	}
+	close(fd);
+
+	if (!status) {
+		fprintf(stderr, "ERROR: daemon did not answer\n");
+		return 1;
+	}
+	statusbuf[statuslen] = '\0';
+	return strtol(statusbuf, NULL, 10);
+}
+
+int main(int argc, char *argv[]) {
+	int err;
+
+	struct lightify_ctx *ctx;
+
+	if (argc >= 3 && 0 == strcmp(argv[1], "--client")) {
+		return client_run(argv[2], argc - 3, argv + 3);
+	}
+
+	err = lightify_new(&ctx, NULL );
+	if (err < 0) {
+		fprintf(stderr, "Cannot allocate library context\n");
+		exit(1);
+	}
+
+	if (run_options(ctx, argc, argv) < 0) exit(1);
+
+	if (daemon_path) {
+		return daemon_run(ctx, daemon_path) < 0 ? 1 : 0;
+	}
 
 	return 0;
 }
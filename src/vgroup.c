@@ -0,0 +1,246 @@
+/*
+  liblightify -- library to control OSRAM's LIGHTIFY
+
+Copyright (c) 2015, Tobias Frost <tobi@coldtobi.de>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/** \file vgroup.c
+ *
+ * Virtual groups: named sets of nodes kept by the library.
+ *
+ * The gateway knows at most 16 groups, as the membership is a bitmask per
+ * node. A virtual group has no such limit; commands to it are fanned out
+ * by the planner of reconcile.c to a broadcast, the hardware groups whose
+ * members are all in the virtual group and node commands for the rest,
+ * sent as one pipelined batch.
+ *
+ * The members are stored by MAC, sorted, so they survive rescans.
+ */
+
+#include "liblightify-private.h"
+#include "context.h"
+#include "log.h"
+#include "reconcile.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct lightify_vgroup {
+	struct lightify_ctx *ctx;
+	char *name;
+
+	uint64_t *members; /**< MACs, ascending */
+	size_t count;
+	size_t alloc;
+};
+
+LIGHTIFY_EXPORT int lightify_vgroup_new(struct lightify_ctx *ctx, const char *name,
+		struct lightify_vgroup **vgroup) {
+	struct lightify_vgroup *vg;
+
+	if (!ctx || !name || !vgroup) return -EINVAL;
+
+	vg = calloc(1, sizeof(struct lightify_vgroup));
+	if (!vg) return -ENOMEM;
+
+	vg->name = strdup(name);
+	if (!vg->name) {
+		free(vg);
+		return -ENOMEM;
+	}
+	vg->ctx = ctx;
+	*vgroup = vg;
+	return 0;
+}
+
+LIGHTIFY_EXPORT int lightify_vgroup_free(struct lightify_vgroup *vgroup) {
+	if (!vgroup) return -EINVAL;
+	free(vgroup->members);
+	free(vgroup->name);
+	free(vgroup);
+	return 0;
+}
+
+LIGHTIFY_EXPORT const char *lightify_vgroup_get_name(struct lightify_vgroup *vgroup) {
+	if (!vgroup) return NULL;
+	return vgroup->name;
+}
+
+/* index of the first member >= mac */
+static size_t vgroup_find(const struct lightify_vgroup *vg, uint64_t mac) {
+	size_t lo = 0, hi = vg->count;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (vg->members[mid] < mac) lo = mid + 1;
+		else hi = mid;
+	}
+	return lo;
+}
+
+static int vgroup_is_member(const struct lightify_vgroup *vg, uint64_t mac) {
+	size_t i = vgroup_find(vg, mac);
+	return i < vg->count && vg->members[i] == mac;
+}
+
+LIGHTIFY_EXPORT int lightify_vgroup_add_node(struct lightify_vgroup *vgroup, uint64_t node_address) {
+	size_t i;
+
+	if (!vgroup) return -EINVAL;
+
+	i = vgroup_find(vgroup, node_address);
+	if (i < vgroup->count && vgroup->members[i] == node_address) return 0;
+
+	if (vgroup->count == vgroup->alloc) {
+		size_t alloc = vgroup->alloc ? vgroup->alloc * 2 : 16;
+		uint64_t *m = realloc(vgroup->members, alloc * sizeof(uint64_t));
+		if (!m) return -ENOMEM;
+		vgroup->members = m;
+		vgroup->alloc = alloc;
+	}
+
+	memmove(&vgroup->members[i + 1], &vgroup->members[i],
+			(vgroup->count - i) * sizeof(uint64_t));
+	vgroup->members[i] = node_address;
+	vgroup->count++;
+	return 0;
+}
+
+LIGHTIFY_EXPORT int lightify_vgroup_remove_node(struct lightify_vgroup *vgroup, uint64_t node_address) {
+	size_t i;
+
+	if (!vgroup) return -EINVAL;
+
+	i = vgroup_find(vgroup, node_address);
+	if (i == vgroup->count || vgroup->members[i] != node_address) return -ENOENT;
+
+	vgroup->count--;
+	memmove(&vgroup->members[i], &vgroup->members[i + 1],
+			(vgroup->count - i) * sizeof(uint64_t));
+	return 0;
+}
+
+LIGHTIFY_EXPORT int lightify_vgroup_get_member_count(struct lightify_vgroup *vgroup) {
+	if (!vgroup) return -EINVAL;
+	return vgroup->count;
+}
+
+LIGHTIFY_EXPORT struct lightify_node *lightify_vgroup_get_next_node(
+		struct lightify_vgroup *vgroup, struct lightify_node *lastnode) {
+	if (!vgroup) return NULL;
+
+	while ((lastnode = lightify_node_get_next(vgroup->ctx, lastnode))) {
+		if (vgroup_is_member(vgroup, lightify_node_get_nodeadr(lastnode))) return lastnode;
+	}
+	return NULL;
+}
+
+/* Send the attributes of proto to all members in the cache */
+static int vgroup_request(struct lightify_ctx *ctx, struct lightify_vgroup *vg,
+		const struct lightify_desired_state *proto, unsigned int fadetime) {
+	struct lightify_desired_state *desired;
+	struct lightify_batch *batch;
+	struct lightify_node *node = NULL;
+	size_t n = 0;
+	int ret, i;
+
+	if (!ctx || !vg || vg->ctx != ctx) return -EINVAL;
+	if (!vg->count) return 0;
+
+	desired = malloc(vg->count * sizeof(*desired));
+	if (!desired) return -ENOMEM;
+
+	while ((node = lightify_vgroup_get_next_node(vg, node))) {
+		desired[n] = *proto;
+		desired[n].node_address = lightify_node_get_nodeadr(node);
+		n++;
+	}
+
+	ret = lightify_batch_new(ctx, &batch);
+	if (ret < 0) goto out;
+
+	ret = reconcile_plan(ctx, desired, n, fadetime, batch, 1);
+	dbg(ctx, "vgroup %s: %d telegrams for %zu nodes\n", vg->name, ret, n);
+	if (ret > 0) {
+		ret = lightify_batch_run(batch);
+		/* report the first failure; the nodes concerned are stale now */
+		for (i = 0; ret > 0 && i < lightify_batch_get_count(batch); i++) {
+			int r = lightify_batch_get_result(batch, i);
+			if (r < 0) ret = r;
+		}
+	}
+	lightify_batch_free(batch);
+
+out:
+	free(desired);
+	return ret < 0 ? ret : 0;
+}
+
+LIGHTIFY_EXPORT int lightify_vgroup_request_onoff(struct lightify_ctx *ctx,
+		struct lightify_vgroup *vgroup, int onoff) {
+	struct lightify_desired_state d;
+
+	memset(&d, 0, sizeof(d));
+	d.fields = LIGHTIFY_STATE_ONOFF;
+	d.is_on = (onoff != 0);
+	return vgroup_request(ctx, vgroup, &d, 0);
+}
+
+LIGHTIFY_EXPORT int lightify_vgroup_request_cct(struct lightify_ctx *ctx,
+		struct lightify_vgroup *vgroup, unsigned int cct, unsigned int fadetime) {
+	struct lightify_desired_state d;
+
+	memset(&d, 0, sizeof(d));
+	d.fields = LIGHTIFY_STATE_CCT;
+	d.cct = cct & 0xffff;
+	return vgroup_request(ctx, vgroup, &d, fadetime);
+}
+
+LIGHTIFY_EXPORT int lightify_vgroup_request_rgbw(struct lightify_ctx *ctx,
+		struct lightify_vgroup *vgroup, unsigned int r, unsigned int g,
+		unsigned int b, unsigned int w, unsigned int fadetime) {
+	struct lightify_desired_state d;
+
+	memset(&d, 0, sizeof(d));
+	d.fields = LIGHTIFY_STATE_RGBW;
+	d.red = r & 0xff;
+	d.green = g & 0xff;
+	d.blue = b & 0xff;
+	d.white = w & 0xff;
+	return vgroup_request(ctx, vgroup, &d, fadetime);
+}
+
+LIGHTIFY_EXPORT int lightify_vgroup_request_brightness(struct lightify_ctx *ctx,
+		struct lightify_vgroup *vgroup, unsigned int level, unsigned int fadetime) {
+	struct lightify_desired_state d;
+
+	memset(&d, 0, sizeof(d));
+	d.fields = LIGHTIFY_STATE_BRIGHTNESS;
+	d.brightness = level & 0xff;
+	return vgroup_request(ctx, vgroup, &d, fadetime);
+}
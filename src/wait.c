@@ -0,0 +1,219 @@
+/*
+  liblightify -- library to control OSRAM's LIGHTIFY
+
+Copyright (c) 2015, Tobias Frost <tobi@coldtobi.de>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * \file wait.c
+ *
+ * Readiness layer for the default I/O functions.
+ *
+ * poll() is the default: it has no limit on the fd number (unlike select()
+ * with FD_SETSIZE) and needs no per-context state. When several contexts
+ * are driven from one loop, they can share an epoll instance instead, so the
+ * sockets are registered once and not for every wait.
+ */
+
+#include "liblightify-private.h"
+#include "context.h"
+#include "log.h"
+#include "wait.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
+struct lightify_wait {
+	/** method in use */
+	enum lightify_wait_method method;
+	/** epoll instance, -1 if none */
+	int epfd;
+	/** set if the library created epfd and needs to close it */
+	int own_epfd;
+	/** fd registered with epfd, -1 if none */
+	int fd;
+};
+
+void wait_deadline_set(struct timespec *dl, struct timeval timeout) {
+	clock_gettime(CLOCK_MONOTONIC, dl);
+	dl->tv_sec += timeout.tv_sec;
+	dl->tv_nsec += timeout.tv_usec * 1000L;
+	if (dl->tv_nsec >= 1000000000L) {
+		dl->tv_sec++;
+		dl->tv_nsec -= 1000000000L;
+	}
+}
+
+int wait_remaining_ms(const struct timespec *dl) {
+	struct timespec now;
+	long long ms;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ms = (long long)(dl->tv_sec - now.tv_sec) * 1000
+			+ (dl->tv_nsec - now.tv_nsec) / 1000000L;
+	if (ms <= 0) return 0;
+	if (ms > 0x7fffffff) return 0x7fffffff;
+	return (int) ms;
+}
+
+int wait_deadline_expired(const struct timespec *dl) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (now.tv_sec != dl->tv_sec) return now.tv_sec > dl->tv_sec;
+	return now.tv_nsec >= dl->tv_nsec;
+}
+
+void wait_deadline_clamp(struct lightify_ctx *ctx, struct timespec *dl) {
+	const struct timespec *rdl = &ctx->req_deadline;
+
+	if (!ctx->has_req_deadline) return;
+	if (rdl->tv_sec < dl->tv_sec ||
+			(rdl->tv_sec == dl->tv_sec && rdl->tv_nsec < dl->tv_nsec)) {
+		*dl = *rdl;
+	}
+}
+
+static int wait_poll(int fd, int what, const struct timespec *dl) {
+	struct pollfd pfd;
+	int n;
+
+	pfd.fd = fd;
+	pfd.events = (what == WAIT_READ) ? POLLIN : POLLOUT;
+	do {
+		pfd.revents = 0;
+		n = poll(&pfd, 1, wait_remaining_ms(dl));
+	} while (n < 0 && errno == EINTR);
+
+	if (n < 0) return -errno;
+	return n;
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+static int wait_epoll(struct lightify_ctx *ctx, struct lightify_wait *w, int fd,
+		int what, const struct timespec *dl) {
+	struct epoll_event ev, evs[8];
+	int n, i;
+
+	if (w->epfd < 0) {
+		w->epfd = epoll_create1(EPOLL_CLOEXEC);
+		if (w->epfd < 0) return -errno;
+		w->own_epfd = 1;
+	}
+
+	/* oneshot: once reported the fd stays silent until the owning context
+	 * waits on it again. So other contexts' fds won't wake us up. */
+	ev.events = ((what == WAIT_READ) ? EPOLLIN : EPOLLOUT) | EPOLLONESHOT;
+	ev.data.ptr = ctx;
+
+	if (w->fd != fd) {
+		/* fd changed (e.g reconnect) -- the old may already be gone */
+		if (w->fd >= 0) epoll_ctl(w->epfd, EPOLL_CTL_DEL, w->fd, NULL);
+		w->fd = -1;
+		n = epoll_ctl(w->epfd, EPOLL_CTL_ADD, fd, &ev);
+	} else {
+		n = epoll_ctl(w->epfd, EPOLL_CTL_MOD, fd, &ev);
+		/* closing a fd removes it from the epoll set; a new socket can get
+		 * the same number */
+		if (n < 0 && errno == ENOENT) n = epoll_ctl(w->epfd, EPOLL_CTL_ADD, fd, &ev);
+	}
+	if (n < 0) return -errno;
+	w->fd = fd;
+
+	for (;;) {
+		n = epoll_wait(w->epfd, evs, sizeof(evs) / sizeof(evs[0]), wait_remaining_ms(dl));
+		if (n < 0 && errno == EINTR) continue;
+		if (n < 0) return -errno;
+		if (n == 0) return 0;
+		for (i = 0; i < n; i++) {
+			if (evs[i].data.ptr == ctx) return 1;
+		}
+		/* only events for other contexts sharing the instance */
+		if (!wait_remaining_ms(dl)) return 0;
+	}
+}
+#endif
+
+int wait_fd(struct lightify_ctx *ctx, int fd, int what, const struct timespec *dl) {
+	struct lightify_wait *w = ctx->wait;
+
+#ifdef HAVE_SYS_EPOLL_H
+	if (w && w->method == LIGHTIFY_WAIT_EPOLL) return wait_epoll(ctx, w, fd, what, dl);
+#else
+	(void) w;
+#endif
+	return wait_poll(fd, what, dl);
+}
+
+void wait_free(struct lightify_ctx *ctx) {
+	struct lightify_wait *w = ctx->wait;
+	if (!w) return;
+
+#ifdef HAVE_SYS_EPOLL_H
+	if (w->epfd >= 0 && w->fd >= 0) epoll_ctl(w->epfd, EPOLL_CTL_DEL, w->fd, NULL);
+#endif
+	if (w->own_epfd) close(w->epfd);
+	free(w);
+	ctx->wait = NULL;
+}
+
+LIGHTIFY_EXPORT int lightify_skt_setwaitmethod(struct lightify_ctx *ctx,
+		enum lightify_wait_method method, int epfd) {
+	struct lightify_wait *w;
+
+	if (!ctx) return -EINVAL;
+
+	switch (method) {
+	case LIGHTIFY_WAIT_POLL:
+		wait_free(ctx);
+		return 0;
+	case LIGHTIFY_WAIT_EPOLL:
+#ifdef HAVE_SYS_EPOLL_H
+		break;
+#else
+		return -ENOTSUP;
+#endif
+	default:
+		return -EINVAL;
+	}
+
+	w = calloc(1, sizeof(struct lightify_wait));
+	if (!w) return -ENOMEM;
+	wait_free(ctx);
+
+	w->method = method;
+	w->epfd = epfd;
+	w->fd = -1;
+	ctx->wait = w;
+	dbg(ctx, "using epoll, %s instance\n", epfd < 0 ? "private" : "shared");
+	return 0;
+}
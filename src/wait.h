@@ -0,0 +1,98 @@
+/*
+  liblightify -- library to control OSRAM's LIGHTIFY
+
+Copyright (c) 2015, Tobias Frost <tobi@coldtobi.de>
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the author nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * \file wait.h
+ *
+ * Readiness layer: wait until the gateway socket can be read or written,
+ * bounded by a monotonic deadline.
+ */
+
+#ifndef SRC_WAIT_H_
+#define SRC_WAIT_H_
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <sys/time.h>
+#include <time.h>
+
+/** wait for the fd to become readable */
+#define WAIT_READ 1
+/** wait for the fd to become writable */
+#define WAIT_WRITE 2
+
+/** Compute an absolute deadline on the monotonic clock
+ *
+ * @param dl where to store the deadline
+ * @param timeout relative timeout from now
+ */
+void wait_deadline_set(struct timespec *dl, struct timeval timeout);
+
+/** Milliseconds left until the deadline, 0 if expired.
+ *
+ * @param dl deadline, see wait_deadline_set()
+ * @return remaining time in ms
+ */
+int wait_remaining_ms(const struct timespec *dl);
+
+/** Check if the deadline has passed
+ *
+ * @param dl deadline
+ * @return non-zero if expired
+ */
+int wait_deadline_expired(const struct timespec *dl);
+
+/** Shorten dl to the deadline of the request in flight, if that is earlier.
+ *
+ * @param ctx library context
+ * @param dl deadline to adjust
+ */
+void wait_deadline_clamp(struct lightify_ctx *ctx, struct timespec *dl);
+
+/** Wait until fd is ready or the deadline passes.
+ *
+ * Uses the method configured with lightify_skt_setwaitmethod().
+ *
+ * @param ctx library context
+ * @param fd the socket
+ * @param what WAIT_READ or WAIT_WRITE
+ * @param dl absolute deadline
+ * @return >0 when ready, 0 on timeout, negative error code
+ */
+int wait_fd(struct lightify_ctx *ctx, int fd, int what, const struct timespec *dl);
+
+/** Release resources of the readiness layer
+ *
+ * @param ctx library context
+ */
+void wait_free(struct lightify_ctx *ctx);
+
+#endif /* SRC_WAIT_H_ */